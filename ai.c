@@ -0,0 +1,393 @@
+/** @file ai.c
+ *
+ *  @brief Expectimax search on the packed board.
+ *
+ *  Max nodes try the four moves, chance nodes place a 2 (p = 2/3) or a
+ *  4 (p = 1/3) on every empty block, the same odds engine_add_random()
+ *  uses.
+ *  Paths whose probability falls below prob_cutoff are scored by the
+ *  heuristic directly, and the mass cut off that way is counted.
+ *  The search deepens one level at a time until max_depth or until the
+ *  time budget runs out, so a result is always available.
+ *
+ *  Every search fills an ai_stats_t which callers read through
+ *  ai_get_stats() to see where the search spent its effort.
+ *
+ *  ai_ponder() runs the same search while the player thinks, one depth
+ *  per call, and gives up as soon as its abort callback says a key is
+ *  waiting. What it finds stays in the transposition table, so the
+ *  following ai_search() on that board is answered from the table.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stddef.h>
+#include "ai.h"
+
+#define ROW_NUM 65536
+/* Nodes searched between two looks at the clock */
+#define CLOCK_MASK 0xff
+/* Nodes searched between two calls of the abort callback */
+#define ABORT_MASK 0xf
+#define PROB_CUTOFF 0.0001f
+
+/* Heuristic score of every possible row */
+static float row_heur[ROW_NUM];
+static int heur_ready = 0;
+
+/** @brief Build the row heuristic table
+ *
+ *  Rewards empty blocks, neighbours that can merge and rows that are
+ *  monotonic, punishes big numbers spread over the board.
+ *
+ *  @return void
+ */
+static void heur_init(void){
+    uint32_t row;
+    if(heur_ready)
+        return;
+    for(row = 0; row < ROW_NUM; row++){
+        int line[4];
+        int i;
+        int empty = 0, merges = 0, prev = 0, counter = 0;
+        int mono_low = 0, mono_high = 0, sum = 0;
+        for(i = 0; i < 4; i++){
+            line[i] = (row >> (i * 4)) & 0xf;
+            sum += line[i] * line[i] * line[i];
+            if(line[i] == 0){
+                empty++;
+            }else{
+                if(prev == line[i]){
+                    counter++;
+                }else if(counter > 0){
+                    merges += 1 + counter;
+                    counter = 0;
+                }
+                prev = line[i];
+            }
+        }
+        if(counter > 0)
+            merges += 1 + counter;
+        for(i = 1; i < 4; i++){
+            int a = line[i - 1] * line[i - 1] * line[i - 1];
+            int b = line[i] * line[i] * line[i];
+            if(a > b)
+                mono_low += a - b;
+            else
+                mono_high += b - a;
+        }
+        row_heur[row] = 200000.0f + 270.0f * empty + 700.0f * merges -
+            47.0f * (mono_low < mono_high ? mono_low : mono_high) -
+            11.0f * sum;
+    }
+    heur_ready = 1;
+}
+
+/** @brief Score a board with the heuristic
+ *
+ *  @param b: the packed board
+ *  @return the heuristic value, higher is better
+ */
+float ai_eval(bboard_t b){
+    bboard_t t = bb_transpose(b);
+    float v = 0;
+    int i;
+    for(i = 0; i < 4; i++){
+        v += row_heur[(b >> (i * 16)) & 0xffff];
+        v += row_heur[(t >> (i * 16)) & 0xffff];
+    }
+    return v;
+}
+
+/** @brief Set up a search context
+ *
+ *  @param ctx: the context to set up
+ *         tt: transposition table with 1 << tt_bits entries
+ *         tt_bits: log2 of the table size
+ *  @return void
+ */
+void ai_init(ai_ctx_t *ctx, ai_tt_entry_t *tt, unsigned int tt_bits){
+    uint32_t i;
+    bb_init();
+    heur_init();
+    ctx->tt = tt;
+    ctx->tt_mask = (1U << tt_bits) - 1;
+    for(i = 0; i <= ctx->tt_mask; i++)
+        tt[i].used = 0;
+    ctx->clock = NULL;
+    ctx->hz = 0;
+    ctx->prob_cutoff = PROB_CUTOFF;
+    ctx->deadline = 0;
+    ctx->timed = 0;
+    ctx->abort = NULL;
+    ctx->stopped = 0;
+    ctx->ponder_board = 0;
+    ctx->ponder_depth = 0;
+}
+
+/** @brief Give the search a clock for its time budget
+ *
+ *  Without a clock the search always goes to max_depth.
+ *
+ *  @param ctx: the search context
+ *         clock: returns the current tick count
+ *         hz: ticks per second
+ *  @return void
+ */
+void ai_set_clock(ai_ctx_t *ctx, unsigned long (*clock)(void),
+    unsigned int hz){
+    ctx->clock = clock;
+    ctx->hz = hz;
+}
+
+/** @brief Counters of the last search
+ *
+ *  @param ctx: the search context
+ *  @return the counters, valid until the next ai_search()
+ */
+const ai_stats_t *ai_get_stats(const ai_ctx_t *ctx){
+    return &ctx->stats;
+}
+
+/** @brief Find the table slot of a board
+ *
+ *  @return the slot
+ */
+static ai_tt_entry_t *tt_slot(ai_ctx_t *ctx, bboard_t b){
+    uint32_t h = (uint32_t)((b * 0x9E3779B97F4A7C15ULL) >> 32);
+    return &ctx->tt[h & ctx->tt_mask];
+}
+
+/** @brief Look at the clock every CLOCK_MASK + 1 nodes and ask the
+ *         abort callback every ABORT_MASK + 1 nodes
+ *
+ *  @return 1 if the search has to stop
+ */
+static int out_of_time(ai_ctx_t *ctx){
+    if(ctx->stopped)
+        return 1;
+    if(ctx->timed && (ctx->stats.nodes & CLOCK_MASK) == 0 &&
+        ctx->clock() >= ctx->deadline)
+        ctx->stopped = 1;
+    if(ctx->abort && (ctx->stats.nodes & ABORT_MASK) == 0 && ctx->abort())
+        ctx->stopped = 1;
+    return ctx->stopped;
+}
+
+static float chance_node(ai_ctx_t *ctx, bboard_t b, int depth, float prob);
+
+/** @brief Max node, the player picks the best move
+ *
+ *  @param b: the board before the move
+ *         depth: moves left to search
+ *         prob: probability of reaching this board
+ *         best: where the best move is written, may be NULL
+ *  @return value of the board
+ */
+static float max_node(ai_ctx_t *ctx, bboard_t b, int depth, float prob,
+    int *best){
+    ai_tt_entry_t *e;
+    float best_v = 0;
+    int best_m = -1;
+    int dir;
+
+    if(depth == 0){
+        ctx->stats.leaves++;
+        return ai_eval(b);
+    }
+    ctx->stats.nodes++;
+    if(out_of_time(ctx))
+        return 0;
+
+    ctx->stats.tt_probes++;
+    e = tt_slot(ctx, b);
+    if(e->used && e->key == b){
+        if(e->depth >= depth){
+            ctx->stats.tt_hits++;
+            if(best)
+                *best = e->move;
+            return e->value;
+        }
+    }else if(e->used){
+        ctx->stats.tt_collisions++;
+    }
+
+    for(dir = 0; dir < MOVE_NUM; dir++){
+        bboard_t nb = bb_move(b, dir, NULL);
+        float v;
+        if(nb == b)
+            continue;
+        v = chance_node(ctx, nb, depth, prob);
+        if(best_m < 0 || v > best_v){
+            best_v = v;
+            best_m = dir;
+        }
+    }
+    if(ctx->stopped)
+        return 0;
+    /* No move left, the game is over */
+    if(best_m < 0)
+        best_v = 0;
+
+    e->key = b;
+    e->value = best_v;
+    e->depth = (uint8_t)depth;
+    e->move = (uint8_t)(best_m < 0 ? 0 : best_m);
+    e->used = 1;
+    if(best)
+        *best = best_m;
+    return best_v;
+}
+
+/** @brief Chance node, a 2 or a 4 appears on an empty block
+ *
+ *  @param b: the board after the move
+ *         depth: moves left to search, including the one just made
+ *         prob: probability of reaching this board
+ *  @return expected value of the board
+ */
+static float chance_node(ai_ctx_t *ctx, bboard_t b, int depth, float prob){
+    int empty = bb_count_empty(b);
+    float p2, p4, sum = 0;
+    int i;
+
+    ctx->stats.nodes++;
+    if(prob < ctx->prob_cutoff || empty == 0){
+        if(empty != 0)
+            ctx->stats.pruned_mass += prob;
+        ctx->stats.leaves++;
+        return ai_eval(b);
+    }
+    p2 = 2.0f / 3.0f / empty;
+    p4 = 1.0f / 3.0f / empty;
+    for(i = 0; i < 16; i++){
+        if(((b >> (i * 4)) & 0xf) != 0)
+            continue;
+        sum += p2 * max_node(ctx, b | ((bboard_t)1 << (i * 4)),
+            depth - 1, prob * p2, NULL);
+        sum += p4 * max_node(ctx, b | ((bboard_t)2 << (i * 4)),
+            depth - 1, prob * p4, NULL);
+        if(ctx->stopped)
+            return 0;
+    }
+    return sum;
+}
+
+/** @brief Reset the counters before a search
+ *
+ *  @return void
+ */
+static void stats_reset(ai_stats_t *st){
+    st->nodes = 0;
+    st->leaves = 0;
+    st->tt_probes = 0;
+    st->tt_hits = 0;
+    st->tt_collisions = 0;
+    st->pruned_mass = 0;
+    st->depth = 0;
+    st->value = 0;
+    st->ms = 0;
+    st->nps = 0;
+}
+
+/** @brief Search the best move for a board
+ *
+ *  Deepens from 1 to max_depth and keeps the move of the deepest
+ *  iteration that finished within the time budget.
+ *
+ *  @param ctx: the search context
+ *         b: the packed board
+ *         max_depth: deepest iteration to try
+ *         ms: time budget, ignored without a clock
+ *  @return best move (MOVE_*), -1 if no move is possible
+ */
+int ai_search(ai_ctx_t *ctx, bboard_t b, int max_depth, unsigned int ms){
+    unsigned long start = 0, ticks;
+    float pruned = 0;
+    int move = -1;
+    int depth;
+
+    stats_reset(&ctx->stats);
+    ctx->stopped = 0;
+    ctx->abort = NULL;
+    ctx->timed = ctx->clock != NULL;
+    if(ctx->clock){
+        start = ctx->clock();
+        ctx->deadline = start + (ms * ctx->hz + 999) / 1000;
+    }
+
+    for(depth = 1; depth <= max_depth; depth++){
+        int m = -1;
+        float v;
+        ctx->stats.pruned_mass = 0;
+        v = max_node(ctx, b, depth, 1.0f, &m);
+        if(ctx->stopped)
+            break;
+        move = m;
+        ctx->stats.value = v;
+        pruned = ctx->stats.pruned_mass;
+        ctx->stats.depth = depth;
+        if(m < 0)
+            break;
+    }
+    ctx->stats.pruned_mass = pruned;
+    /* Not even depth 1 finished, fall back to any possible move */
+    if(move < 0 && ctx->stopped){
+        for(depth = 0; depth < MOVE_NUM && move < 0; depth++){
+            if(bb_move(b, depth, NULL) != b)
+                move = depth;
+        }
+    }
+
+    if(ctx->clock){
+        ticks = ctx->clock() - start;
+        ctx->stats.ms = (uint32_t)(ticks * 1000 / ctx->hz);
+        if(ticks == 0)
+            ticks = 1;
+        ctx->stats.nps = (uint32_t)(ctx->stats.nodes / ticks * ctx->hz);
+    }
+    return move;
+}
+
+/** @brief Search a board in the background, one depth per call
+ *
+ *  Meant for the idle loop: every call goes one level deeper than the
+ *  last one on the same board, until max_depth. The abort callback is
+ *  asked every few nodes and the call returns as soon as it says so.
+ *  The counters of ai_search() are left alone, pondering has its own
+ *  in ponder_stats.
+ *
+ *  @param ctx: the search context
+ *         b: the board waiting for the player's move
+ *         max_depth: deepest level to ponder
+ *         abort: returns non-zero when the search has to give up
+ *  @return 1 if there is more to ponder on this board, 0 otherwise
+ */
+int ai_ponder(ai_ctx_t *ctx, bboard_t b, int max_depth, int (*abort)(void)){
+    ai_stats_t saved;
+
+    if(b != ctx->ponder_board){
+        ctx->ponder_board = b;
+        ctx->ponder_depth = 0;
+        stats_reset(&ctx->ponder_stats);
+    }
+    if(ctx->ponder_depth >= max_depth)
+        return 0;
+
+    saved = ctx->stats;
+    ctx->stats = ctx->ponder_stats;
+    ctx->stopped = 0;
+    ctx->timed = 0;
+    ctx->abort = abort;
+    ctx->stats.pruned_mass = 0;
+    max_node(ctx, b, ctx->ponder_depth + 1, 1.0f, NULL);
+    if(!ctx->stopped){
+        ctx->ponder_depth++;
+        ctx->stats.depth = ctx->ponder_depth;
+    }
+    ctx->abort = NULL;
+    ctx->ponder_stats = ctx->stats;
+    ctx->stats = saved;
+    return ctx->ponder_depth < max_depth;
+}
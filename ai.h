@@ -0,0 +1,65 @@
+/** @file ai.h
+ *
+ *  @brief Expectimax search used for move hints, with counters
+ *         describing what every search did.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _AI_H_
+#define _AI_H_
+
+#include <stdint.h>
+#include "bitboard.h"
+
+/* Transposition table entry, 16 bytes */
+typedef struct
+{
+    bboard_t key;
+    float value;
+    uint8_t depth;
+    uint8_t move;
+    uint16_t used;
+}ai_tt_entry_t;
+
+/* Counters of the last search, reset by every ai_search() */
+typedef struct
+{
+    uint32_t nodes;         /* max and chance nodes expanded */
+    uint32_t leaves;        /* boards scored by the heuristic */
+    uint32_t tt_probes;     /* transposition table lookups */
+    uint32_t tt_hits;       /* lookups answered by the table */
+    uint32_t tt_collisions; /* lookups landing on another board */
+    float pruned_mass;      /* chance probability cut off, root = 1 */
+    int depth;              /* deepest completed iteration */
+    float value;            /* value of the board at that depth */
+    uint32_t ms;            /* time used */
+    uint32_t nps;           /* nodes per second */
+}ai_stats_t;
+
+typedef struct
+{
+    ai_tt_entry_t *tt;
+    uint32_t tt_mask;
+    unsigned long (*clock)(void);
+    unsigned int hz;
+    float prob_cutoff;
+    unsigned long deadline;
+    int timed;
+    int (*abort)(void);
+    int stopped;
+    ai_stats_t stats;
+    /* Background search of the board waiting for a move */
+    bboard_t ponder_board;
+    int ponder_depth;
+    ai_stats_t ponder_stats;
+}ai_ctx_t;
+
+void ai_init(ai_ctx_t *ctx, ai_tt_entry_t *tt, unsigned int tt_bits);
+void ai_set_clock(ai_ctx_t *ctx, unsigned long (*clock)(void),
+    unsigned int hz);
+int ai_search(ai_ctx_t *ctx, bboard_t b, int max_depth, unsigned int ms);
+int ai_ponder(ai_ctx_t *ctx, bboard_t b, int max_depth, int (*abort)(void));
+const ai_stats_t *ai_get_stats(const ai_ctx_t *ctx);
+float ai_eval(bboard_t b);
+
+#endif
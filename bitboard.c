@@ -0,0 +1,324 @@
+/** @file bitboard.c
+ *
+ *  @brief Table driven moves on the packed board.
+ *
+ *  The engine keeps the uint16_t board[SIZE][SIZE] used by the UI.
+ *  The search needs millions of moves per second without touching the
+ *  score or the pseudo-board, so it works on this packed copy instead.
+ *  All the 65536 possible rows are slid once in bb_init() and every
+ *  move afterwards is four table lookups.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug Merging two 32768 blocks overflows the nibble, the same way the
+ *       uint16_t board overflows in engine.c.
+ */
+
+#include "bitboard.h"
+
+#define ROW_NUM 65536
+#define ROW_MASK 0xffffULL
+
+/* Rows slid towards nibble 0 and towards nibble 3 */
+static uint16_t row_low[ROW_NUM];
+static uint16_t row_high[ROW_NUM];
+/* Score earned by sliding a row, the same for both directions */
+static uint32_t row_score[ROW_NUM];
+static int bb_ready = 0;
+
+/** @brief Reverse the four nibbles of a row
+ *
+ *  @param row: the 16-bit row
+ *  @return the reversed row
+ */
+static uint16_t reverse_row(uint16_t row){
+    return (uint16_t)((row >> 12) | ((row >> 4) & 0x00f0) |
+        ((row << 4) & 0x0f00) | (row << 12));
+}
+
+/** @brief Slide and merge one row towards nibble 0
+ *
+ *  Follows the same rules as engine_move_array() in engine.c: every
+ *  block merges at most once and the merged value is added to the score.
+ *
+ *  @param row: the 16-bit row
+ *         score: where the earned score is added, may be NULL
+ *  @return the new row
+ */
+uint16_t bb_row_slide(uint16_t row, uint32_t *score){
+    int line[4];
+    int i, t = 0;
+    int last = 0;
+    uint32_t got = 0;
+    uint16_t out = 0;
+
+    for(i = 0; i < 4; i++)
+        line[i] = 0;
+    for(i = 0; i < 4; i++){
+        int v = (row >> (i * 4)) & 0xf;
+        if(v == 0)
+            continue;
+        if(last != 0 && last == v){
+            /* Merge with the block slid before */
+            line[t - 1] = v + 1;
+            got += 1U << (v + 1);
+            last = 0;
+        }else{
+            line[t++] = v;
+            last = v;
+        }
+    }
+    for(i = 0; i < 4; i++)
+        out |= (uint16_t)((line[i] & 0xf) << (i * 4));
+    if(score)
+        *score += got;
+    return out;
+}
+
+/** @brief Build the row tables
+ *
+ *  Safe to call more than once, only the first call does the work.
+ *
+ *  @return void
+ */
+void bb_init(void){
+    uint32_t row;
+    if(bb_ready)
+        return;
+    for(row = 0; row < ROW_NUM; row++){
+        uint32_t got = 0;
+        uint16_t rev = reverse_row((uint16_t)row);
+        row_low[row] = bb_row_slide((uint16_t)row, &got);
+        row_score[row] = got;
+        row_high[row] = reverse_row(bb_row_slide(rev, 0));
+    }
+    bb_ready = 1;
+}
+
+/** @brief Pack the game board
+ *
+ *  @param board[4][4]: the board used by game.c
+ *  @return the packed board
+ */
+bboard_t bb_pack(uint16_t board[4][4]){
+    bboard_t b = 0;
+    int x, y;
+    for(x = 0; x < 4; x++){
+        for(y = 0; y < 4; y++){
+            uint16_t v = board[x][y];
+            int k = 0;
+            while(v > 1){
+                v >>= 1;
+                k++;
+            }
+            b |= (bboard_t)k << ((x * 4 + y) * 4);
+        }
+    }
+    return b;
+}
+
+/** @brief Unpack into a game board
+ *
+ *  @param b: the packed board
+ *         board[4][4]: where the numbers are written
+ *  @return void
+ */
+void bb_unpack(bboard_t b, uint16_t board[4][4]){
+    int x, y;
+    for(x = 0; x < 4; x++){
+        for(y = 0; y < 4; y++){
+            int k = BB_CELL(b, x, y);
+            board[x][y] = k ? (uint16_t)(1U << k) : 0;
+        }
+    }
+}
+
+/** @brief Transpose the packed board, (x, y) becomes (y, x)
+ *
+ *  @param b: the packed board
+ *  @return the transposed board
+ */
+bboard_t bb_transpose(bboard_t b){
+    bboard_t a1 = b & 0xF0F00F0FF0F00F0FULL;
+    bboard_t a2 = b & 0x0000F0F00000F0F0ULL;
+    bboard_t a3 = b & 0x0F0F00000F0F0000ULL;
+    bboard_t a = a1 | (a2 << 12) | (a3 >> 12);
+    bboard_t b1 = a & 0xFF00FF0000FF00FFULL;
+    bboard_t b2 = a & 0x00FF00FF00000000ULL;
+    bboard_t b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+/** @brief Move the packed board
+ *
+ *  MOVE_UP/MOVE_DOWN slide every board[x] array, MOVE_LEFT/MOVE_RIGHT
+ *  slide across them, the same as move_*() in engine.c.
+ *
+ *  @param b: the packed board
+ *         dir: one of MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT
+ *         score: where the earned score is added, may be NULL
+ *  @return the moved board, equal to b if the move is not possible
+ */
+bboard_t bb_move(bboard_t b, int dir, uint32_t *score){
+    const uint16_t *table = (dir == MOVE_UP || dir == MOVE_LEFT) ?
+        row_low : row_high;
+    bboard_t out = 0;
+    uint32_t got = 0;
+    int i;
+
+    if(dir == MOVE_LEFT || dir == MOVE_RIGHT)
+        b = bb_transpose(b);
+    for(i = 0; i < 4; i++){
+        uint16_t row = (uint16_t)((b >> (i * 16)) & ROW_MASK);
+        out |= (bboard_t)table[row] << (i * 16);
+        got += row_score[row];
+    }
+    if(dir == MOVE_LEFT || dir == MOVE_RIGHT)
+        out = bb_transpose(out);
+    if(score)
+        *score += got;
+    return out;
+}
+
+/** @brief Count the empty blocks
+ *
+ *  @param b: the packed board
+ *  @return number of empty blocks
+ */
+int bb_count_empty(bboard_t b){
+    int i, n = 0;
+    for(i = 0; i < 16; i++){
+        if(((b >> (i * 4)) & 0xf) == 0)
+            n++;
+    }
+    return n;
+}
+
+/** @brief Find the largest block
+ *
+ *  @param b: the packed board
+ *  @return exponent of the largest block, 0 for an empty board
+ */
+int bb_max_tile(bboard_t b){
+    int i, k = 0;
+    for(i = 0; i < 16; i++){
+        int v = (int)((b >> (i * 4)) & 0xf);
+        if(v > k)
+            k = v;
+    }
+    return k;
+}
+
+/** @brief Put a 2 or a 4 on a random empty block
+ *
+ *  Draws the same random numbers as engine_add_random() in engine.c, so
+ *  a packed game and a game_t seeded alike stay identical.
+ *
+ *  @param b: the packed board
+ *         rng: xorshift32 state of the game, updated
+ *  @return the new board, b itself if it is full
+ */
+bboard_t bb_add_random(bboard_t b, uint32_t *rng){
+    int len = bb_count_empty(b);
+    int pick, i;
+    if(len == 0)
+        return b;
+    pick = (int)engine_rng_below(rng, (uint32_t)len);
+    for(i = 0; i < 16; i++){
+        if(((b >> (i * 4)) & 0xf) == 0 && pick-- == 0)
+            break;
+    }
+    return b | ((bboard_t)(engine_rng_below(rng, 3) == 2 ? 2 : 1)
+        << (i * 4));
+}
+
+/** @brief Apply one of the 8 symmetries of the square
+ *
+ *  Bit 0 reverses every board[x] array, bit 1 reverses the order of the
+ *  arrays, bit 2 transposes afterwards.
+ *
+ *  @param b: the packed board
+ *         sym: the symmetry, 0 to BB_SYM_NUM - 1
+ *  @return the transformed board
+ */
+bboard_t bb_symmetry(bboard_t b, int sym){
+    if(sym & 1){
+        b = ((b & 0x000F000F000F000FULL) << 12) |
+            ((b & 0x00F000F000F000F0ULL) << 4) |
+            ((b & 0x0F000F000F000F00ULL) >> 4) |
+            ((b & 0xF000F000F000F000ULL) >> 12);
+    }
+    if(sym & 2){
+        b = (b << 48) | ((b & 0xffff0000ULL) << 16) |
+            ((b >> 16) & 0xffff0000ULL) | (b >> 48);
+    }
+    if(sym & 4)
+        b = bb_transpose(b);
+    return b;
+}
+
+/** @brief Find the smallest of the 8 symmetric boards
+ *
+ *  Boards that only differ by a rotation or a mirror have the same
+ *  value, so caches key them by this canonical form.
+ *
+ *  @param b: the packed board
+ *         sym: where the symmetry used is written, may be NULL
+ *  @return the canonical board
+ */
+bboard_t bb_canonical(bboard_t b, int *sym){
+    bboard_t best = b;
+    int best_s = 0;
+    int s;
+    for(s = 1; s < BB_SYM_NUM; s++){
+        bboard_t t = bb_symmetry(b, s);
+        if(t < best){
+            best = t;
+            best_s = s;
+        }
+    }
+    if(sym)
+        *sym = best_s;
+    return best;
+}
+
+/** @brief Map a move on a board to the same move on its symmetric board
+ *
+ *  @param move: the move on the original board
+ *         sym: the symmetry applied to the board
+ *  @return the move on the transformed board
+ */
+int bb_sym_move(int move, int sym){
+    /* Reversing the arrays swaps up/down, reversing their order swaps
+     * left/right, transposing swaps up/left and down/right */
+    if(sym & 1){
+        if(move == MOVE_UP || move == MOVE_DOWN)
+            move ^= 1;
+    }
+    if(sym & 2){
+        if(move == MOVE_LEFT || move == MOVE_RIGHT)
+            move ^= 1;
+    }
+    if(sym & 4)
+        move ^= 2;
+    return move;
+}
+
+/** @brief Map a move on a symmetric board back to the original board
+ *
+ *  @param move: the move on the transformed board
+ *         sym: the symmetry applied to the board
+ *  @return the move on the original board
+ */
+int bb_unsym_move(int move, int sym){
+    if(sym & 4)
+        move ^= 2;
+    if(sym & 2){
+        if(move == MOVE_LEFT || move == MOVE_RIGHT)
+            move ^= 1;
+    }
+    if(sym & 1){
+        if(move == MOVE_UP || move == MOVE_DOWN)
+            move ^= 1;
+    }
+    return move;
+}
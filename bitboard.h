@@ -0,0 +1,40 @@
+/** @file bitboard.h
+ *
+ *  @brief Packed 64-bit representation of the 4x4 game board.
+ *
+ *  Every block is stored as a 4-bit exponent (0 for an empty block,
+ *  k for the number 2^k). Block board[x][y] lives in nibble x * 4 + y,
+ *  so each board[x] array is one 16-bit row of the packed board.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _BITBOARD_H_
+#define _BITBOARD_H_
+
+#include <stdint.h>
+#include "engine.h"         /* MOVE_* */
+
+typedef uint64_t bboard_t;
+
+/* Block at (x, y) of a packed board */
+#define BB_CELL(b, x, y)  ((int)(((b) >> (((x) * 4 + (y)) * 4)) & 0xf))
+
+void bb_init(void);
+bboard_t bb_pack(uint16_t board[4][4]);
+void bb_unpack(bboard_t b, uint16_t board[4][4]);
+
+bboard_t bb_move(bboard_t b, int dir, uint32_t *score);
+uint16_t bb_row_slide(uint16_t row, uint32_t *score);
+bboard_t bb_transpose(bboard_t b);
+int bb_count_empty(bboard_t b);
+int bb_max_tile(bboard_t b);
+bboard_t bb_add_random(bboard_t b, uint32_t *rng);
+
+/* Symmetries of the board, 3 bits: flip y, flip x, then transpose */
+#define BB_SYM_NUM 8
+bboard_t bb_symmetry(bboard_t b, int sym);
+bboard_t bb_canonical(bboard_t b, int *sym);
+int bb_sym_move(int move, int sym);
+int bb_unsym_move(int move, int sym);
+
+#endif
@@ -0,0 +1,89 @@
+/** @file capture.c
+ *
+ *  @brief Screen capture to COM1, see capture.h.
+ *
+ *  The screen is copied with interrupts off, so the timer cannot draw
+ *  into it half way, then encoded and sent from the copy. Sending takes
+ *  a few tenths of a second at 115200 baud, the game waits for it.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <p1kern.h>
+#include <string.h>
+#include <x86/asm.h>
+
+#include "replay.h"
+#include "serial.h"
+#include "capture.h"
+
+#define CELLS (CONSOLE_WIDTH * CONSOLE_HEIGHT)
+
+static uint16_t cells[CELLS];
+/* Literals cost a byte every 128 cells on top of the cells */
+static uint8_t packed[CELLS * 2 + CELLS / CAPTURE_LITERAL_MAX + 1];
+
+/** @brief Encode the copied cells
+ *
+ *  @return number of bytes in packed[]
+ */
+static uint32_t encode(void){
+    uint32_t n = 0;
+    int i = 0, run, lit, k;
+
+    while(i < CELLS){
+        for(run = 1; i + run < CELLS && run < CAPTURE_RUN_MAX &&
+            cells[i + run] == cells[i]; run++)
+            continue;
+        if(run >= CAPTURE_RUN_MIN){
+            packed[n++] = (uint8_t)(CAPTURE_RUN + run - CAPTURE_RUN_MIN);
+            packed[n++] = (uint8_t)(cells[i] & 0xff);
+            packed[n++] = (uint8_t)(cells[i] >> 8);
+            i += run;
+            continue;
+        }
+        /* Cells up to the next pair of equal ones */
+        for(lit = 1; i + lit < CELLS && lit < CAPTURE_LITERAL_MAX &&
+            !(i + lit + 1 < CELLS && cells[i + lit] == cells[i + lit + 1]);
+            lit++)
+            continue;
+        packed[n++] = (uint8_t)(lit - 1);
+        for(k = 0; k < lit; k++){
+            packed[n++] = (uint8_t)(cells[i + k] & 0xff);
+            packed[n++] = (uint8_t)(cells[i + k] >> 8);
+        }
+        i += lit;
+    }
+    return n;
+}
+
+/** @brief Send the screen to COM1
+ *
+ *  @return void
+ */
+void capture_dump(void){
+    static const char hex[] = "0123456789abcdef";
+    char line[4 + CAPTURE_LINE_BYTES * 2 + 2];
+    uint32_t n, i, crc;
+    int len;
+
+    disable_interrupts();
+    memcpy(cells, (void *)CONSOLE_MEM_BASE, sizeof(cells));
+    enable_interrupts();
+
+    n = encode();
+    crc = replay_crc32(0, cells, sizeof(cells));
+    serial_printf("scr=begin rows=%d cols=%d bytes=%u crc=%08x\n",
+        CONSOLE_HEIGHT, CONSOLE_WIDTH, (unsigned int)n, (unsigned int)crc);
+    for(i = 0; i < n; ){
+        memcpy(line, "scr ", 4);
+        for(len = 4; i < n && len < 4 + CAPTURE_LINE_BYTES * 2; i++){
+            line[len++] = hex[packed[i] >> 4];
+            line[len++] = hex[packed[i] & 0xf];
+        }
+        line[len++] = '\n';
+        line[len] = '\0';
+        serial_puts(line);
+    }
+    serial_puts("scr=end\n");
+}
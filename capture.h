@@ -0,0 +1,37 @@
+/** @file capture.h
+ *
+ *  @brief Screen capture to COM1: every cell of the text screen,
+ *         character and attribute, run-length encoded.
+ *
+ *  The cells are taken as 2 bytes each, character then attribute, row
+ *  by row, and encoded in packets:
+ *
+ *    0x00-0x7f  n + 1 cells follow as they are     (1 to 128)
+ *    0x80-0xff  the next cell, n - 0x80 + 2 times   (2 to 129)
+ *
+ *  The encoded bytes go out as hex lines:
+ *
+ *    scr=begin rows=R cols=C bytes=N crc=XXXXXXXX
+ *    scr HEX                 (CAPTURE_LINE_BYTES bytes a line at most)
+ *    scr=end
+ *
+ *  crc is replay_crc32() of the cells before encoding. host/scrdecode
+ *  turns a capture back into text or a PNG.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+/* Encoded bytes per line, 2 hex digits each */
+#define CAPTURE_LINE_BYTES 48
+
+/* Packets */
+#define CAPTURE_LITERAL_MAX 128
+#define CAPTURE_RUN         0x80
+#define CAPTURE_RUN_MIN     2
+#define CAPTURE_RUN_MAX     129
+
+void capture_dump(void);
+
+#endif
@@ -0,0 +1,511 @@
+/** @file engine.c
+ *  @brief The 2048 engine, free of any console or keyboard code.
+ *
+ *  Move, merge, random block and win/over functions of the game. They
+ *  only touch the game_t they are given and need nothing but stdint.h,
+ *  so this file builds into the kernel and, with host/Makefile, into
+ *  libengine.a/libengine.so for Linux. Front ends draw and read keys
+ *  themselves, or hand both to engine_play() as callbacks.
+ *
+ *  @author Yuhang Jiang (yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include "engine.h"
+
+static int find_same(uint16_t board[SIZE][SIZE]);
+static void animation(uint16_t board[SIZE][SIZE],
+    uint16_t psd_board[SIZE][SIZE]);
+
+/** @brief Set up a new game
+ *
+ *  @param g: the game
+ *         seed: seed of the random blocks
+ *         target_score: number that wins the game, ENGINE_NO_TARGET
+ *                       for none
+ *  @return void
+ */
+void engine_init(game_t *g, uint32_t seed, int target_score){
+    engine_clear_num(g->board);
+    engine_clear_num(g->psd_board);
+    g->score = 0;
+    g->best_score = 0;
+    g->target_score = target_score;
+    engine_seed(g, seed);
+}
+
+/** @brief Seed the random blocks of a game
+ *
+ *  @param g: the game
+ *         seed: any value, 0 is replaced since xorshift needs a non-0 state
+ *  @return void
+ */
+void engine_seed(game_t *g, uint32_t seed){
+    g->rng = seed ? seed : 0x2048;
+}
+
+/** @brief Random number below n from a xorshift32 state
+ *
+ *  Scaled with a multiply instead of a modulo. Anything that wants the
+ *  same random numbers as the engine (bb_add_random(), replays) uses
+ *  this with the state of the game.
+ *
+ *  @param state: the xorshift32 state, updated
+ *         n: the bound
+ *  @return random number in [0, n)
+ */
+uint32_t engine_rng_below(uint32_t *state, uint32_t n){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (uint32_t)(((uint64_t)x * n) >> 32);
+}
+
+/** @brief Random number below n from the game's own generator
+ *
+ *  @param g: the game
+ *         n: the bound
+ *  @return random number in [0, n)
+ */
+uint32_t engine_rand_below(game_t *g, uint32_t n){
+    return engine_rng_below(&g->rng, n);
+}
+
+/** @brief Move the board without adding a new number
+ *
+ *  Copies the board into the pseudo-board first, so the added values
+ *  can be shown afterwards.
+ *
+ *  @param g: the game
+ *         dir: one of MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT
+ *  @return 0: action failed
+ *          1: action succeed
+ */
+int engine_move(game_t *g, int dir){
+    engine_copy_board(g->board, g->psd_board);
+    switch(dir){
+        case MOVE_UP:
+            return move_up(g);
+        case MOVE_DOWN:
+            return move_down(g);
+        case MOVE_LEFT:
+            return move_left(g);
+        case MOVE_RIGHT:
+            return move_right(g);
+    }
+    return 0;
+}
+
+/** @brief Move the board and add a new number if anything moved
+ *
+ *  @param g: the game
+ *         dir: one of MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT
+ *  @return 0: action failed
+ *          1: action succeed
+ */
+int engine_step(game_t *g, int dir){
+    int result = engine_move(g, dir);
+    if(result)
+        engine_add_random(g);
+    return result;
+}
+
+/** @brief Play a whole game through the front end's callbacks
+ *
+ *  Adds the two first numbers, then asks io->input for moves and calls
+ *  io->render after every change until the game is won, over or left.
+ *
+ *  @param g: the game, set up by engine_init()
+ *         io: rendering and input callbacks
+ *  @return ENGINE_WIN, ENGINE_OVER or ENGINE_QUIT
+ */
+int engine_play(game_t *g, const engine_io_t *io){
+    engine_add_random(g);
+    engine_add_random(g);
+    io->render(g, io->ctx);
+    while(1){
+        int dir = io->input(g, io->ctx);
+        if(dir < 0)
+            return ENGINE_QUIT;
+        if(engine_step(g, dir))
+            io->render(g, io->ctx);
+        if(is_win(g))
+            return ENGINE_WIN;
+        if(engine_is_over(g->board))
+            return ENGINE_OVER;
+    }
+}
+
+/* @brief Functions for adding random number 2 or 4 on the board
+ *
+ * First, use a 2-D array to record the location of empty numbers
+ * on the number board.
+ * Then, generate a radom number to select one element in the array.
+ * Finally, generate a random number 2 (p = 2/3) or 4 (p = 1/3) and
+ * store in the board. The numbers come from the game's own generator,
+ * so a seed replays the same game everywhere.
+ *
+ * @return void
+ */
+void engine_add_random(game_t *g){
+    int8_t x, y;
+    int16_t random_len, len = 0;
+    uint16_t n, list[SIZE * SIZE][2];
+    for (x = 0; x < SIZE; x++) {
+        for (y = 0; y < SIZE; y++) {
+            /* Find and record the empty block(0) */
+            if (g->board[x][y] == 0) {
+                /* Store the x, y location of such block */
+                list[len][0]=x;
+                list[len][1]=y;
+                /* Record the number of such empty blocks */
+                len++;
+            }
+        }
+    }
+    /* If the board is not full */
+    if (len > 0) {
+        /* Generate random number to select one empty block
+         * in the array */
+        random_len = engine_rand_below(g, len);
+        /* Generate the random 2 or 4 */
+        n = (engine_rand_below(g, 3) == 2) ? 4 : 2;
+        /* Read the location of the selected block and store
+         * new random number, then the new number will printed 
+         * out by the function draw_num */
+        x = list[random_len][0];
+        y = list[random_len][1];
+        g->board[x][y]=n;
+    }
+    return;
+}
+
+/* @brief Find the same number before the index x in the array
+ *
+ * For a single array node in the array, array[x], search through the 
+ * array[x-1]->array[0]. 
+ * If there is a node whose value is equal to the 0: 
+ * Need not merge if t = stop because the array[t] is just the one need
+ * to stay.
+ * If there is a node whose value is not equal to the 0: 
+ * if array[t] is not equal to array[x], return t+1, means cannot merge
+ * if array[t] is equal to array[x], which means they can merge, return 
+ * the index t.  
+ *
+ * @return 0: action failed
+ *         1: action succeed
+ */
+int8_t engine_find(uint16_t array[SIZE], int8_t stop, int8_t x){
+    int8_t t;
+    if(!x){
+        return x;
+    }
+    for(t = x-1; t >= 0; t--){
+        if(array[t] == 0){
+             if(t == stop)
+                return t;
+        }else{
+           if(array[t] != array[x]){
+                return t+1;
+            }
+            return t;
+        }
+    }
+    return x;
+}
+
+/* @brief Functions for move one single array
+ *
+ * Move each single array of the 2-D array one by one. And compute the 
+ * difference bewteen the new board with the old one. 
+ *
+ * @return 0: action failed
+ *         1: action succeed
+ */
+int engine_move_array(game_t *g, uint16_t array[SIZE]){
+    int i = 0;
+    uint8_t y, t, stop = 0;
+    for(y = 0; y < SIZE; y++){
+        if(array[y] != 0){
+            t = engine_find(array, stop, y);
+            /* If we find a node is not in the same place, we
+             * can move or merge */
+            if(t != y){
+                if(array[t]!=0){
+                    g->score += array[t] + array[y];
+                    /* Update the best score */
+                    if(g->best_score <= g->score)
+                        g->best_score = g->score;
+                    /* If fine one which is not 0, set stop index in order
+                     * to prevent invalid merge */
+                    stop = t + 1;
+                }
+                array[t]+= array[y];
+                array[y] = 0;
+                i = 1;
+            }
+        }
+    }
+    return i;
+}
+
+/* @brief Functions for move up
+ *
+ * Move each single array of the 2-D array one by one. And compute the 
+ * difference bewteen the new board with the old one. 
+ *
+ * @return 0: action failed
+ *         1: action succeed
+ */
+int move_up(game_t *g){
+    int i = 0;
+    int x;
+    for(x = 0; x < SIZE; x++){
+        i |= engine_move_array(g, g->board[x]);
+    }
+    animation(g->board, g->psd_board);
+    return i;
+}
+
+/* @brief Functions for move down
+ *
+ * All these three move actions takes similar theory. Rotate the board 
+ * into move up direction. After than, rotate back.
+ *
+ * @return 0: action failed
+ *         1: action succeed
+ */
+int move_down(game_t *g){
+    int i = 0;
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    i = move_up(g);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    return i;
+}
+
+/* @brief Functions for move left
+ *
+ * All these three move actions takes similar theory. Rotate the board 
+ * into move up direction. After than, rotate back.
+ *
+ * @return 0: action failed
+ *         1: action succeed
+ */
+int move_left(game_t *g){
+    int i = 0;
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    i = move_up(g);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    return i;
+}
+
+/* @brief Functions for move right
+ *
+ * All these three move actions takes similar theory. Rotate the board 
+ * into move up direction. After than, rotate back.
+ *
+ * @return 0: action failed
+ *         1: action succeed
+ */
+int move_right(game_t *g){
+    int i = 0;
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    i = move_up(g);
+    engine_rotate(g->board);
+    engine_rotate(g->psd_board);
+    return i;
+}
+
+/* @brief Functions for rotate the board
+ *
+ * We can just simply to rotate the board into the direction operated 
+ * by move up action, and keep rotating the board to the orignal 
+ * direction
+ *
+ * @return void
+ */
+void engine_rotate(uint16_t board[SIZE][SIZE]){
+    int i, j;
+    int n = SIZE;
+    int m = SIZE - 1;
+    uint16_t temp;
+    for(i = 0; i < n/2; i ++){
+        for(j = i; j < m - i; j ++){
+            temp = board[i][j];
+            board[i][j] = board[j][m-i];
+            board[j][m-i] = board[m-i][m-j];
+            board[m-i][m-j] = board[m-j][i];
+            board[m-j][i] = temp;
+        }
+    }
+    return;
+}
+
+/** @brief Functions for judge if the game is over or not
+ *  
+ *  If we cannot find a pair of numbers which can merge into a new one,
+ *  then game is over.
+ *
+ *  @return 0: game is not over
+ *          1: game is over
+ */
+int engine_is_over(uint16_t board[SIZE][SIZE]){
+    int over = 1;
+    int x, y;
+    /* Check if there is empty block */
+    for(x = 0; x < SIZE; x++){
+        for (y = 0; y < SIZE; y++){
+            if(board[x][y] == 0)
+                return 0;
+        }
+    }
+    if(find_same(board))
+        return 0;
+    engine_rotate(board);
+    if(find_same(board))
+        over = 0;
+    engine_rotate(board);
+    engine_rotate(board);
+    engine_rotate(board);
+    return over;
+}
+
+/** @brief Functions for finding a pair of number with same value
+ *  
+ *  If we cannot find a pair of numbers which can merge into a new one,
+ *  then game is over.
+ *
+ *  @return 0: cannot find the pair
+ *          1: find the pair
+ */
+static int find_same(uint16_t board[SIZE][SIZE]){
+    int x, y;
+    for(x = 0; x < SIZE; x++){
+        for (y = 0; y < SIZE - 1; y++){
+            if(board[x][y] == board[x][y+1])
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/** @brief Functions for judge if the the play wins the game or not
+ *
+ *  If there is a number is equal to the target the score, the player
+ *  wins the game.
+ *
+ *  @return 1: win the game
+ *          0: not yet
+ */
+int is_win(game_t *g){
+    int win = 0;
+    int x, y;
+    /* Empty blocks are 0 too, nothing wins without a target */
+    if(g->target_score == ENGINE_NO_TARGET)
+        return 0;
+    /* Check if there is an number equals to target */
+    for(x = 0; x < SIZE; x++){
+        for (y = 0; y < SIZE; y++){
+            if(g->board[x][y] == g->target_score)
+                win = 1;
+        }
+    }
+    return win;
+}
+
+/** @brief restored the merged value
+ *  
+ *  Since the slide animation is not obvious, I print the added number
+ *  on the top of the orignal ones to show what happens after sliding.
+ *
+ *  @return void
+ */
+static void animation(uint16_t board[SIZE][SIZE],
+    uint16_t psd_board[SIZE][SIZE]){
+    uint16_t back[SIZE][SIZE];
+    int n, m;
+    engine_copy_board(psd_board, back);
+    int i, j;
+    for(i = 0; i < SIZE; i++){
+        for(j = 0; j < SIZE; j++){
+            if(board[i][j] != 2 * psd_board[i][j])
+                psd_board[i][j] = 0;
+        }
+    }
+    for(n = 0; n < SIZE; n++){
+        for(m = 0; m < 2; m++){
+            if(m == 1){
+                if((back[n][2]!=0) && (back[n][3]!=0) &&
+                    (board[n][1] == (back[n][2]+back[n][3])))
+                    psd_board[n][1] = board[n][1]/2;
+            }
+            if(m == 0){
+                if((back[n][1]!=0) && (back[n][3]!=0) &&
+                    (board[n][0] == (back[n][1]+back[n][3])))
+                    psd_board[n][0] = board[n][0]/2;
+
+                if((back[n][2]!=0) && (back[n][3]!=0) &&
+                    (board[n][0] == (back[n][2]+back[n][3])))
+                    psd_board[n][0] = board[n][0]/2;
+
+                if((back[n][2]!=0) && (back[n][1]!=0) &&
+                    (board[n][0] == (back[n][2]+back[n][1])))
+                    psd_board[n][0] = board[n][0]/2;
+            }
+        }
+    }
+    return;
+}
+
+/** @brief Copy the contents of the real board into the pseudo-board.
+ *  
+ *  Called before moving and used to compare the number to record changes.
+ *  @param board[SIZE][SIZE]: real board
+ *         psd_board[SIZE][SIZE]: pseudo-board
+ *  @return void
+ */
+void engine_copy_board(uint16_t board[SIZE][SIZE],
+    uint16_t psd_board[SIZE][SIZE]){
+    int i, j;
+    for(i = 0; i < SIZE; i++){
+        for(j = 0; j < SIZE; j++){
+            psd_board[i][j] = board[i][j];
+        }
+    }
+    return;
+}
+
+/** @brief Hide the pseudo-number of the pseudo-board
+ *  
+ *  Clear the numbers in the board.
+ *
+ *  @return void
+ */
+void engine_clear_num(uint16_t board[SIZE][SIZE]){
+    int i, j;
+    for( i = 0; i < SIZE; i++){
+        for( j = 0; j < SIZE; j++){
+            board[i][j] = 0;
+        }
+    }
+    return;
+}
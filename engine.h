@@ -0,0 +1,87 @@
+/** @file engine.h
+ *
+ *  @brief The 2048 engine: board, moves, random blocks and win/over
+ *         checks, with no console or keyboard underneath.
+ *
+ *  The same engine.c is linked into the kernel and, through
+ *  host/Makefile, into libengine.a/libengine.so for Linux tools.
+ *  Everything a game needs lives in a game_t, so any number of games
+ *  can run side by side.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _ENGINE_H_
+#define _ENGINE_H_
+
+#include <stdint.h>
+
+/* Game buffer size */
+#define SIZE 4
+
+/*******************************************************
+ * Move directions, the same order as game.c handles them
+ *******************************************************/
+#define MOVE_UP     0
+#define MOVE_DOWN   1
+#define MOVE_LEFT   2
+#define MOVE_RIGHT  3
+#define MOVE_NUM    4
+
+typedef struct
+{
+    uint16_t board[SIZE][SIZE];
+    /* Added values of the last move, shown on top of the merged ones */
+    uint16_t psd_board[SIZE][SIZE];
+    int score;
+    int best_score;
+    int target_score;
+    uint32_t rng;           /* xorshift32 state for the new blocks */
+}game_t;
+
+/* target_score of a game with no target, played until it is over */
+#define ENGINE_NO_TARGET 0
+
+/* Results of engine_play() */
+#define ENGINE_QUIT 0
+#define ENGINE_WIN  1
+#define ENGINE_OVER 2
+
+/* Rendering and input of engine_play(), supplied by the front end */
+typedef struct
+{
+    /* Draw the game after it changed */
+    void (*render)(game_t *g, void *ctx);
+    /* Next move (MOVE_*), or -1 to leave the game */
+    int (*input)(game_t *g, void *ctx);
+    void *ctx;
+}engine_io_t;
+
+/* Set up and play */
+void engine_init(game_t *g, uint32_t seed, int target_score);
+void engine_seed(game_t *g, uint32_t seed);
+uint32_t engine_rand_below(game_t *g, uint32_t n);
+uint32_t engine_rng_below(uint32_t *state, uint32_t n);
+int engine_move(game_t *g, int dir);
+int engine_step(game_t *g, int dir);
+int engine_play(game_t *g, const engine_io_t *io);
+
+/* Game operation functions */
+void engine_add_random(game_t *g);
+int move_up(game_t *g);
+int move_down(game_t *g);
+int move_left(game_t *g);
+int move_right(game_t *g);
+int engine_move_array(game_t *g, uint16_t array[SIZE]);
+int8_t engine_find(uint16_t array[SIZE], int8_t stop, int8_t x);
+void engine_rotate(uint16_t board[SIZE][SIZE]);
+
+/* Game over/win helper functions */
+int engine_is_over(uint16_t board[SIZE][SIZE]);
+int is_win(game_t *g);
+
+/* Other help functions */
+void engine_copy_board(uint16_t board[SIZE][SIZE],
+    uint16_t psd_board[SIZE][SIZE]);
+void engine_clear_num(uint16_t board[SIZE][SIZE]);
+
+#endif
@@ -32,12 +32,31 @@
 
 #include <string.h>
 
+#include "engine.h"
+#include "bitboard.h"
+#include "ai.h"
+#include "replay.h"
+#include "serial.h"
+#include "kbench.h"
+#include "prof.h"
+#include "trace.h"
+#include "script.h"
+#include "versus.h"
+#include "wall.h"
+#include "tsc.h"
+#include "stats.h"
+#include "capture.h"
+#include "save.h"
+#include "int.h"
+
 /* Macros for mode selection */
 #define MODE128  'z'
 #define MODE256  'x'
 #define MODE512  'c'
 #define MODE1024 'v'
 #define MODE2048 'b'
+#define VERSUS   'm'
+#define RESUME   'l'
 
 /* Macros for oprations */
 #define UP       'w' 
@@ -47,9 +66,12 @@
 #define PAUSE    'p'
 #define QUIT     'q'
 #define RESTART  'r'
+#define HINT     'h'
+#define PROFILE  'f'
+#define STATS    'i'
+#define CAPTURE  'g'
+#define SAVE     'o'
 
-/* Game buffer size */
-#define SIZE 4
 /* Location for printing the number on the real board */
 #define X(x)    (x * 11 + 6)
 #define Y(y)    (y * 6 + 3)
@@ -78,33 +100,79 @@
 #define TIME_X 23
 #define TIME_Y 49
 
-
-/* Macros for generating random number, rand() from stdlib.h */
-#define RANDOM(x)      (rand()%x)
-#define RANDONM_NUM(x) ((((rand()%x)/(x-1))+1)*2)
-
+/* Location for versus on/off on the welcome page */
+#define VERSUS_X 19
+#define VERSUS_Y 3
+
+/* Location for a failed resume on the welcome page */
+#define RESUME_X 20
+#define RESUME_Y 3
+
+/* Location for the state of a save */
+#define SAVE_X 22
+#define SAVE_Y 49
+
+/* Location for the instructions, under the statistics panel */
+#define HELP_X 7
+#define HELP_Y 48
+#define HELP_ROWS 7
+#define HELP_COLS 32
+
+/* Location for the hint and the search counters */
+#define HINT_X 17
+#define HINT_Y 49
+#define HINT_ROWS 5
+
+/* Search settings for a hint */
+#define AI_TT_BITS 16
+#define AI_HINT_DEPTH 8
+#define AI_HINT_MS 300
+#define AI_PONDER_DEPTH AI_HINT_DEPTH
+
+/* Where a replay comes from, see kernel_main() */
+#define REPLAY_FROM_MODULE 1
+#define REPLAY_FROM_SERIAL 2
+/* Largest replay taken over the serial line */
+#define REPLAY_SERIAL_MAX (128 * 1024)
 /* Several global variables for the game */
-int score = 0;
-int best_score = 0;
-int target_score;
 int seconds = 0;
 int pause = 0;
-uint16_t psd_board[SIZE][SIZE]={{0}};
+/* Two games side by side instead of one, see versus.h */
+static int versus = 0;
+/* TIME on the UI, off while the versus screen is shown */
+static int show_time = 1;
+/* Board, pseudo-board and scores, see engine.h */
+game_t game;
+/* Saved game picked on the welcome page, see save.h */
+static save_record_t resume_rec;
+static int resuming = 0;
+
+/* Search context and its transposition table */
+static ai_ctx_t ai;
+static ai_tt_entry_t ai_tt[1 << AI_TT_BITS];
+static volatile unsigned long cur_ticks = 0;
+
+/* Replay played instead of the keyboard, from the module or COM1 */
+typedef struct
+{
+    const uint8_t *p;
+    const uint8_t *end;
+}replay_src_t;
+
+static int replaying = 0;
+static unsigned int replay_mps = 0;     /* moves per second, 0 = max */
+static unsigned int prof_hz = 0;        /* profiler samples/s, 0 = off */
+static uint32_t trace_boot = 0;         /* trace mask, 0 = off */
+static replay_reader_t replay;
+static replay_src_t replay_src;
+static int replay_next;                 /* read ahead: MOVE_*, REPLAY_* */
+static uint32_t replay_played = 0;
+static unsigned long replay_ticks = 0;
+static uint8_t replay_buf[REPLAY_SERIAL_MAX];
 
 void game_init();
 
-/* Game operation functions */
-void add_random(uint16_t board[SIZE][SIZE]);
-int move_up(uint16_t board[SIZE][SIZE]);
-int move_down(uint16_t board[SIZE][SIZE]);
-int move_left(uint16_t board[SIZE][SIZE]);
-int move_right(uint16_t board[SIZE][SIZE]);
-void rotate(uint16_t board[SIZE][SIZE]);
-
 /* Game over/win helper functions */
-int find_same(uint16_t board[SIZE][SIZE]);
-int is_over(uint16_t board[SIZE][SIZE]);
-int is_win(uint16_t board[SIZE][SIZE]);
 int game_win();
 int game_over();
 
@@ -112,18 +180,31 @@ int game_over();
 void set_target_score();
 int set_color(int num);
 void draw_num(uint16_t board[SIZE][SIZE]);
-void clear_num(uint16_t board[SIZE][SIZE]);
 void draw_psd_num(uint16_t psd_board[SIZE][SIZE]);
 void hide_psd_num(uint16_t psd_board[SIZE][SIZE]);
 void print_score();
 void print_mode();
 void print_bestscore();
-void animation(uint16_t board[SIZE][SIZE], uint16_t psd_board[SIZE][SIZE]);
-void copy_borad(uint16_t board[SIZE][SIZE], uint16_t psd_board[SIZE][SIZE]);
+void print_hint(int move);
+void print_help();
+void print_save(const char *state);
 
 void debug_print(uint16_t board[SIZE][SIZE]);
 
 void tick(unsigned int numTicks);
+unsigned long get_ticks(void);
+static void setup(void);
+
+/* Adds a random number, traced */
+void spawn(void);
+
+/* Replay functions */
+int replay_load(mbinfo_t *mbinfo, int from);
+int replay_key(void);
+void replay_finish(void);
+
+/* Declared in int.c */
+int kbd_pending(void);
 
 /** @brief Kernel entrypoint.
  *  
@@ -134,10 +215,48 @@ void tick(unsigned int numTicks);
  */
 int kernel_main(mbinfo_t *mbinfo, int argc, char **argv, char **envp)
 {
+    int i, from = 0, bench = 0, wall = 0;
+
     /*
      * Initialize device-driver library.
      */
-    
+    serial_init();
+
+    /* "replay" plays the first boot module, "replay=serial" a replay
+     * sent to COM1, "mps=N" sets the pace (max speed without it),
+     * "bench" runs the self-benchmark instead of the game, "prof" or
+     * "prof=HZ" samples the kernel for the profiler, "trace" or
+     * "trace=all" (timer included) sends a trace of events to COM1,
+     * "wall" or "wall=N" shows N games played by the search, "save=LBA"
+     * reserves sector LBA (not 0) for the saved game, saving is off
+     * without it */
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "bench") == 0)
+            bench = 1;
+        else if(strcmp(argv[i], "wall") == 0)
+            wall = WALL_MIN;
+        else if(strncmp(argv[i], "wall=", 5) == 0)
+            wall = atoi(argv[i] + 5);
+        else if(strcmp(argv[i], "replay") == 0)
+            from = REPLAY_FROM_MODULE;
+        else if(strcmp(argv[i], "replay=serial") == 0)
+            from = REPLAY_FROM_SERIAL;
+        else if(strncmp(argv[i], "mps=", 4) == 0)
+            replay_mps = (unsigned int)atoi(argv[i] + 4);
+        else if(strcmp(argv[i], "prof") == 0)
+            prof_hz = PROF_MIN_HZ;
+        else if(strncmp(argv[i], "prof=", 5) == 0)
+            prof_hz = (unsigned int)atoi(argv[i] + 5);
+        else if(strcmp(argv[i], "trace") == 0)
+            trace_boot = TRACE_DEFAULT;
+        else if(strcmp(argv[i], "trace=all") == 0)
+            trace_boot = TRACE_ALL;
+        else if(strncmp(argv[i], "save=", 5) == 0 &&
+            save_set_lba((uint32_t)atoi(argv[i] + 5)) != 0)
+            serial_printf("save=error reason=lba arg=%s\n", argv[i] + 5);
+    }
+    if(from != 0)
+        replaying = replay_load(mbinfo, from) == 0;
 
     /*
      * When kernel_main() begins, interrupts are DISABLED.
@@ -146,7 +265,22 @@ int kernel_main(mbinfo_t *mbinfo, int argc, char **argv, char **envp)
      */
 
     lprintf( "Hello from a brand new kernel!" );
-    game_init();
+    if(bench){
+        setup();
+        kbench_run(&ai);
+        if(prof_hz)
+            prof_dump();
+    }else if(wall){
+        /* The wall owns the whole screen */
+        show_time = 0;
+        setup();
+        wall_run(&ai, wall, get_ticks);
+        clear_console();
+        set_term_color(FGND_BCYAN);
+        printf("Wall of boards stopped.");
+    }else{
+        game_init();
+    }
 
     while(1)
         continue;
@@ -162,7 +296,8 @@ int kernel_main(mbinfo_t *mbinfo, int argc, char **argv, char **envp)
  */
 void tick(unsigned int numTicks)
 {  
-    if(numTicks %100 == 0){
+    cur_ticks = numTicks;
+    if(numTicks %100 == 0 && show_time){
         if(pause == 0){
             seconds ++;
         }
@@ -173,6 +308,174 @@ void tick(unsigned int numTicks)
 
 }
 
+/** @brief Clock used by the search for its time budget
+ *
+ *  @return number of timer ticks so far, 100 per second
+ */
+unsigned long get_ticks(void)
+{
+    return cur_ticks;
+}
+
+/** @brief Start what every mode runs on
+ *
+ *  The search, the timer and keyboard handlers, and the profiler and
+ *  trace when the boot options asked for them.
+ *
+ *  @return void
+ */
+static void setup(void)
+{
+    ai_init(&ai, ai_tt, AI_TT_BITS);
+    ai_set_clock(&ai, get_ticks, TIMER_HZ);
+    handler_install(tick);
+    enable_interrupts();
+    if(prof_hz)
+        prof_start(prof_hz);
+    if(trace_boot)
+        trace_start(trace_boot);
+}
+
+/** @brief Add a random number to the game, tracing where it went
+ *
+ *  @return void
+ */
+void spawn(void)
+{
+    bboard_t before, after;
+    int sq;
+
+    if(!(trace_mask & TRACE_BIT(TRACE_SPAWN))){
+        engine_add_random(&game);
+        return;
+    }
+    before = bb_pack(game.board);
+    engine_add_random(&game);
+    after = bb_pack(game.board);
+    for(sq = 0; sq < SIZE * SIZE; sq++){
+        if(((before ^ after) >> (sq * 4)) & 0xf){
+            trace_event(TRACE_SPAWN, sq | ((after >> (sq * 4)) & 0xf) << 8);
+            break;
+        }
+    }
+}
+
+/** @brief Read callback of the replay, out of the loaded bytes
+ *
+ *  @return number of bytes read
+ */
+static int replay_read(void *ctx, void *buf, uint32_t len)
+{
+    replay_src_t *src = ctx;
+    uint32_t left = (uint32_t)(src->end - src->p);
+    if(len > left)
+        len = left;
+    memcpy(buf, src->p, len);
+    src->p += len;
+    return (int)len;
+}
+
+/** @brief Find the replay and read its header
+ *
+ *  A boot module is used where it was loaded. Over COM1, the replay
+ *  comes as a 4-byte little endian length and the bytes, and is taken
+ *  in whole before the game starts so that the line never slows the
+ *  replay down.
+ *
+ *  @param mbinfo: the multiboot info
+ *         from: REPLAY_FROM_MODULE or REPLAY_FROM_SERIAL
+ *  @return 0 on success, -1 or REPLAY_ERR_* if there is no replay
+ */
+int replay_load(mbinfo_t *mbinfo, int from)
+{
+    struct multiboot_module *mod;
+    uint32_t len = 0, i;
+    int ret;
+
+    if(from == REPLAY_FROM_MODULE){
+        if(!(mbinfo->flags & MULTIBOOT_MODS) || mbinfo->mods_count == 0){
+            serial_printf("replay=error reason=no-module\n");
+            return -1;
+        }
+        mod = (struct multiboot_module *)mbinfo->mods_addr;
+        replay_src.p = (const uint8_t *)mod->mod_start;
+        replay_src.end = (const uint8_t *)mod->mod_end;
+    }else{
+        serial_printf("replay=waiting\n");
+        for(i = 0; i < 4; i++)
+            len |= (uint32_t)serial_getc() << (i * 8);
+        if(len > REPLAY_SERIAL_MAX){
+            serial_printf("replay=error reason=too-long bytes=%u\n",
+                (unsigned int)len);
+            return -1;
+        }
+        for(i = 0; i < len; i++)
+            replay_buf[i] = (uint8_t)serial_getc();
+        replay_src.p = replay_buf;
+        replay_src.end = replay_buf + len;
+    }
+    if((ret = replay_read_begin(&replay, replay_read, &replay_src)) != 0){
+        serial_printf("replay=error code=%d\n", ret);
+        return ret;
+    }
+    replay_next = replay_read_move(&replay);
+    return 0;
+}
+
+/** @brief Next key of the replay, paced by replay_mps
+ *
+ *  @return the key of the next move, -1 without one
+ */
+int replay_key(void)
+{
+    static const char keys[MOVE_NUM] = { UP, DOWN, LEFT, RIGHT };
+    int dir = replay_next;
+
+    if(dir < 0){
+        replay_finish();
+        return -1;
+    }
+    if(replay_mps != 0){
+        while(cur_ticks - replay_ticks <
+            (unsigned long)replay_played * TIMER_HZ / replay_mps)
+            continue;
+    }
+    replay_next = replay_read_move(&replay);
+    replay_played++;
+    return keys[dir];
+}
+
+/** @brief Check the game against the end of the replay and report
+ *
+ *  The result goes to the hint panel and, as one line of key=value
+ *  pairs, to COM1. The keyboard takes over the game afterwards.
+ *
+ *  @return void
+ */
+void replay_finish(void)
+{
+    unsigned long ticks = cur_ticks - replay_ticks;
+    unsigned long ms = ticks / TIMER_HZ * 1000 +
+        ticks % TIMER_HZ * 1000 / TIMER_HZ;
+    unsigned long mps = ticks ? replay_played * TIMER_HZ / ticks : 0;
+    int ok = replay_next == REPLAY_END &&
+        replay_check(&game, &replay.end, replay_played) == 0;
+
+    replaying = 0;
+    set_term_color(ok ? FGND_BGRN : FGND_RED);
+    set_cursor(HINT_X, HINT_Y);
+    printf("REPLAY %-10s", ok ? "OK" : "FAILED");
+    set_term_color(FGND_LGRAY);
+    set_cursor(HINT_X + 1, HINT_Y);
+    printf("moves %-10u", (unsigned int)replay_played);
+    set_cursor(HINT_X + 2, HINT_Y);
+    printf("ms %-8lu mps %-6lu", ms, mps);
+    serial_printf("replay=%s moves=%u score=%d max=%d ms=%lu mps=%lu"
+        " code=%d\n", ok ? "ok" : "failed", (unsigned int)replay_played,
+        game.score, 1 << bb_max_tile(bb_pack(game.board)), ms, mps,
+        replay_next);
+}
+
 /** @brief Welcome page
  *
  *  Inclueds instructions and provides five mode for the game.
@@ -194,8 +497,8 @@ static const char *welcome =
 "                                                                                "
 "   'z': 128 mode    'x': 256 mode                                               "
 "   'c': 512 mode    'v': 1024 mode                                              "
-"   'b': 2048 mode                                                               "
-"                                                      @Author: Yuhang Jiang     "
+"   'b': 2048 mode    'm': versus, two players side by side (on/off)             "
+"   'l': resume the saved game                         @Author: Yuhang Jiang     "
 "                                                        @Andrew ID: yuhangj     "
 "                                                                                "
 "                                              ";
@@ -217,9 +520,9 @@ static const char *UI =
 " |          |          |          |          |   'p' to pause                   "
 " |          |          |          |          |   'q' to quit                    "
 " |          |          |          |          |   'r' to restart                 "
-" +----------+----------+----------+----------+                                  "
-" |          |          |          |          |                                  "
-" |          |          |          |          |                                  "
+" +----------+----------+----------+----------+   'h' for a hint                 "
+" |          |          |          |          |   'i' for statistics             "
+" |          |          |          |          |   'o' to save                    "
 " |          |          |          |          |                                  "
 " |          |          |          |          |                                  "
 " |          |          |          |          |                                  "
@@ -255,26 +558,55 @@ static const char *BYE =
 "                                                    @Andrew ID: yuhangj         ";
 
 void game_init(){
-    uint16_t board[SIZE][SIZE]={{0}};
+    uint16_t (*board)[SIZE] = game.board;
 
-    char ch;
+    int ch;
     int result;
     int gameover, goodbye;
     int win;
+    int move;
+    int saved;
+    uint64_t t0 = 0;
 
-    handler_install(tick);
-    enable_interrupts();
+    setup();
 restartgame:
+    /* A save not written yet is written before the game goes away */
+    save_flush(get_ticks);
     /* Clear thr console and (re)set the target score */
     clear_console();
-    set_target_score();
+    if(replaying)
+        game.target_score = replay.header.target_score;
+    else
+        set_target_score();
+    /* Both players play in versus.c until one of them quits */
+    if(versus){
+        show_time = 0;
+        versus_run(game.target_score, (uint32_t)cur_ticks, get_ticks);
+        show_time = 1;
+        clear_console();
+        set_term_color(FGND_BCYAN);
+        printf("%s", BYE);
+        return;
+    }
     /* Clear the number in the board */
-    clear_num(board);
+    engine_clear_num(board);
+    /* New numbers depend on how long the welcome page was shown, a
+     * replay brings its own seed */
+    engine_seed(&game, replaying ? replay.header.seed : (uint32_t)cur_ticks);
+    /* A resumed game goes on from where it was saved */
+    if(resuming){
+        bb_unpack(resume_rec.board, board);
+        game.score = resume_rec.score;
+        if(resume_rec.best_score > game.best_score)
+            game.best_score = resume_rec.best_score;
+        game.rng = resume_rec.rng;
+    }
     /* Print the UI for game */
     set_term_color(FGND_BCYAN);
     printf("%s", UI);
+    stats_expose();
     /* Print the selected mode and the best score if not 0 */
-    if(best_score!=0)
+    if(game.best_score!=0)
         print_bestscore();
     print_mode();
 
@@ -283,11 +615,17 @@ restartgame:
     /* Hide the ugly curosr */
     hide_cursor();
     /* Add two random number in the beginning of the game */
-    add_random(board);
-    add_random(board);
+    if(!resuming){
+        spawn();
+        spawn();
+    }else{
+        print_score();
+    }
     draw_num(board);
     /* (re)set the time before entering in to the game */
-    seconds = 0;
+    seconds = resuming ? resume_rec.seconds : 0;
+    resuming = 0;
+    replay_ticks = cur_ticks;
     while(1){
         result = 0;
         goodbye = 0;
@@ -296,31 +634,39 @@ restartgame:
         // while((seconds-sleep)==25){
         //     break;
         // }
-        // hide_psd_num(psd_board);
+        // hide_psd_num(game.psd_board);
         /* Copy the board into pseudo-board before moving the blocks */
-        copy_borad(board, psd_board);
-        ch = readchar(); 
+        engine_copy_board(board, game.psd_board);
+        ch = replaying ? replay_key() : readchar();
+        if(ch != -1){
+            TRACE(TRACE_KEY, (uint8_t)ch);
+            t0 = read_tsc();
+        }
         /* Wait for player's instructions, if 'pause' triggered, lock
          * every possible 4 move actions */   
         switch(ch){
             case UP:
                 if(pause == 0){
-                    result = move_up(board);
+                    result = move_up(&game);
+                    TRACE(TRACE_MOVE, MOVE_UP | result << 8);
                 }
                 break;
             case DOWN:
                 if(pause == 0){
-                    result = move_down(board);
+                    result = move_down(&game);
+                    TRACE(TRACE_MOVE, MOVE_DOWN | result << 8);
                 }
                 break;
             case LEFT:
                 if(pause == 0){
-                    result = move_left(board);
+                    result = move_left(&game);
+                    TRACE(TRACE_MOVE, MOVE_LEFT | result << 8);
                 }
                 break;
             case RIGHT:
                 if(pause == 0){
-                    result = move_right(board);
+                    result = move_right(&game);
+                    TRACE(TRACE_MOVE, MOVE_RIGHT | result << 8);
                 }
                 break;
             case PAUSE:
@@ -339,6 +685,44 @@ restartgame:
                     printf("---------+----------+----------+----------");
                 }
                 break;
+            case HINT:
+                /* Search the current board and show the counters */
+                if(pause == 0){
+                    TRACE(TRACE_SEARCH_BEGIN, AI_HINT_DEPTH);
+                    move = ai_search(&ai, bb_pack(board), AI_HINT_DEPTH,
+                        AI_HINT_MS);
+                    TRACE(TRACE_SEARCH_END, ai_get_stats(&ai)->nodes);
+                    print_hint(move);
+                }
+                break;
+            case PROFILE:
+                /* Send the profile so far to COM1 */
+                prof_dump();
+                break;
+            case STATS:
+                /* Show the statistics over the instructions, or give
+                 * the instructions back */
+                if(!stats_toggle(cur_ticks))
+                    print_help();
+                break;
+            case CAPTURE:
+                /* Send the screen to COM1 */
+                capture_dump();
+                break;
+            case SAVE:
+                /* Take the game as it is now, the disk is written from
+                 * the idle loop */
+                resume_rec.board = bb_pack(board);
+                resume_rec.score = game.score;
+                resume_rec.best_score = game.best_score;
+                resume_rec.target_score = game.target_score;
+                resume_rec.seconds = seconds;
+                resume_rec.rng = game.rng;
+                if(save_start(&resume_rec, cur_ticks) == SAVE_OK)
+                    print_save("SAVING...");
+                else
+                    print_save("SAVE IS OFF");
+                break;
             case QUIT:
                 /* Reset the pause flag before showing the 'bye' page */
                 if(pause == 1)
@@ -349,27 +733,52 @@ restartgame:
                 /* Reset the pause flag before restarting the game */
                 if(pause == 1)
                     pause = 0;
-                score = 0;
-                clear_num(board);
+                game.score = 0;
+                engine_clear_num(board);
                 goto restartgame;
+            default:
+                /* No key yet, search ahead while the player thinks so
+                 * that the next hint comes from the table. Any key that
+                 * arrives stops the search right away. */
+                if(ch == -1){
+                    if((saved = save_poll(cur_ticks)) != 0)
+                        print_save(saved > 0 ? "SAVED" : "SAVE FAILED");
+                    script_poll();
+                    trace_drain();
+                    stats_poll(cur_ticks);
+                }
+                if(ch == -1 && pause == 0)
+                    ai_ponder(&ai, bb_pack(board), AI_PONDER_DEPTH,
+                        kbd_pending);
+                break;
         }
         /* Move actions succeed and draw relavent info on the game UI */
         if(result == 1){
-            hide_psd_num(psd_board);
-            add_random(board);
+            spawn();
+            stats_move(read_tsc() - t0);
+            t0 = read_tsc();
+            TRACE(TRACE_RENDER_BEGIN, 0);
+            hide_psd_num(game.psd_board);
             draw_num(board);
-            draw_psd_num(psd_board);
+            draw_psd_num(game.psd_board);
             print_score();
             print_bestscore();
+            TRACE(TRACE_RENDER_END, 0);
+            stats_frame(read_tsc() - t0);
         }
+        /* Check a replay after its last move, before the win/over page.
+         * Until then nobody is at the keyboard to answer those pages, so
+         * the replay plays on through them. */
+        if(replaying && replay_next < 0)
+            replay_finish();
         /* Judge win or not */
-        if(is_win(board)){
+        if(!replaying && is_win(&game)){
             if(game_win()){
                 gameover = 0;
                 goodbye = 1;
                 break;
             }else{
-                score = 0;
+                game.score = 0;
                 set_cursor(0,0);
                 goto restartgame;
             }
@@ -379,8 +788,8 @@ restartgame:
             break;
         }
         /* If move actions failed, judge game is over or not */
-        if(result == 0 ){
-            if(is_over(board)){
+        if(result == 0 && !replaying){
+            if(engine_is_over(board)){
                 gameover = 1;
                 break;
             }
@@ -392,13 +801,14 @@ restartgame:
     if(gameover == 1){
         goodbye = game_over();
         if(!goodbye){
-            score = 0;
+            game.score = 0;
             set_cursor(0, 0);
             goto restartgame;
         }
     }
     /* If player want to exit the game, show the 'goodbye' page */
     if(goodbye == 1){
+        save_flush(get_ticks);
         clear_console();
         set_term_color(FGND_BCYAN);
         printf("%s", BYE);
@@ -406,66 +816,6 @@ restartgame:
     }
 }
 
-/** @brief restored the merged value
- *  
- *  Since the slide animation is not obvious, I print the added number
- *  on the top of the orignal ones to show what happens after sliding.
- *
- *  @return void
- */
-void animation(uint16_t board[SIZE][SIZE], uint16_t psd_board[SIZE][SIZE]){
-    uint16_t back[SIZE][SIZE];
-    int n, m;
-    copy_borad(psd_board, back);
-    int i, j;
-    for(i = 0; i < SIZE; i++){
-        for(j = 0; j < SIZE; j++){
-            if(board[i][j] != 2 * psd_board[i][j])
-                psd_board[i][j] = 0;
-        }
-    }
-    for(n = 0; n < SIZE; n++){
-        for(m = 0; m < 2; m++){
-            if(m == 1){
-                if((back[n][2]!=0) && (back[n][3]!=0) &&
-                    (board[n][1] == (back[n][2]+back[n][3])))
-                    psd_board[n][1] = board[n][1]/2;
-            }
-            if(m == 0){
-                if((back[n][1]!=0) && (back[n][3]!=0) &&
-                    (board[n][0] == (back[n][1]+back[n][3])))
-                    psd_board[n][0] = board[n][0]/2;
-
-                if((back[n][2]!=0) && (back[n][3]!=0) &&
-                    (board[n][0] == (back[n][2]+back[n][3])))
-                    psd_board[n][0] = board[n][0]/2;
-
-                if((back[n][2]!=0) && (back[n][1]!=0) &&
-                    (board[n][0] == (back[n][2]+back[n][1])))
-                    psd_board[n][0] = board[n][0]/2;
-            }
-        }
-    }
-    return;
-}
-
-/** @brief Copy the contents of the real board into the pseudo-board.
- *  
- *  Called before moving and used to compare the number to record changes.
- *  @param board[SIZE][SIZE]: real board
- *         psd_board[SIZE][SIZE]: pseudo-board
- *  @return void
- */
-void copy_borad(uint16_t board[SIZE][SIZE], uint16_t psd_board[SIZE][SIZE]){
-    int i, j;
-    for(i = 0; i < SIZE; i++){
-        for(j = 0; j < SIZE; j++){
-            psd_board[i][j] = board[i][j];
-        }
-    }
-    return;
-}
-
 /** @brief Set the target socre
  *  
  *  Instuctions for selecting and setting the target score 
@@ -473,41 +823,62 @@ void copy_borad(uint16_t board[SIZE][SIZE], uint16_t psd_board[SIZE][SIZE]){
  *  @return void
  */
 void set_target_score(){
-    char select;
-    char c;
+    int select;
+    int c;
     set_term_color(FGND_BCYAN);
     printf("%s", welcome);
     hide_cursor();
     while(1){
-        target_score = 0;
+        game.target_score = 0;
         select = readchar();
         /* Set the target score */
         switch(select){
             case MODE128:
-                target_score = 128;
+                game.target_score = 128;
                 break;
             case MODE256:
-                target_score = 256;
+                game.target_score = 256;
                 break;
             case MODE512:
-                target_score = 512;
+                game.target_score = 512;
                 break;
             case MODE1024:
-                target_score = 1024;
+                game.target_score = 1024;
                 break;
             case MODE2048:
-                target_score = 2048;
+                game.target_score = 2048;
                 break;
+            case RESUME:
+                /* Take the target and the game from the saved one */
+                if(save_load(&resume_rec, get_ticks) == SAVE_OK){
+                    game.target_score = resume_rec.target_score;
+                    resuming = 1;
+                    versus = 0;
+                    break;
+                }
+                set_cursor(RESUME_X, RESUME_Y);
+                printf("No saved game to resume.");
+                continue;
+            case VERSUS:
+                /* Toggle versus and show it */
+                versus = !versus;
+                set_cursor(VERSUS_X, VERSUS_Y);
+                printf(versus ? "Versus mode: ON " : "                ");
+                continue;
             default:
                 continue;
         }
-        if(target_score!= 0)
+        if(game.target_score!= 0 || resuming)
             break;
     }
     /* Wait for selection confirmation and continue the game */
     set_cursor(22, 22);
-    printf("You selected '%d' mode! Please type 'y' to continue.\n",
-        target_score);
+    if(resuming)
+        printf("Saved '%d' game, score %d! Please type 'y' to continue.\n",
+            game.target_score, (int)resume_rec.score);
+    else
+        printf("You selected '%d' mode! Please type 'y' to continue.\n",
+            game.target_score);
     while(1){
         c = readchar();
         switch(c){
@@ -612,70 +983,6 @@ void hide_psd_num(uint16_t psd_board[SIZE][SIZE]){
     return;
 }
 
-/** @brief Hide the pseudo-number of the pseudo-board
- *  
- *  Clear the numbers in the board.
- *
- *  @return void
- */
-void clear_num(uint16_t board[SIZE][SIZE]){
-    int i, j;
-    for( i = 0; i < SIZE; i++){
-        for( j = 0; j < SIZE; j++){
-            board[i][j] = 0;
-        }
-    }
-    return;
-}
-
-/** @brief Functions for judge if the game is over or not
- *  
- *  If we cannot find a pair of numbers which can merge into a new one,
- *  then game is over.
- *
- *  @return 0: game is not over
- *          1: game is over
- */
-int is_over(uint16_t board[SIZE][SIZE]){
-    int over = 1;
-    int x, y;
-    /* Check if there is empty block */
-    for(x = 0; x < SIZE; x++){
-        for (y = 0; y < SIZE; y++){
-            if(board[x][y] == 0)
-                return 0;
-        }
-    }
-    if(find_same(board))
-        return 0;
-    rotate(board);
-    if(find_same(board))
-        over = 0;
-    rotate(board);
-    rotate(board);
-    rotate(board);
-    return over;
-}
-
-/** @brief Functions for finding a pair of number with same value
- *  
- *  If we cannot find a pair of numbers which can merge into a new one,
- *  then game is over.
- *
- *  @return 0: cannot find the pair
- *          1: find the pair
- */
-int find_same(uint16_t board[SIZE][SIZE]){
-    int x, y;
-    for(x = 0; x < SIZE; x++){
-        for (y = 0; y < SIZE - 1; y++){
-            if(board[x][y] == board[x][y+1])
-                return 1;
-        }
-    }
-    return 0;
-}
-
 
 /*  @brief Functions for printing instructions after game over
  *  
@@ -688,7 +995,7 @@ int find_same(uint16_t board[SIZE][SIZE]){
 int game_over(){
     int goodbye;
     int restart;
-    char ch;
+    int ch;
     set_term_color(FGND_BCYAN);
     set_cursor(10, 12);
     printf("BAD LUCK!! GAME IS OVER!");
@@ -723,27 +1030,6 @@ int game_over(){
     return 0;
 }
 
-/** @brief Functions for judge if the the play wins the game or not
- *
- *  If there is a number is equal to the target the score, the player
- *  wins the game.
- *
- *  @return 1: win the game
- *          0: not yet
- */
-int is_win(uint16_t board[SIZE][SIZE]){
-    int win = 0;
-    int x, y;
-    /* Check if there is an number equals to target */
-    for(x = 0; x < SIZE; x++){
-        for (y = 0; y < SIZE; y++){
-            if(board[x][y] == target_score)
-                win = 1;
-        }
-    }
-    return win;
-}
-
 /* @brief Functions for printing instructions after win.
  *
  * Show the 'player win' info, and instruction guide for restarting
@@ -755,10 +1041,10 @@ int is_win(uint16_t board[SIZE][SIZE]){
 int game_win(){
     int goodbye;
     int restart;
-    char ch;
+    int ch;
     set_term_color(FGND_BCYAN);
     set_cursor(10, 10);
-    printf("GOT %d! GOOD LUCK! YOU WIN!", target_score);
+    printf("GOT %d! GOOD LUCK! YOU WIN!", game.target_score);
     set_cursor(14, 20);
     printf("TO RESTART GAME: press 'r'");
     set_cursor(16, 20);
@@ -790,226 +1076,6 @@ int game_win(){
     return 0;
 }
 
-/* @brief Functions for adding random number 2 or 4 on the board
- *
- * First, use a 2-D array to record the location of empty numbers
- * on the number board.
- * Then, generate a radom number to select one element in the array.
- * Finally, generate a random number 2 or 4 and store in the board.
- *
- * @return void
- */
-void add_random(uint16_t board[SIZE][SIZE]){
-    int8_t x, y;
-    int16_t random_len, len = 0;
-    uint16_t n, list[SIZE * SIZE][2];
-    for (x = 0; x < SIZE; x++) {
-        for (y = 0; y < SIZE; y++) {
-            /* Find and record the empty block(0) */
-            if (board[x][y] == 0) {
-                /* Store the x, y location of such block */
-                list[len][0]=x;
-                list[len][1]=y;
-                /* Record the number of such empty blocks */
-                len++;
-            }
-        }
-    }
-    /* If the board is not full */
-    if (len > 0) {
-        /* Generate random number to select one empty block
-         * in the array */
-        random_len = RANDOM(len);
-        /* Generate the random 2 or 4 */
-        n = RANDONM_NUM(3);
-        /* Read the location of the selected block and store
-         * new random number, then the new number will printed 
-         * out by the function draw_num */
-        x = list[random_len][0];
-        y = list[random_len][1];
-        board[x][y]=n;
-    }
-    return;
-}
-
-/* @brief Find the same number before the index x in the array
- *
- * For a single array node in the array, array[x], search through the 
- * array[x-1]->array[0]. 
- * If there is a node whose value is equal to the 0: 
- * Need not merge if t = stop because the array[t] is just the one need
- * to stay.
- * If there is a node whose value is not equal to the 0: 
- * if array[t] is not equal to array[x], return t+1, means cannot merge
- * if array[t] is equal to array[x], which means they can merge, return 
- * the index t.  
- *
- * @return 0: action failed
- *         1: action succeed
- */
-int8_t find(uint16_t array[SIZE], int8_t stop, int8_t x){
-    int8_t t;
-    if(!x){
-        return x;
-    }
-    for(t = x-1; t >= 0; t--){
-        if(array[t] == 0){
-             if(t == stop)
-                return t;
-        }else{
-           if(array[t] != array[x]){
-                return t+1;
-            }
-            return t;
-        }
-    }
-    return x;
-}
-
-/* @brief Functions for move up
- *
- * Move each single array of the 2-D array one by one. And compute the 
- * difference bewteen the new board with the old one. 
- *
- * @return 0: action failed
- *         1: action succeed
- */
-int move_array(uint16_t array[SIZE]){
-    int i = 0;
-    uint8_t y, t, stop = 0;
-    for(y = 0; y < SIZE; y++){
-        if(array[y] != 0){
-            t = find(array, stop, y);
-            /* If we find a node is not in the same place, we
-             * can move or merge */
-            if(t != y){
-                if(array[t]!=0){
-                    score += array[t] + array[y];
-                    /* Update the best score */
-                    if(best_score <= score)
-                        best_score = score;
-                    /* If fine one which is not 0, set stop index in order
-                     * to prevent invalid merge */
-                    stop = t + 1;
-                }
-                array[t]+= array[y];
-                array[y] = 0;
-                i = 1;
-            }
-        }
-    }
-    return i;
-}
-
-/* @brief Functions for move up
- *
- * Move each single array of the 2-D array one by one. And compute the 
- * difference bewteen the new board with the old one. 
- *
- * @return 0: action failed
- *         1: action succeed
- */
-int move_up(uint16_t board[SIZE][SIZE]){
-    int i = 0;
-    int x;
-    for(x = 0; x < SIZE; x++){
-        i |= move_array(board[x]);
-    }
-    animation(board,psd_board);
-    return i;
-}
-
-/* @brief Functions for move down
- *
- * All these three move actions takes similar theory. Rotate the board 
- * into move up direction. After than, rotate back.
- *
- * @return 0: action failed
- *         1: action succeed
- */
-int move_down(uint16_t board[SIZE][SIZE]){
-    int i = 0;
-    rotate(board);
-    rotate(psd_board);
-    rotate(board);
-    rotate(psd_board);
-    i = move_up(board);
-    rotate(board);
-    rotate(psd_board);
-    rotate(board);
-    rotate(psd_board);
-    return i;
-}
-
-/* @brief Functions for move left
- *
- * All these three move actions takes similar theory. Rotate the board 
- * into move up direction. After than, rotate back.
- *
- * @return 0: action failed
- *         1: action succeed
- */
-int move_left(uint16_t board[SIZE][SIZE]){
-    int i = 0;
-    rotate(board);
-    rotate(psd_board);
-    i = move_up(board);
-    rotate(board);
-    rotate(psd_board);
-    rotate(board);
-    rotate(psd_board);
-    rotate(board);
-    rotate(psd_board);
-    return i;
-}
-
-/* @brief Functions for move right
- *
- * All these three move actions takes similar theory. Rotate the board 
- * into move up direction. After than, rotate back.
- *
- * @return 0: action failed
- *         1: action succeed
- */
-int move_right(uint16_t board[SIZE][SIZE]){
-    int i = 0;
-    rotate(board);
-    rotate(psd_board);
-    rotate(board);
-    rotate(psd_board);
-    rotate(board);
-    rotate(psd_board);
-    i = move_up(board);
-    rotate(board);
-    rotate(psd_board);
-    return i;
-}
-
-/* @brief Functions for rotate the board
- *
- * We can just simply to rotate the board into the direction operated 
- * by move up action, and keep rotating the board to the orignal 
- * direction
- *
- * @return void
- */
-void rotate(uint16_t board[SIZE][SIZE]){
-    int i, j;
-    int n = SIZE;
-    int m = SIZE - 1;
-    uint16_t temp;
-    for(i = 0; i < n/2; i ++){
-        for(j = i; j < m - i; j ++){
-            temp = board[i][j];
-            board[i][j] = board[j][m-i];
-            board[j][m-i] = board[m-i][m-j];
-            board[m-i][m-j] = board[m-j][i];
-            board[m-j][i] = temp;
-        }
-    }
-    return;
-}
-
 /* @brief Functions for debugging the board number
  *
  * Print out the content of the number in the terminal for debugging.
@@ -1083,7 +1149,7 @@ int set_color(int num){
 void print_score(){
     set_cursor(SCORE_X, SCORE_Y);
     set_term_color(FGND_BMAG);
-    printf("%d    ",  score);
+    printf("%d    ",  game.score);
     return;
 }
 
@@ -1097,7 +1163,7 @@ void print_score(){
 void print_bestscore(){
     set_cursor(BESTSCORE_X, BESTSCORE_Y);
     set_term_color(FGND_BCYAN);
-    printf("%d    ",  best_score);
+    printf("%d    ",  game.best_score);
     return;
 }
 
@@ -1111,19 +1177,76 @@ void print_bestscore(){
 void print_mode(){
     set_cursor(MODE_X, MODE_Y);
     set_term_color(FGND_BCYAN);
-    printf("In '%d' Mode ", target_score);
+    if(game.target_score == ENGINE_NO_TARGET)
+        printf("No target    ");
+    else
+        printf("In '%d' Mode ", game.target_score);
     return;
 }
 
+/* @brief Functions for printing the instructions
+ *
+ * Print the instructions of the UI again, where the statistics panel
+ * was.
+ *
+ * @return void
+ */
+void print_help(){
+    int i;
+    set_term_color(FGND_BCYAN);
+    for(i = 0; i < HELP_ROWS; i++){
+        set_cursor(HELP_X + i, HELP_Y);
+        putbytes(UI + (HELP_X + i) * CONSOLE_WIDTH + HELP_Y, HELP_COLS);
+    }
+    return;
+}
 
+/* @brief Functions for printing the state of a save
+ *
+ * @param  state: what the save is doing
+ * @return void
+ */
+void print_save(const char *state){
+    set_cursor(SAVE_X, SAVE_Y);
+    set_term_color(FGND_BCYAN);
+    printf("%-12s", state);
+    return;
+}
 
-
-
-
-
-
-
-
-
-
-
+/* @brief Functions for printing the hint
+ *
+ * Print the suggested move and the counters of the search behind it
+ * on the right side of the UI, below the mode.
+ *
+ * @param  move: the suggested move, -1 if there is none
+ * @return void
+ */
+void print_hint(int move){
+    static const char *names[MOVE_NUM] = { "UP", "DOWN", "LEFT", "RIGHT" };
+    const ai_stats_t *st = ai_get_stats(&ai);
+    int hit = 0;
+    int pruned = (int)(st->pruned_mass * 10000);
+    int i;
+
+    if(st->tt_probes)
+        hit = (int)(100.0f * st->tt_hits / st->tt_probes);
+    /* Clean up the counters of the last hint */
+    set_term_color(FGND_BCYAN);
+    for(i = 0; i < HINT_ROWS; i++){
+        set_cursor(HINT_X + i, HINT_Y);
+        printf("                              ");
+    }
+    set_cursor(HINT_X, HINT_Y);
+    printf("HINT: %s  DEPTH %d", move < 0 ? "NONE" : names[move],
+        st->depth);
+    set_term_color(FGND_LGRAY);
+    set_cursor(HINT_X + 1, HINT_Y);
+    printf("NODE %u LEAF %u", st->nodes, st->leaves);
+    set_cursor(HINT_X + 2, HINT_Y);
+    printf("TT HIT %d%% COLL %u", hit, st->tt_collisions);
+    set_cursor(HINT_X + 3, HINT_Y);
+    printf("PRUNED %d.%02d%% %ums", pruned / 100, pruned % 100, st->ms);
+    set_cursor(HINT_X + 4, HINT_Y);
+    printf("NPS %u", st->nps);
+    return;
+}
@@ -0,0 +1,409 @@
+/** @file bench.c
+ *
+ *  @brief Microbenchmarks of the engine and console hot paths.
+ *
+ *  Every benchmark runs its function over the same seeded inputs (boards
+ *  taken from random games), several times, and reports the fastest run
+ *  as cycles and nanoseconds per operation. With -p the Linux perf_event
+ *  counters add IPC, branch misses and L1D misses per operation.
+ *  The console benchmarks run the real console.c against host_vga[],
+ *  an ordinary array standing in for the text-mode buffer. One op of
+ *  the vecenv benchmarks steps a batch of 64 games.
+ *
+ *  bench [-n OPS] [-r RUNS] [-s SEED] [-p] [-f json|csv] [NAME...]
+ *
+ *  One line per benchmark, JSON by default, so runs can be diffed and
+ *  kept to spot regressions.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug Cycles come from the TSC, which ticks at a fixed rate that is not
+ *       the core clock on every machine; the perf 'cycles' counter is the
+ *       real one when -p is given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "engine.h"
+#include "p1kern.h"
+#include "vecenv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+/* Number of seeded boards the benchmarks cycle through */
+#define INPUTS 4096
+#define INPUT_MASK (INPUTS - 1)
+
+unsigned char host_vga[CONSOLE_WIDTH * CONSOLE_HEIGHT * 2];
+unsigned long host_port_writes = 0;
+
+static game_t inputs[INPUTS];
+static game_t work;
+
+/* Games of the batched environment benchmarks, one op steps them all */
+#define VEC_GAMES 64
+#define VEC_ACTIONS 256
+static vecenv_t venv[2];
+static uint32_t vactions[VEC_ACTIONS][VEC_GAMES];
+static volatile uint32_t sink;
+
+/*******************************************************
+ * Timing and perf_event counters
+ *******************************************************/
+
+#define PERF_CYCLES   0
+#define PERF_INSNS    1
+#define PERF_BRMISS   2
+#define PERF_L1DMISS  3
+#define PERF_NUM      4
+
+static int perf_fd[PERF_NUM] = { -1, -1, -1, -1 };
+
+/** @brief Open the perf_event counters as one group
+ *
+ *  @return 0 on success, -1 if perf_event is not available
+ */
+static int perf_open(void){
+    static const struct { uint32_t type; uint64_t config; } ev[PERF_NUM] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    };
+    int i;
+    for(i = 0; i < PERF_NUM; i++){
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = ev[i].type;
+        attr.config = ev[i].config;
+        attr.disabled = (i == 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf_fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+            i == 0 ? -1 : perf_fd[0], 0);
+        if(perf_fd[i] < 0){
+            perror("perf_event_open");
+            while(i-- > 0)
+                close(perf_fd[i]);
+            perf_fd[0] = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/** @brief Start or stop the counter group
+ *
+ *  @return void
+ */
+static void perf_enable(int on){
+    if(perf_fd[0] < 0)
+        return;
+    if(on){
+        ioctl(perf_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }else{
+        ioctl(perf_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/** @brief Read the counter group
+ *
+ *  @return void
+ */
+static void perf_read(uint64_t val[PERF_NUM]){
+    int i;
+    for(i = 0; i < PERF_NUM; i++){
+        val[i] = 0;
+        if(perf_fd[0] >= 0 &&
+            read(perf_fd[i], &val[i], sizeof(val[i])) != sizeof(val[i]))
+            val[i] = 0;
+    }
+}
+
+/** @brief Timestamp in cycles, or in nanoseconds without a TSC
+ *
+ *  @return the timestamp
+ */
+static uint64_t now_cycles(void){
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/** @brief Timestamp in nanoseconds
+ *
+ *  @return the timestamp
+ */
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*******************************************************
+ * The benchmarks, one op per call on input i
+ *******************************************************/
+
+static void load(unsigned int i){
+    engine_copy_board(inputs[i & INPUT_MASK].board, work.board);
+}
+
+static void op_move_up(unsigned int i){ load(i); sink += move_up(&work); }
+static void op_move_down(unsigned int i){ load(i); sink += move_down(&work); }
+static void op_move_left(unsigned int i){ load(i); sink += move_left(&work); }
+static void op_move_right(unsigned int i){
+    load(i);
+    sink += move_right(&work);
+}
+static void op_rotate(unsigned int i){
+    (void)i;
+    engine_rotate(work.board);
+    sink += work.board[0][0];
+}
+static void op_find(unsigned int i){
+    uint16_t *a = inputs[i & INPUT_MASK].board[i & 3];
+    sink += (uint32_t)engine_find(a, 0, 3);
+}
+static void op_move_array(unsigned int i){
+    uint16_t a[SIZE];
+    memcpy(a, inputs[i & INPUT_MASK].board[i & 3], sizeof(a));
+    sink += engine_move_array(&work, a);
+}
+static void op_add_random(unsigned int i){ load(i); engine_add_random(&work); }
+static void op_is_over(unsigned int i){
+    sink += engine_is_over(inputs[i & INPUT_MASK].board);
+}
+static void op_is_win(unsigned int i){ sink += is_win(&inputs[i & INPUT_MASK]); }
+static void op_copy_borad(unsigned int i){
+    engine_copy_board(inputs[i & INPUT_MASK].board, work.psd_board);
+}
+static void op_putbyte(unsigned int i){
+    /* Newline every 64 characters, so scrolling is part of the mix */
+    sink += putbyte((i & 63) == 63 ? '\n' : 'a' + (i & 15));
+}
+static void op_draw_char(unsigned int i){
+    draw_char((int)(i % CONSOLE_HEIGHT), (int)(i % CONSOLE_WIDTH),
+        'a' + (i & 15), FGND_WHITE);
+}
+static void op_console_scroll(unsigned int i){ (void)i; console_scroll(); }
+static void op_clear_console(unsigned int i){ (void)i; clear_console(); }
+static void op_vecenv_scalar(unsigned int i){
+    vecenv_step(&venv[VECENV_SCALAR], vactions[i % VEC_ACTIONS]);
+}
+static void op_vecenv_avx2(unsigned int i){
+    vecenv_step(&venv[VECENV_AVX2], vactions[i % VEC_ACTIONS]);
+}
+
+typedef struct
+{
+    const char *name;
+    void (*op)(unsigned int i);
+    int weight;             /* divides the op count for slow benchmarks */
+}bench_t;
+
+static const bench_t benches[] = {
+    { "move_up",        op_move_up,        1 },
+    { "move_down",      op_move_down,      1 },
+    { "move_left",      op_move_left,      1 },
+    { "move_right",     op_move_right,     1 },
+    { "rotate",         op_rotate,         1 },
+    { "find",           op_find,           1 },
+    { "move_array",     op_move_array,     1 },
+    { "add_random",     op_add_random,     1 },
+    { "is_over",        op_is_over,        1 },
+    { "is_win",         op_is_win,         1 },
+    { "copy_borad",     op_copy_borad,     1 },
+    { "putbyte",        op_putbyte,        1 },
+    { "draw_char",      op_draw_char,      1 },
+    { "console_scroll", op_console_scroll, 64 },
+    { "clear_console",  op_clear_console,  64 },
+    { "vecenv_scalar",  op_vecenv_scalar,  VEC_GAMES },
+    { "vecenv_avx2",    op_vecenv_avx2,    VEC_GAMES },
+};
+#define BENCH_NUM ((int)(sizeof(benches) / sizeof(benches[0])))
+
+/** @brief Fill the inputs with boards from seeded random games
+ *
+ *  Every input is a position reached by random moves, so the mix of
+ *  empty and merged blocks is the one the game sees.
+ *
+ *  @return void
+ */
+static void make_inputs(uint32_t seed){
+    game_t g;
+    int i = 0;
+    while(i < INPUTS){
+        engine_init(&g, seed + (uint32_t)i, 2048);
+        engine_add_random(&g);
+        engine_add_random(&g);
+        while(i < INPUTS && !engine_is_over(g.board)){
+            engine_step(&g, (int)engine_rand_below(&g, MOVE_NUM));
+            inputs[i++] = g;
+        }
+    }
+    engine_init(&work, seed, 2048);
+}
+
+/** @brief Start the batched environments and draw their actions
+ *
+ *  Without AVX2 both environments run the scalar backend.
+ *
+ *  @return 0 on success, -1 if out of memory
+ */
+static int make_vecenv(uint32_t seed){
+    uint32_t seeds[VEC_GAMES];
+    int i, j;
+    for(i = 0; i < VEC_GAMES; i++)
+        seeds[i] = seed + (uint32_t)i;
+    for(i = 0; i < 2; i++){
+        if(vecenv_init(&venv[i], VEC_GAMES, i) != 0 &&
+            vecenv_init(&venv[i], VEC_GAMES, VECENV_SCALAR) != 0)
+            return -1;
+        vecenv_reset(&venv[i], seeds);
+    }
+    for(i = 0; i < VEC_ACTIONS; i++){
+        for(j = 0; j < VEC_GAMES; j++)
+            vactions[i][j] = engine_rand_below(&work, MOVE_NUM);
+    }
+    return 0;
+}
+
+/** @brief Run one benchmark and print its line
+ *
+ *  @return void
+ */
+static void run(const bench_t *b, unsigned long ops, int runs, int csv){
+    uint64_t best_cyc = UINT64_MAX, best_ns = 0;
+    uint64_t best_perf[PERF_NUM] = { 0 };
+    unsigned long n = ops / b->weight;
+    int r;
+
+    if(n == 0)
+        n = 1;
+    for(r = 0; r < runs; r++){
+        uint64_t t0, t1, n0, n1, perf[PERF_NUM];
+        unsigned long i;
+        perf_enable(1);
+        n0 = now_ns();
+        t0 = now_cycles();
+        for(i = 0; i < n; i++)
+            b->op((unsigned int)i);
+        t1 = now_cycles();
+        n1 = now_ns();
+        perf_enable(0);
+        perf_read(perf);
+        if(t1 - t0 < best_cyc){
+            best_cyc = t1 - t0;
+            best_ns = n1 - n0;
+            memcpy(best_perf, perf, sizeof(perf));
+        }
+    }
+
+    if(csv){
+        printf("%s,%lu,%.2f,%.2f", b->name, n, (double)best_cyc / n,
+            (double)best_ns / n);
+        if(perf_fd[0] >= 0)
+            printf(",%.3f,%.4f,%.4f", best_perf[PERF_CYCLES] ?
+                (double)best_perf[PERF_INSNS] / best_perf[PERF_CYCLES] : 0.0,
+                (double)best_perf[PERF_BRMISS] / n,
+                (double)best_perf[PERF_L1DMISS] / n);
+        printf("\n");
+    }else{
+        printf("{\"bench\":\"%s\",\"ops\":%lu,\"cycles_per_op\":%.2f,"
+            "\"ns_per_op\":%.2f", b->name, n, (double)best_cyc / n,
+            (double)best_ns / n);
+        if(perf_fd[0] >= 0)
+            printf(",\"ipc\":%.3f,\"branch_miss_per_op\":%.4f,"
+                "\"l1d_miss_per_op\":%.4f", best_perf[PERF_CYCLES] ?
+                (double)best_perf[PERF_INSNS] / best_perf[PERF_CYCLES] : 0.0,
+                (double)best_perf[PERF_BRMISS] / n,
+                (double)best_perf[PERF_L1DMISS] / n);
+        printf("}\n");
+    }
+    fflush(stdout);
+}
+
+/** @brief Is the benchmark selected on the command line
+ *
+ *  @return 1 if it has to run
+ */
+static int selected(const char *name, int argc, char **argv){
+    int i;
+    if(argc == 0)
+        return 1;
+    for(i = 0; i < argc; i++){
+        if(strcmp(argv[i], name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv){
+    unsigned long ops = 1000000;
+    int runs = 5;
+    uint32_t seed = 1;
+    int use_perf = 0, csv = 0;
+    int opt, i;
+
+    while((opt = getopt(argc, argv, "n:r:s:pf:")) != -1){
+        switch(opt){
+            case 'n':
+                ops = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 's':
+                seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                use_perf = 1;
+                break;
+            case 'f':
+                csv = strcmp(optarg, "csv") == 0;
+                break;
+            default:
+                fprintf(stderr, "usage: bench [-n OPS] [-r RUNS] [-s SEED] "
+                    "[-p] [-f json|csv] [NAME...]\n");
+                return 2;
+        }
+    }
+    if(use_perf && perf_open() < 0)
+        fprintf(stderr, "bench: running without perf counters\n");
+    if(runs < 1)
+        runs = 1;
+
+    make_inputs(seed);
+    if(make_vecenv(seed) != 0){
+        perror("bench");
+        return 1;
+    }
+    hide_cursor();
+    if(csv){
+        printf("bench,ops,cycles_per_op,ns_per_op%s\n", perf_fd[0] >= 0 ?
+            ",ipc,branch_miss_per_op,l1d_miss_per_op" : "");
+    }
+    for(i = 0; i < BENCH_NUM; i++){
+        if(selected(benches[i].name, argc - optind, argv + optind))
+            run(&benches[i], ops, runs, csv);
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/** @file p1kern.h
+ *
+ *  @brief Host stand-in for the 410 p1kern.h, so console.c can be built
+ *         and benchmarked on Linux.
+ *
+ *  The text-mode buffer is an ordinary array, host_vga[], defined by the
+ *  program linking console.o.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _HOST_P1KERN_H_
+#define _HOST_P1KERN_H_
+
+#include <stdint.h>
+
+#define CONSOLE_WIDTH  80
+#define CONSOLE_HEIGHT 25
+
+/* Two bytes, character and color, per cell */
+extern unsigned char host_vga[CONSOLE_WIDTH * CONSOLE_HEIGHT * 2];
+#define CONSOLE_MEM_BASE ((uintptr_t)host_vga)
+
+#define CRTC_IDX_REG        0x3d4
+#define CRTC_DATA_REG       0x3d5
+#define CRTC_CURSOR_LSB_IDX 15
+#define CRTC_CURSOR_MSB_IDX 14
+
+#define FGND_BLACK 0x0
+#define FGND_BLUE  0x1
+#define FGND_GREEN 0x2
+#define FGND_CYAN  0x3
+#define FGND_RED   0x4
+#define FGND_MAG   0x5
+#define FGND_BRWN  0x6
+#define FGND_LGRAY 0x7
+#define FGND_DGRAY 0x8
+#define FGND_BBLUE 0x9
+#define FGND_BGRN  0xA
+#define FGND_BCYAN 0xB
+#define FGND_PINK  0xC
+#define FGND_BMAG  0xD
+#define FGND_YLLW  0xE
+#define FGND_WHITE 0xF
+
+int putbyte(char ch);
+void putbytes(const char *s, int len);
+int set_term_color(int color);
+void get_term_color(int *color);
+int set_cursor(int row, int col);
+void get_cursor(int *row, int *col);
+void hide_cursor(void);
+void show_cursor(void);
+void clear_console(void);
+void draw_char(int row, int col, int ch, int color);
+char get_char(int row, int col);
+void console_scroll(void);
+
+#endif
@@ -0,0 +1,12 @@
+/** @file simics.h
+ *
+ *  @brief Host stand-in for the 410 simics.h.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _HOST_SIMICS_H_
+#define _HOST_SIMICS_H_
+
+#define lprintf(...) ((void)0)
+
+#endif
@@ -0,0 +1,21 @@
+/** @file asm.h
+ *
+ *  @brief Host stand-in for the 410 x86/asm.h. Port writes only count,
+ *         there is no CRTC behind them.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _HOST_X86_ASM_H_
+#define _HOST_X86_ASM_H_
+
+#include <stdint.h>
+
+extern unsigned long host_port_writes;
+
+static inline void outb(uint16_t port, uint8_t val){
+    (void)port;
+    (void)val;
+    host_port_writes++;
+}
+
+#endif
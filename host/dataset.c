@@ -0,0 +1,239 @@
+/** @file dataset.c
+ *
+ *  @brief Double-buffered shard writer of dataset.h.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dataset.h"
+
+static const uint32_t widths[DATASET_COLUMNS] = { 8, 1, 1, 4, 4 };
+
+static uint64_t align_up(uint64_t v){
+    return (v + DATASET_ALIGN - 1) & ~(uint64_t)(DATASET_ALIGN - 1);
+}
+
+static int buf_alloc(dataset_buf_t *b, size_t cap){
+    b->board = malloc(cap * sizeof(*b->board));
+    b->legal = malloc(cap);
+    b->move = malloc(cap);
+    b->reward = malloc(cap * sizeof(*b->reward));
+    b->final_score = malloc(cap * sizeof(*b->final_score));
+    b->n = 0;
+    if(!b->board || !b->legal || !b->move || !b->reward || !b->final_score)
+        return -1;
+    return 0;
+}
+
+static void buf_free(dataset_buf_t *b){
+    free(b->board);
+    free(b->legal);
+    free(b->move);
+    free(b->reward);
+    free(b->final_score);
+}
+
+/** @brief pwrite() all of len bytes
+ *
+ *  @return 0 on success, -1 with errno set
+ */
+static int write_all(int fd, const void *buf, size_t len, uint64_t off){
+    const char *p = buf;
+    while(len > 0){
+        ssize_t got = pwrite(fd, p, len, (off_t)off);
+        if(got < 0){
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += got;
+        len -= (size_t)got;
+        off += (uint64_t)got;
+    }
+    return 0;
+}
+
+/** @brief Write one buffer as the next shard
+ *
+ *  @return 0 on success, -1 with errno set
+ */
+static int write_shard(dataset_t *d, const dataset_buf_t *b){
+    static char page[DATASET_ALIGN];
+    dataset_header_t *h = (dataset_header_t *)page;
+    const void *cols[DATASET_COLUMNS] = { b->board, b->legal, b->move,
+        b->reward, b->final_score };
+    char path[4096];
+    uint64_t off = DATASET_ALIGN;
+    int fd, i, ret = 0;
+
+    memset(page, 0, sizeof(page));
+    h->magic = DATASET_MAGIC;
+    h->version = DATASET_VERSION;
+    h->records = b->n;
+    h->columns = DATASET_COLUMNS;
+    h->shard = d->shards;
+    for(i = 0; i < DATASET_COLUMNS; i++){
+        h->column[i].offset = off;
+        h->column[i].width = widths[i];
+        off = align_up(off + (uint64_t)b->n * widths[i]);
+    }
+
+    snprintf(path, sizeof(path), "%s/shard-%06u.bin", d->dir, d->shards);
+    if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -1;
+    if(write_all(fd, page, sizeof(page), 0) != 0)
+        ret = -1;
+    for(i = 0; i < DATASET_COLUMNS && ret == 0; i++){
+        if(write_all(fd, cols[i], b->n * widths[i], h->column[i].offset) != 0)
+            ret = -1;
+    }
+    /* Pad the last column so every column can be mapped whole */
+    if(ret == 0 && ftruncate(fd, (off_t)off) != 0)
+        ret = -1;
+    if(close(fd) != 0)
+        ret = -1;
+    return ret;
+}
+
+/** @brief Writer thread: writes every buffer handed over as a shard
+ *
+ *  @return NULL
+ */
+static void *writer(void *arg){
+    dataset_t *d = arg;
+    int b, err;
+
+    pthread_mutex_lock(&d->lock);
+    while(1){
+        while(d->full < 0 && !d->stop)
+            pthread_cond_wait(&d->cond, &d->lock);
+        if(d->full < 0)
+            break;
+        b = d->full;
+        /* Producers keep filling the other buffer meanwhile */
+        pthread_mutex_unlock(&d->lock);
+        err = write_shard(d, &d->buf[b]) != 0 ? errno : 0;
+        pthread_mutex_lock(&d->lock);
+        if(err != 0 && d->error == 0)
+            d->error = err;
+        d->shards++;
+        d->records += d->buf[b].n;
+        d->buf[b].n = 0;
+        d->full = -1;
+        pthread_cond_broadcast(&d->cond);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return NULL;
+}
+
+/** @brief Start writing shards into a directory
+ *
+ *  @param d: the dataset
+ *         dir: directory of the shards, created if needed
+ *         shard_records: records per shard, DATASET_SHARD_RECORDS if 0
+ *  @return 0 on success, -1 on failure with errno set
+ */
+int dataset_open(dataset_t *d, const char *dir, size_t shard_records){
+    memset(d, 0, sizeof(*d));
+    d->cap = shard_records ? shard_records : DATASET_SHARD_RECORDS;
+    d->full = -1;
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return -1;
+    if((d->dir = strdup(dir)) == NULL)
+        return -1;
+    if(buf_alloc(&d->buf[0], d->cap) != 0 ||
+        buf_alloc(&d->buf[1], d->cap) != 0){
+        buf_free(&d->buf[0]);
+        buf_free(&d->buf[1]);
+        free(d->dir);
+        errno = ENOMEM;
+        return -1;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+    if((errno = pthread_create(&d->writer, NULL, writer, d)) != 0){
+        buf_free(&d->buf[0]);
+        buf_free(&d->buf[1]);
+        free(d->dir);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief Add records, safe from any number of threads
+ *
+ *  The records of one call stay together unless a shard fills up in
+ *  the middle. When both buffers are full, the caller waits for the
+ *  writer.
+ *
+ *  @param d: the dataset
+ *         recs: the records
+ *         n: number of records
+ *  @return 0 on success, -1 if a shard could not be written (errno set)
+ */
+int dataset_append(dataset_t *d, const dataset_rec_t *recs, size_t n){
+    dataset_buf_t *b;
+    size_t i;
+    int err;
+
+    pthread_mutex_lock(&d->lock);
+    for(i = 0; i < n; i++){
+        b = &d->buf[d->fill];
+        if(b->n == d->cap){
+            while(d->full >= 0)
+                pthread_cond_wait(&d->cond, &d->lock);
+            d->full = d->fill;
+            d->fill ^= 1;
+            pthread_cond_broadcast(&d->cond);
+            b = &d->buf[d->fill];
+        }
+        b->board[b->n] = recs[i].board;
+        b->legal[b->n] = recs[i].legal;
+        b->move[b->n] = recs[i].move;
+        b->reward[b->n] = recs[i].reward;
+        b->final_score[b->n] = recs[i].final_score;
+        b->n++;
+    }
+    err = d->error;
+    pthread_mutex_unlock(&d->lock);
+    if(err != 0){
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief Write the last records and stop the writer
+ *
+ *  @return 0 on success, -1 if a shard could not be written (errno set)
+ */
+int dataset_close(dataset_t *d){
+    pthread_mutex_lock(&d->lock);
+    while(d->full >= 0)
+        pthread_cond_wait(&d->cond, &d->lock);
+    if(d->buf[d->fill].n > 0)
+        d->full = d->fill;
+    d->stop = 1;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+    pthread_join(d->writer, NULL);
+
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->cond);
+    buf_free(&d->buf[0]);
+    buf_free(&d->buf[1]);
+    free(d->dir);
+    if(d->error != 0){
+        errno = d->error;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+/** @file dataset.h
+ *
+ *  @brief Training data written as column-oriented shard files.
+ *
+ *  Every record is one move of a game: the packed board before it, the
+ *  mask of legal moves (bit MOVE_*), the move chosen, the score it made
+ *  and the final score of the game. A shard is a 4096-byte header and
+ *  one column per field, each starting on a 4096-byte boundary, so a
+ *  reader maps the file and indexes column[i] directly:
+ *
+ *    board        uint64_t[records]
+ *    legal        uint8_t[records]
+ *    move         uint8_t[records]
+ *    reward       uint32_t[records]
+ *    final_score  uint32_t[records]
+ *
+ *  Records are appended to one of two in-memory shards while a writer
+ *  thread writes the other one out.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _DATASET_H_
+#define _DATASET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "bitboard.h"
+
+#define DATASET_MAGIC   0x48534432  /* "2DSH" */
+#define DATASET_VERSION 1
+#define DATASET_ALIGN   4096
+/* Records in a full shard */
+#define DATASET_SHARD_RECORDS (1 << 20)
+
+/* Columns, in file order */
+#define DATASET_COL_BOARD   0
+#define DATASET_COL_LEGAL   1
+#define DATASET_COL_MOVE    2
+#define DATASET_COL_REWARD  3
+#define DATASET_COL_FINAL   4
+#define DATASET_COLUMNS     5
+
+typedef struct
+{
+    uint64_t offset;        /* from the start of the file */
+    uint32_t width;         /* bytes per record */
+    uint32_t pad;
+}dataset_column_t;
+
+/* Start of every shard, padded to DATASET_ALIGN bytes in the file */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t records;
+    uint32_t columns;
+    uint32_t shard;         /* number of the shard in its directory */
+    dataset_column_t column[DATASET_COLUMNS];
+}dataset_header_t;
+
+typedef struct
+{
+    bboard_t board;
+    uint8_t legal;
+    uint8_t move;
+    uint32_t reward;
+    uint32_t final_score;
+}dataset_rec_t;
+
+/* One shard in memory, column by column */
+typedef struct
+{
+    uint64_t *board;
+    uint8_t *legal;
+    uint8_t *move;
+    uint32_t *reward;
+    uint32_t *final_score;
+    size_t n;
+}dataset_buf_t;
+
+typedef struct
+{
+    char *dir;
+    size_t cap;             /* records in a shard */
+    dataset_buf_t buf[2];
+    int fill;               /* buffer taking records */
+    int full;               /* buffer waiting for the writer, -1 if none */
+    int stop;
+    int error;              /* errno of a failed write */
+    uint32_t shards;        /* shards written */
+    uint64_t records;       /* records written */
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+}dataset_t;
+
+int dataset_open(dataset_t *d, const char *dir, size_t shard_records);
+int dataset_append(dataset_t *d, const dataset_rec_t *recs, size_t n);
+int dataset_close(dataset_t *d);
+
+#endif
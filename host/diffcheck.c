@@ -0,0 +1,551 @@
+/** @file diffcheck.c
+ *
+ *  @brief Differential check of every move backend against engine.c.
+ *
+ *  The reference is the original engine_move_array()/engine_rotate()
+ *  code in engine.c.
+ *  Every other backend must give, for every board and direction, the
+ *  same resulting board, the same score, the same legality and the same
+ *  merge events. Merge events are compared per line: the score and the
+ *  number of merges of each line moved on its own.
+ *
+ *  The check first runs every possible row in every line and direction,
+ *  then random and adversarial boards (long runs of equal numbers, the
+ *  largest numbers) on all cores. The first mismatch stops everything
+ *  and is shrunk to the smallest failing line before it is printed.
+ *
+ *  diffcheck [-n BOARDS] [-t THREADS] [-s SEED] [-x] [-v STEPS]
+ *
+ *  -x skips the exhaustive row pass. New backends only need an entry in
+ *  backends[].
+ *
+ *  -v checks the batched environment (vecenv.h) instead: its AVX2 and
+ *  scalar backends step VEC_GAMES games for STEPS steps from the same
+ *  seeds and actions, and every array must match bit for bit after
+ *  every step. Actions are mostly legal moves, so games end and are
+ *  reset, with some illegal ones mixed in.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include "engine.h"
+#include "bitboard.h"
+#include "vecenv.h"
+
+/* Games of the -v check */
+#define VEC_GAMES 1024
+
+typedef struct
+{
+    bboard_t board;
+    uint32_t score;
+    int legal;
+    uint32_t line_score[SIZE];
+    int line_merges[SIZE];
+}result_t;
+
+typedef struct
+{
+    const char *name;
+    bboard_t (*move)(bboard_t b, int dir, uint32_t *score);
+}backend_t;
+
+/*******************************************************
+ * Backends
+ *******************************************************/
+
+/** @brief The original engine: engine_move_array() and engine_rotate()
+ *         on a game_t
+ *
+ *  @return the moved board
+ */
+static bboard_t ref_move(bboard_t b, int dir, uint32_t *score){
+    game_t g;
+    engine_init(&g, 1, 0);
+    bb_unpack(b, g.board);
+    engine_move(&g, dir);
+    *score += (uint32_t)g.score;
+    return bb_pack(g.board);
+}
+
+/** @brief Reverse the nibbles of a row
+ *
+ *  @return the reversed row
+ */
+static uint16_t reverse_row(uint16_t row){
+    return (uint16_t)((row >> 12) | ((row >> 4) & 0x00f0) |
+        ((row << 4) & 0x0f00) | (row << 12));
+}
+
+/** @brief Bitboard without tables: bb_row_slide() on every row
+ *
+ *  @return the moved board
+ */
+static bboard_t direct_move(bboard_t b, int dir, uint32_t *score){
+    bboard_t out = 0;
+    int i;
+    if(dir == MOVE_LEFT || dir == MOVE_RIGHT)
+        b = bb_transpose(b);
+    for(i = 0; i < 4; i++){
+        uint16_t row = (uint16_t)(b >> (i * 16));
+        if(dir == MOVE_UP || dir == MOVE_LEFT)
+            row = bb_row_slide(row, score);
+        else
+            row = reverse_row(bb_row_slide(reverse_row(row), score));
+        out |= (bboard_t)row << (i * 16);
+    }
+    if(dir == MOVE_LEFT || dir == MOVE_RIGHT)
+        out = bb_transpose(out);
+    return out;
+}
+
+static const backend_t backends[] = {
+    { "reference", ref_move },
+    { "table",     bb_move },
+    { "direct",    direct_move },
+};
+#define BACKEND_NUM ((int)(sizeof(backends) / sizeof(backends[0])))
+
+/*******************************************************
+ * Running and comparing
+ *******************************************************/
+
+/* Nibbles of line l: board[l] for up/down, column l for left/right */
+static bboard_t line_mask(int dir, int l){
+    if(dir == MOVE_UP || dir == MOVE_DOWN)
+        return 0xffffULL << (l * 16);
+    return 0x000f000f000f000fULL << (l * 4);
+}
+
+static int count_tiles(bboard_t b){
+    return 16 - bb_count_empty(b);
+}
+
+/** @brief Run one backend on one board
+ *
+ *  @return void
+ */
+static void run_backend(const backend_t *be, bboard_t b, int dir,
+    result_t *r){
+    int l;
+    r->score = 0;
+    r->board = be->move(b, dir, &r->score);
+    r->legal = r->board != b;
+    for(l = 0; l < SIZE; l++){
+        bboard_t line = b & line_mask(dir, l);
+        uint32_t s = 0;
+        bboard_t moved = be->move(line, dir, &s);
+        r->line_score[l] = s;
+        r->line_merges[l] = count_tiles(line) - count_tiles(moved);
+    }
+}
+
+static int same_result(const result_t *a, const result_t *b){
+    int l;
+    if(a->board != b->board || a->score != b->score || a->legal != b->legal)
+        return 0;
+    for(l = 0; l < SIZE; l++){
+        if(a->line_score[l] != b->line_score[l] ||
+            a->line_merges[l] != b->line_merges[l])
+            return 0;
+    }
+    return 1;
+}
+
+/** @brief Compare all backends on one board
+ *
+ *  @return index of the first backend that differs, 0 if all agree
+ */
+static int check(bboard_t b, int dir){
+    result_t ref, r;
+    int i;
+    run_backend(&backends[0], b, dir, &ref);
+    for(i = 1; i < BACKEND_NUM; i++){
+        run_backend(&backends[i], b, dir, &r);
+        if(!same_result(&ref, &r))
+            return i;
+    }
+    return 0;
+}
+
+/** @brief Shrink a failing board to the smallest failing line
+ *
+ *  Keeps only one failing line, then lowers and removes numbers while
+ *  the backends still disagree.
+ *
+ *  @return the shrunk board
+ */
+static bboard_t minimize(bboard_t b, int dir){
+    int l, i, changed;
+    for(l = 0; l < SIZE; l++){
+        bboard_t line = b & line_mask(dir, l);
+        if(check(line, dir)){
+            b = line;
+            break;
+        }
+    }
+    do{
+        changed = 0;
+        for(i = 0; i < 16; i++){
+            int v = (int)((b >> (i * 4)) & 0xf);
+            bboard_t t;
+            if(v == 0)
+                continue;
+            /* Try without the number, then with a smaller one */
+            t = b & ~(0xfULL << (i * 4));
+            if(check(t, dir)){
+                b = t;
+                changed = 1;
+                continue;
+            }
+            if(v > 1){
+                t = b - (1ULL << (i * 4));
+                if(check(t, dir)){
+                    b = t;
+                    changed = 1;
+                }
+            }
+        }
+    }while(changed);
+    return b;
+}
+
+/** @brief Print both results of a mismatch
+ *
+ *  @return void
+ */
+static void report(bboard_t b, int dir){
+    static const char *names[MOVE_NUM] = { "up", "down", "left", "right" };
+    int bad = check(b, dir);
+    bboard_t small = minimize(b, dir);
+    result_t ref, r;
+    int i, l;
+
+    printf("MISMATCH backend %s, move %s\n", backends[bad].name, names[dir]);
+    printf("  board    %016llx\n", (unsigned long long)b);
+    printf("  smallest %016llx\n", (unsigned long long)small);
+    bad = check(small, dir);
+    for(i = 0; i < 2; i++){
+        const backend_t *be = &backends[i == 0 ? 0 : bad];
+        run_backend(be, small, dir, i == 0 ? &ref : &r);
+        result_t *p = i == 0 ? &ref : &r;
+        printf("  %-9s -> %016llx score %u legal %d lines", be->name,
+            (unsigned long long)p->board, p->score, p->legal);
+        for(l = 0; l < SIZE; l++)
+            printf(" %u/%d", p->line_score[l], p->line_merges[l]);
+        printf("\n");
+    }
+}
+
+/*******************************************************
+ * Board generation and threads
+ *******************************************************/
+
+static volatile int failed = 0;
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct
+{
+    uint64_t rng;
+    uint64_t boards;
+    uint64_t done;
+}worker_t;
+
+/** @brief splitmix64, one independent stream per thread
+ *
+ *  @return next random number
+ */
+static uint64_t next_rand(uint64_t *s){
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/** @brief Random or adversarial board
+ *
+ *  @return the board
+ */
+static bboard_t make_board(uint64_t *s){
+    uint64_t r = next_rand(s);
+    bboard_t b = 0;
+    int i;
+    switch(r & 3){
+        case 0:
+            /* Anything, every nibble uniform */
+            return next_rand(s);
+        case 1:{
+            /* Few distinct small numbers, lots of merges */
+            uint64_t v = next_rand(s);
+            for(i = 0; i < 16; i++, v >>= 2)
+                b |= (bboard_t)(v & 3) << (i * 4);
+            return b;
+        }
+        case 2:{
+            /* Runs of one number, with holes */
+            int k = (int)((r >> 8) % 15) + 1;
+            uint64_t v = next_rand(s);
+            for(i = 0; i < 16; i++, v >>= 2){
+                if(v & 3)
+                    b |= (bboard_t)k << (i * 4);
+            }
+            return b;
+        }
+        default:{
+            /* The largest numbers, merges that overflow the nibble */
+            uint64_t v = next_rand(s);
+            for(i = 0; i < 16; i++, v >>= 2)
+                b |= (bboard_t)((v & 3) ? 12 + (v & 3) : 0) << (i * 4);
+            return b;
+        }
+    }
+}
+
+static void *worker(void *arg){
+    worker_t *w = arg;
+    uint64_t n;
+    for(n = 0; n < w->boards && !failed; n++){
+        bboard_t b = make_board(&w->rng);
+        int dir;
+        for(dir = 0; dir < MOVE_NUM; dir++){
+            if(check(b, dir)){
+                pthread_mutex_lock(&report_lock);
+                if(!failed){
+                    failed = 1;
+                    report(b, dir);
+                }
+                pthread_mutex_unlock(&report_lock);
+                break;
+            }
+        }
+        w->done = n + 1;
+    }
+    return NULL;
+}
+
+/** @brief Every possible row, in every line and every direction
+ *
+ *  @return 0 if all backends agree
+ */
+static int exhaustive_rows(void){
+    uint32_t row;
+    int l, dir;
+    for(row = 0; row < 65536; row++){
+        for(dir = 0; dir < MOVE_NUM; dir++){
+            for(l = 0; l < SIZE; l++){
+                bboard_t b;
+                if(dir == MOVE_UP || dir == MOVE_DOWN){
+                    b = (bboard_t)row << (l * 16);
+                }else{
+                    /* The row as column l */
+                    b = bb_transpose((bboard_t)row << (l * 16));
+                }
+                if(check(b, dir)){
+                    report(b, dir);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/*******************************************************
+ * Batched environment
+ *******************************************************/
+
+/* First game where field differs in the two environments, or -1 */
+#define VEC_DIFF(a, b, field) vec_diff((a)->field, (b)->field, \
+    sizeof(*(a)->field), (a)->n)
+
+static long vec_diff(const void *a, const void *b, size_t size, size_t n){
+    size_t i;
+    for(i = 0; i < n; i++){
+        if(memcmp((const char *)a + i * size, (const char *)b + i * size,
+            size) != 0)
+            return (long)i;
+    }
+    return -1;
+}
+
+/** @brief Compare every array of the two environments
+ *
+ *  @return 0 if they agree, 1 after printing the first difference
+ */
+static int vec_compare(const vecenv_t *s, const vecenv_t *v, uint64_t step){
+    static const char *names[] = { "board", "rng", "seed", "score",
+        "reward", "done", "legal", "final" };
+    long at[8];
+    int f;
+
+    at[0] = VEC_DIFF(s, v, board);
+    at[1] = VEC_DIFF(s, v, rng);
+    at[2] = VEC_DIFF(s, v, seed);
+    at[3] = VEC_DIFF(s, v, score);
+    at[4] = VEC_DIFF(s, v, reward);
+    at[5] = VEC_DIFF(s, v, done);
+    at[6] = VEC_DIFF(s, v, legal);
+    at[7] = VEC_DIFF(s, v, final);
+    for(f = 0; f < 8; f++){
+        long i = at[f];
+        if(i < 0)
+            continue;
+        printf("MISMATCH vecenv avx2, %s of game %ld after step %llu\n",
+            names[f], i, (unsigned long long)step);
+        printf("  board  scalar %016llx avx2 %016llx\n",
+            (unsigned long long)s->board[i], (unsigned long long)v->board[i]);
+        printf("  rng    scalar %llx/%llx avx2 %llx/%llx\n",
+            (unsigned long long)s->rng[i], (unsigned long long)s->seed[i],
+            (unsigned long long)v->rng[i], (unsigned long long)v->seed[i]);
+        printf("  score  scalar %llu avx2 %llu, final %u/%u\n",
+            (unsigned long long)s->score[i], (unsigned long long)v->score[i],
+            s->final[i], v->final[i]);
+        printf("  reward scalar %u avx2 %u, done %u/%u, legal %x/%x\n",
+            s->reward[i], v->reward[i], s->done[i], v->done[i],
+            s->legal[i], v->legal[i]);
+        return 1;
+    }
+    return 0;
+}
+
+/** @brief Step the AVX2 and scalar environments side by side
+ *
+ *  @return 0 if they agree, 1 on a mismatch or error
+ */
+static int check_vecenv(uint64_t steps, uint64_t seed){
+    vecenv_t s, v;
+    uint32_t seeds[VEC_GAMES], actions[VEC_GAMES];
+    uint64_t rng = seed, step, ended = 0;
+    int i, k, n, ret = 0;
+
+    if(vecenv_init(&v, VEC_GAMES, VECENV_AVX2) != 0){
+        printf("vecenv: no AVX2 backend here, skipped\n");
+        return 0;
+    }
+    if(vecenv_init(&s, VEC_GAMES, VECENV_SCALAR) != 0){
+        vecenv_free(&v);
+        perror("diffcheck");
+        return 1;
+    }
+    for(i = 0; i < VEC_GAMES; i++)
+        seeds[i] = (uint32_t)next_rand(&rng);
+    vecenv_reset(&s, seeds);
+    vecenv_reset(&v, seeds);
+    if(vec_compare(&s, &v, 0))
+        ret = 1;
+    for(step = 1; step <= steps && ret == 0; step++){
+        for(i = 0; i < VEC_GAMES; i++){
+            uint64_t r = next_rand(&rng);
+            /* One in 8 any move, else one of the legal ones */
+            n = __builtin_popcount(s.legal[i]);
+            if((r & 7) == 0 || n == 0){
+                actions[i] = (uint32_t)(r >> 8) & 3;
+                continue;
+            }
+            k = (int)((r >> 8) % (uint64_t)n);
+            for(actions[i] = 0; !(s.legal[i] & (1u << actions[i])) || k-- > 0;
+                actions[i]++)
+                continue;
+        }
+        vecenv_step(&s, actions);
+        vecenv_step(&v, actions);
+        ret = vec_compare(&s, &v, step);
+        for(i = 0; i < VEC_GAMES; i++)
+            ended += s.done[i];
+    }
+    if(ret == 0)
+        printf("vecenv: avx2 and scalar agree on %d games x %llu steps, "
+            "%llu games ended\n", VEC_GAMES, (unsigned long long)steps,
+            (unsigned long long)ended);
+    vecenv_free(&s);
+    vecenv_free(&v);
+    return ret;
+}
+
+int main(int argc, char **argv){
+    uint64_t boards = 10000000;
+    uint64_t seed = 1, total = 0;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int rows = 1;
+    uint64_t vec_steps = 0;
+    worker_t *w;
+    pthread_t *tid;
+    struct timespec t0, t1;
+    double secs;
+    int opt, i;
+
+    while((opt = getopt(argc, argv, "n:t:s:xv:")) != -1){
+        switch(opt){
+            case 'n':
+                boards = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'x':
+                rows = 0;
+                break;
+            case 'v':
+                vec_steps = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: diffcheck [-n BOARDS] [-t THREADS] "
+                    "[-s SEED] [-x] [-v STEPS]\n");
+                return 2;
+        }
+    }
+    if(threads < 1)
+        threads = 1;
+    bb_init();
+    if(vec_steps)
+        return check_vecenv(vec_steps, seed);
+
+    printf("backends:");
+    for(i = 0; i < BACKEND_NUM; i++)
+        printf(" %s", backends[i].name);
+    printf("\n");
+    if(rows){
+        if(exhaustive_rows())
+            return 1;
+        printf("all 65536 rows agree in every line and direction\n");
+    }
+
+    w = calloc((size_t)threads, sizeof(*w));
+    tid = calloc((size_t)threads, sizeof(*tid));
+    if(w == NULL || tid == NULL){
+        perror("diffcheck");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(i = 0; i < threads; i++){
+        w[i].rng = seed * 0x100000001B3ULL + (uint64_t)i;
+        w[i].boards = boards / threads + (i < (int)(boards % threads));
+        pthread_create(&tid[i], NULL, worker, &w[i]);
+    }
+    for(i = 0; i < threads; i++){
+        pthread_join(tid[i], NULL);
+        total += w[i].done;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    printf("%llu boards x %d moves on %d threads, %.2fs, %.0f boards/s\n",
+        (unsigned long long)total, MOVE_NUM, threads, secs,
+        secs > 0 ? total / secs : 0.0);
+    if(failed)
+        return 1;
+    printf("all backends agree\n");
+    return 0;
+}
@@ -0,0 +1,244 @@
+/** @file evcache.c
+ *
+ *  @brief Persistent position-evaluation cache in a memory-mapped file.
+ *
+ *  Boards are stored by their canonical form (bb_canonical()), so the
+ *  8 rotations and mirrors of a board share one slot. The best move is
+ *  kept in the canonical frame and mapped back on lookup.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug The file is not locked, only one process should write at a time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "evcache.h"
+
+/** @brief Slot where the probe for a key starts
+ *
+ *  @return index of the slot
+ */
+static uint64_t evcache_home(const evcache_t *c, bboard_t key){
+    return (key * 0x9E3779B97F4A7C15ULL >> 20) & c->mask;
+}
+
+/** @brief Open a cache file, creating it when it does not exist
+ *
+ *  A file that cannot be made whole is removed again, so no partial
+ *  cache is left behind.
+ *
+ *  @param c: the cache to open
+ *         path: the file
+ *         bits: log2 of the slot count for a new file, ignored when the
+ *               file already exists; EVCACHE_EXISTING to fail instead of
+ *               creating one
+ *  @return 0 on success, -1 on failure with errno set
+ */
+int evcache_open(evcache_t *c, const char *path, unsigned int bits){
+    struct stat st;
+    evcache_header_t hdr;
+    void *p;
+    int created = 0, err;
+
+    c->fd = open(path, O_RDWR);
+    if(c->fd < 0 && errno == ENOENT && bits != EVCACHE_EXISTING){
+        c->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        created = 1;
+    }
+    if(c->fd < 0)
+        return -1;
+    if(fstat(c->fd, &st) < 0)
+        goto fail;
+
+    if(created){
+        /* New file, write the header and grow it to full size */
+        if(bits > 40){
+            errno = EINVAL;
+            goto fail;
+        }
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = EVCACHE_MAGIC;
+        hdr.version = EVCACHE_VERSION;
+        hdr.bits = bits;
+        c->size = sizeof(hdr) + (sizeof(evcache_entry_t) << bits);
+        if(ftruncate(c->fd, (off_t)c->size) < 0 ||
+            pwrite(c->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+            goto fail;
+    }else{
+        if(pread(c->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+            hdr.magic != EVCACHE_MAGIC || hdr.version != EVCACHE_VERSION ||
+            hdr.bits > 40)
+            goto bad;
+        c->size = sizeof(hdr) + (sizeof(evcache_entry_t) << hdr.bits);
+        if((size_t)st.st_size != c->size)
+            goto bad;
+    }
+
+    p = mmap(NULL, c->size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if(p == MAP_FAILED)
+        goto fail;
+    c->hdr = (evcache_header_t *)p;
+    c->slots = (evcache_entry_t *)(c->hdr + 1);
+    c->mask = (1ULL << c->hdr->bits) - 1;
+    return 0;
+
+bad:
+    fprintf(stderr, "evcache: %s is not a cache file\n", path);
+fail:
+    err = errno;
+    close(c->fd);
+    if(created)
+        unlink(path);
+    c->fd = -1;
+    errno = err;
+    return -1;
+}
+
+/** @brief Flush and unmap a cache
+ *
+ *  @param c: the cache
+ *  @return void
+ */
+void evcache_close(evcache_t *c){
+    if(c->fd < 0)
+        return;
+    msync(c->hdr, c->size, MS_SYNC);
+    munmap(c->hdr, c->size);
+    close(c->fd);
+    c->fd = -1;
+}
+
+/** @brief Look up a board
+ *
+ *  @param c: the cache
+ *         b: the board, in any orientation
+ *         depth: the entry must come from a search at least this deep
+ *         value: where the value is written
+ *         move: where the best move on b is written
+ *  @return 1 on a hit, 0 on a miss
+ */
+int evcache_lookup(evcache_t *c, bboard_t b, int depth, float *value,
+    int *move){
+    int sym;
+    bboard_t key = bb_canonical(b, &sym);
+    uint64_t i = evcache_home(c, key);
+    int n;
+
+    for(n = 0; n < EVCACHE_PROBES; n++, i = (i + 1) & c->mask){
+        evcache_entry_t *e = &c->slots[i];
+        if(e->key == 0)
+            break;
+        if(e->key == key){
+            if(e->depth < depth)
+                break;
+            *value = e->value;
+            *move = bb_unsym_move(e->move, sym);
+            c->hdr->hits++;
+            return 1;
+        }
+    }
+    c->hdr->misses++;
+    return 0;
+}
+
+/** @brief Store the result of a search
+ *
+ *  An existing entry of the same board is only replaced by a deeper
+ *  one. When all the probed slots hold other boards, the shallowest
+ *  of them is evicted.
+ *
+ *  @param c: the cache
+ *         b: the board, in any orientation
+ *         depth: depth of the search
+ *         value: value found
+ *         move: best move on b
+ *  @return void
+ */
+void evcache_store(evcache_t *c, bboard_t b, int depth, float value,
+    int move){
+    int sym;
+    bboard_t key = bb_canonical(b, &sym);
+    uint64_t i = evcache_home(c, key);
+    evcache_entry_t *victim = NULL;
+    int n;
+
+    if(key == 0)
+        return;
+    for(n = 0; n < EVCACHE_PROBES; n++, i = (i + 1) & c->mask){
+        evcache_entry_t *e = &c->slots[i];
+        if(e->key == 0 || e->key == key){
+            victim = e;
+            break;
+        }
+        if(victim == NULL || e->depth < victim->depth)
+            victim = e;
+    }
+    if(victim->key == key && victim->depth > depth)
+        return;
+    if(victim->key == 0)
+        c->hdr->count++;
+    else if(victim->key != key)
+        c->hdr->evictions++;
+    victim->key = key;
+    victim->value = value;
+    victim->move = (uint8_t)bb_sym_move(move, sym);
+    victim->depth = (uint8_t)depth;
+    c->hdr->stores++;
+}
+
+/** @brief Rewrite a cache into a new file
+ *
+ *  Drops entries shallower than min_depth and rehashes the rest into
+ *  1 << bits slots, deepest entries winning when the new file is full.
+ *  The counters are carried over.
+ *
+ *  @param src: the existing cache
+ *         dst: the new file, must not exist
+ *         bits: log2 of the slot count of the new file
+ *         min_depth: entries shallower than this are dropped
+ *  @return number of entries kept, -1 on failure
+ */
+int evcache_compact(const char *src, const char *dst, unsigned int bits,
+    int min_depth){
+    evcache_t in, out;
+    uint64_t i;
+    int kept = 0;
+    int d, max_depth = 0;
+
+    if(access(dst, F_OK) == 0){
+        fprintf(stderr, "evcache: %s already exists\n", dst);
+        return -1;
+    }
+    if(evcache_open(&in, src, EVCACHE_EXISTING) < 0)
+        return -1;
+    if(evcache_open(&out, dst, bits) < 0){
+        evcache_close(&in);
+        return -1;
+    }
+    for(i = 0; i <= in.mask; i++){
+        if(in.slots[i].key != 0 && in.slots[i].depth > max_depth)
+            max_depth = in.slots[i].depth;
+    }
+    /* Deepest first, so shallow entries are the ones evicted */
+    for(d = max_depth; d >= min_depth; d--){
+        for(i = 0; i <= in.mask; i++){
+            evcache_entry_t *e = &in.slots[i];
+            if(e->key == 0 || e->depth != d)
+                continue;
+            evcache_store(&out, e->key, e->depth, e->value, e->move);
+        }
+    }
+    kept = (int)out.hdr->count;
+    out.hdr->hits = in.hdr->hits;
+    out.hdr->misses = in.hdr->misses;
+    out.hdr->stores = in.hdr->stores;
+    out.hdr->evictions = in.hdr->evictions;
+    evcache_close(&out);
+    evcache_close(&in);
+    return kept;
+}
@@ -0,0 +1,67 @@
+/** @file evcache.h
+ *
+ *  @brief Persistent position-evaluation cache in a memory-mapped file.
+ *
+ *  Maps canonical boards to the value and best move found by the
+ *  search. The file is an open-addressed table of 16-byte entries after
+ *  a 64-byte header and is mapped shared, so everything stored survives
+ *  the process and the next run starts warm.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _EVCACHE_H_
+#define _EVCACHE_H_
+
+#include <stdint.h>
+#include "bitboard.h"
+
+#define EVCACHE_MAGIC   0x48435645  /* "EVCH" */
+#define EVCACHE_VERSION 1
+/* Slots looked at before an insert replaces the shallowest one */
+#define EVCACHE_PROBES  16
+/* bits of evcache_open() for a file that must already exist */
+#define EVCACHE_EXISTING 0
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bits;          /* 1 << bits slots */
+    uint32_t pad;
+    uint64_t count;         /* slots in use */
+    uint64_t hits;          /* lookups answered, over all runs */
+    uint64_t misses;        /* lookups not answered, over all runs */
+    uint64_t stores;        /* entries written, over all runs */
+    uint64_t evictions;     /* entries replaced by another board */
+    uint64_t reserved;
+}evcache_header_t;
+
+/* Key 0 (the empty board) marks a free slot */
+typedef struct
+{
+    bboard_t key;
+    float value;
+    uint8_t move;           /* best move on the canonical board */
+    uint8_t depth;
+    uint16_t pad;
+}evcache_entry_t;
+
+typedef struct
+{
+    int fd;
+    size_t size;
+    evcache_header_t *hdr;
+    evcache_entry_t *slots;
+    uint64_t mask;
+}evcache_t;
+
+int evcache_open(evcache_t *c, const char *path, unsigned int bits);
+void evcache_close(evcache_t *c);
+int evcache_lookup(evcache_t *c, bboard_t b, int depth, float *value,
+    int *move);
+void evcache_store(evcache_t *c, bboard_t b, int depth, float value,
+    int move);
+int evcache_compact(const char *src, const char *dst, unsigned int bits,
+    int min_depth);
+
+#endif
@@ -0,0 +1,154 @@
+/** @file evcache_tool.c
+ *
+ *  @brief Command line front end of the persistent evaluation cache.
+ *
+ *  evcache_tool create FILE BITS
+ *  evcache_tool stats FILE
+ *  evcache_tool compact SRC DST BITS [MIN_DEPTH]
+ *  evcache_tool warm FILE GAMES DEPTH [SEED]
+ *
+ *  'warm' plays games with the search and answers every position it can
+ *  from the cache, storing the ones it had to search. Running it twice
+ *  shows the second run starting warm in the hit counters.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "evcache.h"
+#include "ai.h"
+
+#define TT_BITS 20
+
+static ai_tt_entry_t tt[1 << TT_BITS];
+
+/** @brief Print the usage
+ *
+ *  @return 2, the exit status
+ */
+static int usage(void){
+    fprintf(stderr,
+        "usage: evcache_tool create FILE BITS\n"
+        "       evcache_tool stats FILE\n"
+        "       evcache_tool compact SRC DST BITS [MIN_DEPTH]\n"
+        "       evcache_tool warm FILE GAMES DEPTH [SEED]\n");
+    return 2;
+}
+
+/** @brief Print the header counters and the depth histogram
+ *
+ *  @return void
+ */
+static void print_stats(evcache_t *c){
+    uint64_t depth_hist[256];
+    uint64_t i, lookups;
+    int d;
+
+    memset(depth_hist, 0, sizeof(depth_hist));
+    for(i = 0; i <= c->mask; i++){
+        if(c->slots[i].key != 0)
+            depth_hist[c->slots[i].depth]++;
+    }
+    lookups = c->hdr->hits + c->hdr->misses;
+    printf("slots      %llu\n", (unsigned long long)(c->mask + 1));
+    printf("used       %llu (%.1f%%)\n", (unsigned long long)c->hdr->count,
+        100.0 * c->hdr->count / (c->mask + 1));
+    printf("hits       %llu\n", (unsigned long long)c->hdr->hits);
+    printf("misses     %llu\n", (unsigned long long)c->hdr->misses);
+    printf("hit rate   %.1f%%\n",
+        lookups ? 100.0 * c->hdr->hits / lookups : 0.0);
+    printf("stores     %llu\n", (unsigned long long)c->hdr->stores);
+    printf("evictions  %llu\n", (unsigned long long)c->hdr->evictions);
+    for(d = 0; d < 256; d++){
+        if(depth_hist[d])
+            printf("depth %-3d  %llu\n", d,
+                (unsigned long long)depth_hist[d]);
+    }
+}
+
+/** @brief Play games, answering from the cache where possible
+ *
+ *  @return 0
+ */
+static int warm(evcache_t *c, int games, int depth, uint32_t seed){
+    ai_ctx_t ai;
+    uint64_t hits = 0, searched = 0;
+    clock_t start = clock();
+    double secs;
+    int g;
+
+    ai_init(&ai, tt, TT_BITS);
+    for(g = 0; g < games; g++){
+        bboard_t b = bb_add_random(bb_add_random(0, &seed), &seed);
+        uint32_t score = 0;
+        for(;;){
+            float value;
+            int move;
+            if(evcache_lookup(c, b, depth, &value, &move)){
+                hits++;
+            }else{
+                move = ai_search(&ai, b, depth, 0);
+                if(move < 0)
+                    break;
+                evcache_store(c, b, depth, ai_get_stats(&ai)->value, move);
+                searched++;
+            }
+            b = bb_add_random(bb_move(b, move, &score), &seed);
+        }
+        printf("game %d: score %u max %d\n", g, score, 1 << bb_max_tile(b));
+    }
+    secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("positions %llu, from cache %llu, searched %llu, %.2fs\n",
+        (unsigned long long)(hits + searched), (unsigned long long)hits,
+        (unsigned long long)searched, secs);
+    return 0;
+}
+
+int main(int argc, char **argv){
+    evcache_t c;
+    int ret = 0;
+
+    if(argc < 3)
+        return usage();
+
+    if(strcmp(argv[1], "create") == 0 && argc == 4){
+        if(atoi(argv[3]) < 1)
+            return usage();
+        if(evcache_open(&c, argv[2], (unsigned int)atoi(argv[3])) < 0){
+            perror(argv[2]);
+            return 1;
+        }
+        evcache_close(&c);
+    }else if(strcmp(argv[1], "stats") == 0 && argc == 3){
+        if(evcache_open(&c, argv[2], EVCACHE_EXISTING) < 0){
+            perror(argv[2]);
+            return 1;
+        }
+        print_stats(&c);
+        evcache_close(&c);
+    }else if(strcmp(argv[1], "compact") == 0 && (argc == 5 || argc == 6)){
+        int kept = evcache_compact(argv[2], argv[3],
+            (unsigned int)atoi(argv[4]), argc == 6 ? atoi(argv[5]) : 0);
+        if(kept < 0){
+            perror(argv[2]);
+            return 1;
+        }
+        printf("kept %d entries\n", kept);
+    }else if(strcmp(argv[1], "warm") == 0 && (argc == 5 || argc == 6)){
+        if(evcache_open(&c, argv[2], 22) < 0){
+            perror(argv[2]);
+            return 1;
+        }
+        ret = warm(&c, atoi(argv[3]), atoi(argv[4]),
+            argc == 6 ? (uint32_t)strtoul(argv[5], NULL, 0) : 1);
+        print_stats(&c);
+        evcache_close(&c);
+    }else{
+        return usage();
+    }
+    return ret;
+}
@@ -0,0 +1,583 @@
+/** @file gameserver.c
+ *
+ *  @brief Headless game server speaking the protocol of gameserver.h.
+ *
+ *  A session is one client on a Unix domain socket, or on stdin/stdout
+ *  when no socket is given. It runs as three threads joined by queues:
+ *  the reader cuts the input into messages, the worker plays them on
+ *  the packed board and the writer sends the replies, several per
+ *  writev(). The engine never waits for the client to read or write,
+ *  and a client can keep many requests in flight.
+ *
+ *  Every session has its own games, touched only by its worker. Games
+ *  draw the same numbers as the engine, so game s here is the game with
+ *  seed s in the kernel.
+ *
+ *  gameserver [-s SOCKET]
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "engine.h"
+#include "bitboard.h"
+#include "gameserver.h"
+
+/* Messages waiting between two threads of a session */
+#define QUEUE_LEN 256
+/* Replies sent by one writev() */
+#define WRITE_BATCH 64
+#define READ_BUF (64 << 10)
+
+/* One message, with its length in front as it goes on the wire */
+typedef struct
+{
+    uint32_t len;           /* type byte and payload */
+    uint8_t data[];         /* data[0] is the type */
+}msg_t;
+
+typedef struct
+{
+    msg_t *slot[QUEUE_LEN];
+    unsigned int head, tail;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+}queue_t;
+
+typedef struct
+{
+    bboard_t board;
+    uint32_t score;
+    uint32_t moves;
+    uint32_t rng;
+    uint8_t target;         /* log2 of the target score, 0 for none */
+    uint8_t live;
+}sgame_t;
+
+typedef struct
+{
+    int in, out;
+    queue_t requests;
+    queue_t replies;
+    /* Owned by the worker */
+    sgame_t *games;
+    uint32_t game_num, game_cap;
+    uint32_t *free_ids;
+    uint32_t free_num;
+    uint64_t messages, moves;
+    /* Owned by the reader */
+    uint8_t rbuf[READ_BUF];
+    size_t rpos, rend;
+}session_t;
+
+/*******************************************************
+ * Queues
+ *******************************************************/
+
+static void queue_init(queue_t *q){
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void queue_destroy(queue_t *q){
+    while(q->head != q->tail)
+        free(q->slot[q->head++ % QUEUE_LEN]);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static void queue_push(queue_t *q, msg_t *m){
+    pthread_mutex_lock(&q->lock);
+    while(q->tail - q->head == QUEUE_LEN)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    q->slot[q->tail++ % QUEUE_LEN] = m;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* No more messages after the ones queued */
+static void queue_close(queue_t *q){
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/** @brief Take every queued message, up to max, waiting for one
+ *
+ *  @return number of messages taken, 0 once the queue is closed and empty
+ */
+static int queue_pop(queue_t *q, msg_t **m, int max){
+    int n = 0;
+    pthread_mutex_lock(&q->lock);
+    while(q->head == q->tail && !q->closed)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    while(n < max && q->head != q->tail)
+        m[n++] = q->slot[q->head++ % QUEUE_LEN];
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+/*******************************************************
+ * Messages
+ *******************************************************/
+
+static msg_t *msg_new(uint8_t type, uint32_t payload){
+    msg_t *m = malloc(sizeof(*m) + 1 + payload);
+    if(m == NULL){
+        perror("gameserver");
+        exit(1);
+    }
+    m->len = 1 + payload;
+    m->data[0] = type;
+    return m;
+}
+
+static uint32_t get_u32(const uint8_t *p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v){
+    memcpy(p, &v, sizeof(v));
+}
+
+static msg_t *error_reply(uint32_t code, uint8_t type){
+    msg_t *m = msg_new(GS_ERROR, 5);
+    put_u32(m->data + 1, code);
+    m->data[5] = type;
+    return m;
+}
+
+/*******************************************************
+ * Games
+ *******************************************************/
+
+static uint32_t legal_moves(bboard_t b){
+    uint32_t score = 0, legal = 0;
+    int dir;
+    for(dir = 0; dir < MOVE_NUM; dir++){
+        if(bb_move(b, dir, &score) != b)
+            legal |= 1u << dir;
+    }
+    return legal;
+}
+
+/** @brief Write the state of a game into a reply
+ *
+ *  @param p: GS_STATE_BYTES bytes of the reply
+ *         id: the game
+ *         g: the game, NULL if there is no such game
+ *         flags: GS_FLAG_MOVED or 0
+ *  @return void
+ */
+static void put_state(uint8_t *p, uint32_t id, const sgame_t *g, int flags){
+    int max;
+    uint32_t legal;
+
+    memset(p, 0, GS_STATE_BYTES);
+    put_u32(p, id);
+    if(g == NULL){
+        p[21] = GS_FLAG_INVALID;
+        return;
+    }
+    max = bb_max_tile(g->board);
+    legal = legal_moves(g->board);
+    if(legal == 0)
+        flags |= GS_FLAG_OVER;
+    if(g->target != 0 && max >= g->target)
+        flags |= GS_FLAG_WON;
+    put_u32(p + 4, g->score);
+    memcpy(p + 8, &g->board, sizeof(g->board));
+    put_u32(p + 16, g->moves);
+    p[20] = (uint8_t)legal;
+    p[21] = (uint8_t)flags;
+    p[22] = (uint8_t)max;
+}
+
+static sgame_t *find_game(session_t *s, uint32_t id){
+    if(id >= s->game_num || !s->games[id].live)
+        return NULL;
+    return &s->games[id];
+}
+
+/** @brief Take a free game id, growing the table if needed
+ *
+ *  @return the id
+ */
+static uint32_t alloc_game(session_t *s){
+    if(s->free_num > 0)
+        return s->free_ids[--s->free_num];
+    if(s->game_num == s->game_cap){
+        s->game_cap = s->game_cap ? s->game_cap * 2 : 1024;
+        s->games = realloc(s->games, s->game_cap * sizeof(*s->games));
+        s->free_ids = realloc(s->free_ids, s->game_cap * sizeof(*s->free_ids));
+        if(s->games == NULL || s->free_ids == NULL){
+            perror("gameserver");
+            exit(1);
+        }
+    }
+    return s->game_num++;
+}
+
+static msg_t *do_create(session_t *s, const uint8_t *p, uint32_t len){
+    uint32_t count, seed, target, i, id;
+    uint8_t goal = 0;
+    msg_t *m;
+    sgame_t *g;
+    game_t eg;
+
+    if(len != 12)
+        return error_reply(GS_ERR_LENGTH, GS_CREATE);
+    count = get_u32(p);
+    seed = get_u32(p + 4);
+    target = get_u32(p + 8);
+    if(count > (GS_MAX_MSG - 5) / GS_STATE_BYTES)
+        return error_reply(GS_ERR_SIZE, GS_CREATE);
+    while(goal < 15 && (2u << goal) <= target)
+        goal++;
+
+    m = msg_new(GS_CREATE, 4 + count * GS_STATE_BYTES);
+    put_u32(m->data + 1, count);
+    for(i = 0; i < count; i++){
+        id = alloc_game(s);
+        g = &s->games[id];
+        /* The engine's own seeding, then its two first numbers */
+        engine_init(&eg, seed + i, (int)target);
+        g->rng = eg.rng;
+        g->board = bb_add_random(bb_add_random(0, &g->rng), &g->rng);
+        g->score = 0;
+        g->moves = 0;
+        g->target = goal;
+        g->live = 1;
+        put_state(m->data + 5 + i * GS_STATE_BYTES, id, g, 0);
+    }
+    return m;
+}
+
+static msg_t *do_step(session_t *s, const uint8_t *p, uint32_t len){
+    uint32_t count, i, id;
+    unsigned int dir;
+    bboard_t nb;
+    msg_t *m;
+    sgame_t *g;
+    int flags;
+
+    if(len < 4 || (uint64_t)len != 4 + (uint64_t)get_u32(p) * 5)
+        return error_reply(GS_ERR_LENGTH, GS_STEP);
+    count = get_u32(p);
+    if(count > (GS_MAX_MSG - 5) / GS_STATE_BYTES)
+        return error_reply(GS_ERR_SIZE, GS_STEP);
+
+    m = msg_new(GS_STEP, 4 + count * GS_STATE_BYTES);
+    put_u32(m->data + 1, count);
+    for(i = 0; i < count; i++){
+        id = get_u32(p + 4 + i * 5);
+        dir = p[8 + i * 5];
+        g = find_game(s, id);
+        if(dir >= MOVE_NUM)
+            g = NULL;
+        flags = 0;
+        if(g != NULL){
+            nb = bb_move(g->board, (int)dir, &g->score);
+            if(nb != g->board){
+                g->board = bb_add_random(nb, &g->rng);
+                g->moves++;
+                flags = GS_FLAG_MOVED;
+            }
+        }
+        put_state(m->data + 5 + i * GS_STATE_BYTES, id, g, flags);
+    }
+    s->moves += count;
+    return m;
+}
+
+/* GS_GET and GS_FREE, both a list of ids */
+static msg_t *do_ids(session_t *s, uint8_t type, const uint8_t *p,
+    uint32_t len){
+    uint32_t count, i, id, freed = 0;
+    msg_t *m;
+    sgame_t *g;
+
+    if(len < 4 || (uint64_t)len != 4 + (uint64_t)get_u32(p) * 4)
+        return error_reply(GS_ERR_LENGTH, type);
+    count = get_u32(p);
+    if(type == GS_FREE){
+        for(i = 0; i < count; i++){
+            id = get_u32(p + 4 + i * 4);
+            if((g = find_game(s, id)) != NULL){
+                g->live = 0;
+                s->free_ids[s->free_num++] = id;
+                freed++;
+            }
+        }
+        m = msg_new(GS_FREE, 4);
+        put_u32(m->data + 1, freed);
+        return m;
+    }
+    if(count > (GS_MAX_MSG - 5) / GS_STATE_BYTES)
+        return error_reply(GS_ERR_SIZE, type);
+    m = msg_new(GS_GET, 4 + count * GS_STATE_BYTES);
+    put_u32(m->data + 1, count);
+    for(i = 0; i < count; i++){
+        id = get_u32(p + 4 + i * 4);
+        put_state(m->data + 5 + i * GS_STATE_BYTES, id, find_game(s, id), 0);
+    }
+    return m;
+}
+
+static msg_t *handle(session_t *s, const msg_t *req){
+    const uint8_t *p = req->data + 1;
+    uint32_t len = req->len - 1;
+
+    /* Queued by the reader for a length out of range */
+    if(req->len == 0)
+        return error_reply(GS_ERR_FRAME, 0);
+    switch(req->data[0]){
+        case GS_CREATE:
+            return do_create(s, p, len);
+        case GS_STEP:
+            return do_step(s, p, len);
+        case GS_GET:
+        case GS_FREE:
+            return do_ids(s, req->data[0], p, len);
+        default:
+            return error_reply(GS_ERR_TYPE, req->data[0]);
+    }
+}
+
+/*******************************************************
+ * Session threads
+ *******************************************************/
+
+static void *worker(void *arg){
+    session_t *s = arg;
+    msg_t *reqs[WRITE_BATCH];
+    int n, i;
+
+    while((n = queue_pop(&s->requests, reqs, WRITE_BATCH)) > 0){
+        for(i = 0; i < n; i++){
+            queue_push(&s->replies, handle(s, reqs[i]));
+            free(reqs[i]);
+            s->messages++;
+        }
+    }
+    queue_close(&s->replies);
+    return NULL;
+}
+
+/** @brief writev() every byte of the vectors
+ *
+ *  @return 0 on success, -1 on failure
+ */
+static int writev_all(int fd, struct iovec *iov, int cnt){
+    ssize_t got;
+    while(cnt > 0){
+        if((got = writev(fd, iov, cnt)) < 0){
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        while(cnt > 0 && (size_t)got >= iov->iov_len){
+            got -= (ssize_t)iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if(cnt > 0){
+            iov->iov_base = (char *)iov->iov_base + got;
+            iov->iov_len -= (size_t)got;
+        }
+    }
+    return 0;
+}
+
+static void *writer(void *arg){
+    session_t *s = arg;
+    msg_t *reps[WRITE_BATCH];
+    struct iovec iov[WRITE_BATCH];
+    int n, i, failed = 0;
+
+    while((n = queue_pop(&s->replies, reps, WRITE_BATCH)) > 0){
+        for(i = 0; i < n; i++){
+            iov[i].iov_base = reps[i];
+            iov[i].iov_len = sizeof(uint32_t) + reps[i]->len;
+        }
+        /* Keep draining after a failure so the worker is never stuck */
+        if(!failed && writev_all(s->out, iov, n) != 0)
+            failed = 1;
+        for(i = 0; i < n; i++)
+            free(reps[i]);
+    }
+    return NULL;
+}
+
+/** @brief Read len bytes through the session's buffer
+ *
+ *  @return 0 on success, -1 at the end of the input or on failure
+ */
+static int read_bytes(session_t *s, void *dst, size_t len){
+    uint8_t *d = dst;
+    ssize_t got;
+    size_t take;
+
+    while(len > 0){
+        if(s->rpos == s->rend){
+            got = read(s->in, s->rbuf, sizeof(s->rbuf));
+            if(got < 0 && errno == EINTR)
+                continue;
+            if(got <= 0)
+                return -1;
+            s->rpos = 0;
+            s->rend = (size_t)got;
+        }
+        take = s->rend - s->rpos;
+        if(take > len)
+            take = len;
+        memcpy(d, s->rbuf + s->rpos, take);
+        s->rpos += take;
+        d += take;
+        len -= take;
+    }
+    return 0;
+}
+
+/** @brief Serve one client until it closes its side
+ *
+ *  The calling thread is the reader.
+ *
+ *  @param in: where requests come from
+ *         out: where replies go
+ *  @return void
+ */
+static void session_run(int in, int out){
+    session_t *s;
+    pthread_t wk, wr;
+    uint32_t len;
+    msg_t *m;
+
+    if((s = calloc(1, sizeof(*s))) == NULL){
+        perror("gameserver");
+        return;
+    }
+    s->in = in;
+    s->out = out;
+    queue_init(&s->requests);
+    queue_init(&s->replies);
+    pthread_create(&wk, NULL, worker, s);
+    pthread_create(&wr, NULL, writer, s);
+
+    while(read_bytes(s, &len, sizeof(len)) == 0){
+        if(len == 0 || len > GS_MAX_MSG){
+            /* The stream cannot be cut into messages any more */
+            m = msg_new(0, 0);
+            m->len = 0;
+            queue_push(&s->requests, m);
+            break;
+        }
+        m = msg_new(0, len - 1);
+        if(read_bytes(s, m->data, len) != 0){
+            free(m);
+            break;
+        }
+        queue_push(&s->requests, m);
+    }
+    queue_close(&s->requests);
+    pthread_join(wk, NULL);
+    pthread_join(wr, NULL);
+
+    fprintf(stderr, "gameserver: session done, %llu messages, %llu moves, "
+        "%u games\n", (unsigned long long)s->messages,
+        (unsigned long long)s->moves, s->game_num - s->free_num);
+    queue_destroy(&s->requests);
+    queue_destroy(&s->replies);
+    free(s->games);
+    free(s->free_ids);
+    free(s);
+}
+
+static void *connection(void *arg){
+    int fd = (int)(intptr_t)arg;
+    session_run(fd, fd);
+    close(fd);
+    return NULL;
+}
+
+/** @brief Accept clients on a Unix domain socket, one session each
+ *
+ *  @return only on failure
+ */
+static int serve_socket(const char *path){
+    struct sockaddr_un addr;
+    pthread_t tid;
+    int lfd, fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)){
+        fprintf(stderr, "gameserver: socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(lfd, 64) != 0){
+        perror(path);
+        return 1;
+    }
+    while(1){
+        if((fd = accept(lfd, NULL, NULL)) < 0){
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            return 1;
+        }
+        if(pthread_create(&tid, NULL, connection, (void *)(intptr_t)fd) != 0){
+            close(fd);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+}
+
+int main(int argc, char **argv){
+    const char *path = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:")) != -1){
+        switch(opt){
+            case 's':
+                path = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: gameserver [-s SOCKET]\n");
+                return 2;
+        }
+    }
+    /* A client that goes away shows up as a failed write */
+    signal(SIGPIPE, SIG_IGN);
+    bb_init();
+    if(path != NULL)
+        return serve_socket(path);
+    session_run(STDIN_FILENO, STDOUT_FILENO);
+    return 0;
+}
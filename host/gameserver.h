@@ -0,0 +1,63 @@
+/** @file gameserver.h
+ *
+ *  @brief Binary protocol of the game server (gameserver.c).
+ *
+ *  Every message, both ways, is a 32-bit length, a type byte and the
+ *  payload; the length counts the type byte and the payload. Integers
+ *  are little-endian. The server answers every request with one reply
+ *  of the same type, in order, so a client can send many requests
+ *  before reading the first reply.
+ *
+ *    GS_CREATE  u32 count, u32 seed, u32 target
+ *               -> u32 count, count game states
+ *               Game i starts like engine_init() with seed + i.
+ *    GS_STEP    u32 count, count (u32 id, u8 dir)
+ *               -> u32 count, count game states
+ *    GS_GET     u32 count, count u32 id
+ *               -> u32 count, count game states
+ *    GS_FREE    u32 count, count u32 id
+ *               -> u32 games freed
+ *    GS_ERROR   (reply only) u32 GS_ERR_*, u8 type of the request
+ *
+ *  A game state is GS_STATE_BYTES bytes:
+ *
+ *    u32 id, u32 score, u64 packed board (bitboard.h), u32 moves,
+ *    u8 legal moves (bit MOVE_*), u8 GS_FLAG_*, u8 log2 of the max tile,
+ *    u8 0
+ *
+ *  GS_FLAG_INVALID is set alone, with the id, when there is no game
+ *  with that id or the direction is not a MOVE_*.
+ *
+ *  Ids of freed games are given to new games again. A move that does
+ *  not change the board, as every move once the game is over, leaves
+ *  the game as it is and GS_FLAG_MOVED clear.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _GAMESERVER_H_
+#define _GAMESERVER_H_
+
+/* Message types */
+#define GS_CREATE 'C'
+#define GS_STEP   'S'
+#define GS_GET    'G'
+#define GS_FREE   'F'
+#define GS_ERROR  'E'
+
+/* Length of the largest message, type byte included */
+#define GS_MAX_MSG (16 << 20)
+#define GS_STATE_BYTES 24
+
+/* Flags of a game state */
+#define GS_FLAG_MOVED   0x01    /* the move of this request changed the board */
+#define GS_FLAG_OVER    0x02    /* no legal move left */
+#define GS_FLAG_WON     0x04    /* the target was reached */
+#define GS_FLAG_INVALID 0x08    /* no such game, or dir is no MOVE_* */
+
+/* Codes of GS_ERROR */
+#define GS_ERR_TYPE   1         /* unknown message type */
+#define GS_ERR_LENGTH 2         /* payload does not match its count */
+#define GS_ERR_SIZE   3         /* too many games at once */
+#define GS_ERR_FRAME  4         /* length 0 or over GS_MAX_MSG, the session ends */
+
+#endif
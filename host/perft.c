@@ -0,0 +1,279 @@
+/** @file perft.c
+ *
+ *  @brief Perft for 2048: every board reachable from a seeded opening.
+ *
+ *  One ply is a move that changes the board followed by a new block,
+ *  2 or 4, on any empty square. Plies are expanded a level at a time:
+ *  the boards of a level are shared among the threads, and every child
+ *  goes, in canonical form, into a lock-free hash set for the next
+ *  level. Each entry also counts the paths leading to it, so the number
+ *  of move/spawn sequences of every depth (the perft number) comes out
+ *  exact while each distinct board is expanded once.
+ *
+ *  The counts and the checksum of the unique boards only depend on
+ *  bb_move() and bb_canonical(), so a change in the move generator
+ *  shows up as different numbers for the same seed and depth.
+ *
+ *  perft [-d DEPTH] [-s SEED] [-t THREADS] [-m LOG2_SLOTS]
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include "engine.h"
+#include "bitboard.h"
+
+/* Boards a thread takes from the level at once */
+#define CHUNK 1024
+
+typedef struct
+{
+    pthread_t tid;
+    uint64_t children;      /* boards generated */
+    uint64_t inserted;      /* of them new in the set */
+    int full;               /* the set ran out of slots */
+} __attribute__((aligned(64))) worker_t;
+
+/* Open addressing set: 0 is a free slot, no reachable board is 0 */
+static uint64_t *keys;
+static uint64_t *paths;
+static uint64_t slot_mask;
+
+/* Level being expanded */
+static uint64_t *level_keys;
+static uint64_t *level_paths;
+static size_t level_num;
+static size_t next_board;
+
+static uint64_t mix(uint64_t x){
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/** @brief Add the paths of a board to the set
+ *
+ *  @return 1 if the board was new, 0 if it was there, -1 if the set is full
+ */
+static int insert(uint64_t key, uint64_t n){
+    uint64_t i = mix(key) & slot_mask, seen, probes;
+
+    for(probes = 0; probes <= slot_mask; probes++){
+        seen = __atomic_load_n(&keys[i], __ATOMIC_ACQUIRE);
+        if(seen == 0){
+            seen = 0;
+            if(__atomic_compare_exchange_n(&keys[i], &seen, key, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+                __atomic_fetch_add(&paths[i], n, __ATOMIC_RELAXED);
+                return 1;
+            }
+            /* Lost the slot, seen is the board that took it */
+        }
+        if(seen == key){
+            __atomic_fetch_add(&paths[i], n, __ATOMIC_RELAXED);
+            return 0;
+        }
+        i = (i + 1) & slot_mask;
+    }
+    return -1;
+}
+
+/** @brief Expand one board: every move, then every new block
+ *
+ *  @return void
+ */
+static void expand(worker_t *w, bboard_t b, uint64_t n){
+    uint32_t score = 0;
+    bboard_t nb;
+    int dir, cell, ret;
+
+    for(dir = 0; dir < MOVE_NUM; dir++){
+        nb = bb_move(b, dir, &score);
+        if(nb == b)
+            continue;
+        for(cell = 0; cell < 16; cell++){
+            if((nb >> (cell * 4)) & 0xf)
+                continue;
+            /* 2 and 4, exponents 1 and 2 */
+            ret = insert(bb_canonical(nb | (1ULL << (cell * 4)), NULL), n);
+            w->inserted += ret > 0;
+            w->full |= ret < 0;
+            ret = insert(bb_canonical(nb | (2ULL << (cell * 4)), NULL), n);
+            w->inserted += ret > 0;
+            w->full |= ret < 0;
+            w->children += 2;
+        }
+    }
+}
+
+static void *worker(void *arg){
+    worker_t *w = arg;
+    size_t i, end;
+
+    while((i = __atomic_fetch_add(&next_board, CHUNK, __ATOMIC_RELAXED)) <
+        level_num && !w->full){
+        end = i + CHUNK < level_num ? i + CHUNK : level_num;
+        for(; i < end; i++)
+            expand(w, level_keys[i], level_paths[i]);
+    }
+    return NULL;
+}
+
+/** @brief Move the set into the level arrays and empty it
+ *
+ *  @param n: number of boards in the set
+ *         total: where the sum of their paths goes
+ *         check: where the checksum of the boards goes
+ *  @return 0 on success, -1 if out of memory
+ */
+static int take_level(size_t n, uint64_t *total, uint64_t *check){
+    uint64_t i;
+    size_t k = 0;
+
+    free(level_keys);
+    free(level_paths);
+    level_keys = malloc(n * sizeof(*level_keys));
+    level_paths = malloc(n * sizeof(*level_paths));
+    if(level_keys == NULL || level_paths == NULL)
+        return -1;
+    *total = 0;
+    *check = 0;
+    for(i = 0; i <= slot_mask; i++){
+        if(keys[i] == 0)
+            continue;
+        level_keys[k] = keys[i];
+        level_paths[k] = paths[i];
+        *total += paths[i];
+        /* Independent of the order of the slots */
+        *check += mix(keys[i]);
+        k++;
+        /* Only used slots are written back, the rest stays untouched */
+        keys[i] = 0;
+        paths[i] = 0;
+    }
+    level_num = k;
+    return 0;
+}
+
+int main(int argc, char **argv){
+    int depth = 3, threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int slot_bits = 22, opt, d, i, full;
+    uint32_t seed = 1, rng;
+    uint64_t children, unique, total, check, all_children = 0;
+    struct timespec t0, t1, start;
+    double secs, all_secs;
+    worker_t *w;
+    bboard_t b;
+    game_t g;
+
+    while((opt = getopt(argc, argv, "d:s:t:m:")) != -1){
+        switch(opt){
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 's':
+                seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'm':
+                slot_bits = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: perft [-d DEPTH] [-s SEED] "
+                    "[-t THREADS] [-m LOG2_SLOTS]\n");
+                return 2;
+        }
+    }
+    if(threads < 1)
+        threads = 1;
+    if(slot_bits < 10 || slot_bits > 34){
+        fprintf(stderr, "perft: LOG2_SLOTS must be 10 to 34\n");
+        return 2;
+    }
+    bb_init();
+    slot_mask = (1ULL << slot_bits) - 1;
+    keys = calloc(slot_mask + 1, sizeof(*keys));
+    paths = calloc(slot_mask + 1, sizeof(*paths));
+    w = calloc((size_t)threads, sizeof(*w));
+    if(keys == NULL || paths == NULL || w == NULL){
+        perror("perft");
+        return 1;
+    }
+
+    /* The engine's own opening for the seed */
+    engine_init(&g, seed, 2048);
+    rng = g.rng;
+    b = bb_add_random(bb_add_random(0, &rng), &rng);
+    insert(bb_canonical(b, NULL), 1);
+    take_level(1, &total, &check);
+    printf("seed %u opening %016llx, %d threads, 2^%d slots\n",
+        (unsigned int)seed, (unsigned long long)b, threads, slot_bits);
+    printf("%5s %20s %14s %12s %18s %14s\n", "depth", "paths", "children",
+        "unique", "checksum", "states/s");
+    printf("%5d %20llu %14d %12d %18s %14s\n", 0, 1ULL, 0, 1, "-", "-");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(d = 1; d <= depth; d++){
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        next_board = 0;
+        memset(w, 0, (size_t)threads * sizeof(*w));
+        for(i = 0; i < threads; i++)
+            pthread_create(&w[i].tid, NULL, worker, &w[i]);
+        children = unique = 0;
+        full = 0;
+        for(i = 0; i < threads; i++){
+            pthread_join(w[i].tid, NULL);
+            children += w[i].children;
+            unique += w[i].inserted;
+            full |= w[i].full;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if(full){
+            fprintf(stderr, "perft: depth %d needs more than 2^%d slots, "
+                "raise -m\n", d, slot_bits);
+            return 1;
+        }
+        if(take_level((size_t)unique, &total, &check) != 0){
+            perror("perft");
+            return 1;
+        }
+        secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        if(secs <= 0)
+            secs = 1e-9;
+        all_children += children;
+        printf("%5d %20llu %14llu %12llu   %016llx %14.0f\n", d,
+            (unsigned long long)total, (unsigned long long)children,
+            (unsigned long long)unique, (unsigned long long)check,
+            children / secs);
+        fflush(stdout);
+        if(level_num == 0)
+            break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    all_secs = (t1.tv_sec - start.tv_sec) +
+        (t1.tv_nsec - start.tv_nsec) / 1e9;
+    if(all_secs <= 0)
+        all_secs = 1e-9;
+    printf("total %llu states in %.3fs, %.0f states/s\n",
+        (unsigned long long)all_children, all_secs, all_children / all_secs);
+
+    free(keys);
+    free(paths);
+    free(level_keys);
+    free(level_paths);
+    free(w);
+    return 0;
+}
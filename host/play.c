@@ -0,0 +1,106 @@
+/** @file play.c
+ *
+ *  @brief Terminal front end of the engine, linked against libengine.
+ *
+ *  Shows how a host program plugs its own rendering and input into
+ *  engine_play(): the board is printed to stdout and moves are read as
+ *  'w a s d' lines from stdin, 'q' leaves. With a REPLAY file the game
+ *  is recorded in the format of replay.h.
+ *
+ *  play [SEED] [TARGET] [REPLAY]
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "engine.h"
+#include "replay.h"
+
+/* Set when the game is recorded */
+static replay_writer_t writer;
+static FILE *replay_file = NULL;
+
+static int write_file(void *ctx, const void *buf, uint32_t len){
+    return fwrite(buf, 1, len, ctx) == len ? 0 : -1;
+}
+
+/** @brief Print the board and the score
+ *
+ *  @return void
+ */
+static void render(game_t *g, void *ctx){
+    int x, y;
+    (void)ctx;
+    /* board[x][y]: x is the column, y the row on screen */
+    for(y = 0; y < SIZE; y++){
+        for(x = 0; x < SIZE; x++)
+            printf("%6d", g->board[x][y]);
+        printf("\n");
+    }
+    printf("score %d\n\n", g->score);
+}
+
+/** @brief Read the next move from stdin
+ *
+ *  @return MOVE_*, -1 on 'q' or end of input
+ */
+static int read_move(void){
+    int ch;
+    while((ch = getchar()) != EOF){
+        switch(ch){
+            case 'w':
+                return MOVE_UP;
+            case 's':
+                return MOVE_DOWN;
+            case 'a':
+                return MOVE_LEFT;
+            case 'd':
+                return MOVE_RIGHT;
+            case 'q':
+                return -1;
+        }
+    }
+    return -1;
+}
+
+/** @brief Next move from stdin, recorded if there is a replay
+ *
+ *  @return MOVE_*, -1 to leave
+ */
+static int input(game_t *g, void *ctx){
+    int dir = read_move();
+    (void)ctx;
+    if(dir >= 0 && replay_file != NULL)
+        replay_write_move(&writer, g, dir);
+    return dir;
+}
+
+int main(int argc, char **argv){
+    game_t g;
+    engine_io_t io = { render, input, NULL };
+    int ret;
+
+    engine_init(&g, argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 1,
+        argc > 2 ? atoi(argv[2]) : 2048);
+    if(argc > 3){
+        replay_header_t h = { REPLAY_VERSION, REPLAY_RULES_CLASSIC,
+            g.target_score, g.rng };
+        if((replay_file = fopen(argv[3], "wb")) == NULL){
+            perror(argv[3]);
+            return 1;
+        }
+        replay_write_begin(&writer, write_file, replay_file, &h);
+    }
+    ret = engine_play(&g, &io);
+    if(replay_file != NULL){
+        if(replay_write_end(&writer, &g) != 0 || fclose(replay_file) != 0)
+            perror(argv[3]);
+    }
+    if(ret == ENGINE_WIN)
+        printf("GOT %d! YOU WIN!\n", g.target_score);
+    else if(ret == ENGINE_OVER)
+        printf("GAME IS OVER!\n");
+    return 0;
+}
@@ -0,0 +1,373 @@
+/** @file replayverify.c
+ *
+ *  @brief Check directories of replays by playing every one of them.
+ *
+ *  The files are listed first, then the threads take them one at a time
+ *  from a shared counter. Every replay is mapped, read in place and
+ *  played on the packed board (or with the engine itself with -e); the
+ *  score, max tile and board it claims must come out of its moves and
+ *  its seed. Broken or inconsistent replays are listed on stderr.
+ *
+ *  Then replay_seek() jumps to a few moves drawn from the replay's seed,
+ *  and the game it finds (board, score, generator and the next move)
+ *  must be the one reached by playing from move 0, which catches a
+ *  broken keyframe or index.
+ *
+ *  replayverify [-t THREADS] [-e] [-k SEEKS] PATH...
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "engine.h"
+#include "bitboard.h"
+#include "replay.h"
+
+/* Seeks checked per replay by default */
+#define SEEKS_DEFAULT 4
+#define SEEKS_MAX 64
+
+typedef struct
+{
+    const uint8_t *start;
+    const uint8_t *p;
+    const uint8_t *end;
+}mem_src_t;
+
+typedef struct
+{
+    pthread_t tid;
+    uint64_t files;
+    uint64_t bad;
+    uint64_t bytes;
+    uint64_t moves;
+} __attribute__((aligned(64))) worker_t;
+
+static char **paths = NULL;
+static size_t path_num = 0, path_cap = 0;
+static size_t next_path = 0;
+static int use_engine = 0;
+static int seeks = SEEKS_DEFAULT;
+
+static int mem_read(void *ctx, void *buf, uint32_t len){
+    mem_src_t *src = ctx;
+    uint32_t left = (uint32_t)(src->end - src->p);
+    if(len > left)
+        len = left;
+    memcpy(buf, src->p, len);
+    src->p += len;
+    return (int)len;
+}
+
+static int mem_seek(void *ctx, int32_t off, int from_end){
+    mem_src_t *src = ctx;
+    const uint8_t *base = from_end ? src->end : src->start;
+    if(off < src->start - base || off > src->end - base)
+        return -1;
+    src->p = base + off;
+    return 0;
+}
+
+static int compare_u32(const void *a, const void *b){
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static const char *error_name(int err){
+    switch(err){
+        case REPLAY_ERR_IO:
+            return "truncated";
+        case REPLAY_ERR_CRC:
+            return "bad crc";
+        default:
+            return "bad format";
+    }
+}
+
+/** @brief Play a replay on the packed board and compare its end record
+ *
+ *  @param r: the reader, after replay_read_begin()
+ *         moves: where the number of moves played goes
+ *  @return NULL if it is consistent, what is wrong if not
+ */
+static const char *play_packed(replay_reader_t *r, uint32_t *moves){
+    game_t g;
+    bboard_t b, nb;
+    uint32_t rng, score = 0;
+    int dir;
+
+    /* The engine's own seeding, then its two first numbers */
+    engine_init(&g, r->header.seed, r->header.target_score);
+    rng = g.rng;
+    b = bb_add_random(bb_add_random(0, &rng), &rng);
+    while((dir = replay_read_move(r)) >= 0){
+        nb = bb_move(b, dir, &score);
+        if(nb != b)
+            b = bb_add_random(nb, &rng);
+    }
+    *moves = r->moves;
+    if(dir != REPLAY_END)
+        return error_name(dir);
+    if(score != r->end.score)
+        return "score";
+    if((1 << bb_max_tile(b)) != r->end.max_tile)
+        return "max tile";
+    if(r->end.board != 0 && b != r->end.board)
+        return "board";
+    return NULL;
+}
+
+/** @brief Play a replay with engine_step(), the reference
+ *
+ *  @return NULL if it is consistent, what is wrong if not
+ */
+static const char *play_engine(replay_reader_t *r, uint32_t *moves){
+    game_t g;
+    int dir;
+
+    replay_start(&g, &r->header);
+    while((dir = replay_read_move(r)) >= 0)
+        engine_step(&g, dir);
+    *moves = r->moves;
+    if(dir != REPLAY_END)
+        return error_name(dir);
+    if(replay_check(&g, &r->end, r->moves) != 0)
+        return "score, max tile or board";
+    return NULL;
+}
+
+/** @brief Check replay_seek() against playing the replay from move 0
+ *
+ *  The moves looked for are drawn from the seed, so a failure repeats;
+ *  the last one is the end of the game. They are sorted and the
+ *  reference game passes each of them once.
+ *
+ *  @param map: the replay
+ *         size: its bytes
+ *         total: its number of moves, already checked
+ *  @return NULL if every seek finds the same game, what is wrong if not
+ */
+static const char *check_seeks(const uint8_t *map, size_t size,
+    uint32_t total){
+    uint32_t targets[SEEKS_MAX];
+    replay_reader_t ref, r;
+    mem_src_t ref_src, src;
+    game_t g, at;
+    uint32_t rng;
+    int n = seeks, i, seeked, next = 0, dir;
+
+    ref_src.start = ref_src.p = map;
+    ref_src.end = map + size;
+    if(replay_read_begin(&ref, mem_read, &ref_src) != 0)
+        return "header";
+    rng = ref.header.seed ^ 0x5eed;
+    for(i = 0; i < n - 1; i++)
+        targets[i] = engine_rng_below(&rng, total + 1);
+    targets[n - 1] = total;
+    qsort(targets, (size_t)n, sizeof(targets[0]), compare_u32);
+
+    replay_start(&g, &ref.header);
+    i = 0;
+    while(1){
+        seeked = 0;
+        while(i < n && targets[i] == ref.moves){
+            src.start = src.p = map;
+            src.end = map + size;
+            if(replay_read_begin(&r, mem_read, &src) != 0 ||
+                replay_seek(&r, mem_seek, &at, targets[i]) != 0)
+                return "seek failed";
+            if(memcmp(at.board, g.board, sizeof(g.board)) != 0)
+                return "seek board";
+            if(at.score != g.score || at.rng != g.rng)
+                return "seek score or generator";
+            next = replay_read_move(&r);
+            seeked = 1;
+            i++;
+        }
+        dir = replay_read_move(&ref);
+        if(seeked && next != dir)
+            return "seek next move";
+        if(dir < 0)
+            return i == n ? NULL : "seek past the end";
+        engine_step(&g, dir);
+    }
+}
+
+/** @brief Map one replay and check it
+ *
+ *  @return NULL if it is consistent, what is wrong if not
+ */
+static const char *verify(const char *path, worker_t *w){
+    replay_reader_t r;
+    mem_src_t src;
+    struct stat st;
+    const char *why;
+    uint32_t moves = 0;
+    void *map;
+    int fd, ret;
+
+    if((fd = open(path, O_RDONLY)) < 0)
+        return "cannot open";
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+        close(fd);
+        return "empty";
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return "cannot map";
+    madvise(map, (size_t)st.st_size, MADV_WILLNEED);
+    src.start = src.p = map;
+    src.end = src.p + st.st_size;
+    if((ret = replay_read_begin(&r, mem_read, &src)) != 0)
+        why = error_name(ret);
+    else if(use_engine)
+        why = play_engine(&r, &moves);
+    else
+        why = play_packed(&r, &moves);
+    if(why == NULL && seeks > 0)
+        why = check_seeks(map, (size_t)st.st_size, moves);
+    munmap(map, (size_t)st.st_size);
+    w->bytes += (uint64_t)st.st_size;
+    w->moves += moves;
+    return why;
+}
+
+static void *worker(void *arg){
+    worker_t *w = arg;
+    size_t i;
+    const char *why;
+
+    while((i = __atomic_fetch_add(&next_path, 1, __ATOMIC_RELAXED)) <
+        path_num){
+        w->files++;
+        if((why = verify(paths[i], w)) != NULL){
+            w->bad++;
+            fprintf(stderr, "%s: %s\n", paths[i], why);
+        }
+    }
+    return NULL;
+}
+
+static void add_path(const char *path){
+    if(path_num == path_cap){
+        path_cap = path_cap ? path_cap * 2 : 1024;
+        paths = realloc(paths, path_cap * sizeof(*paths));
+        if(paths == NULL){
+            perror("replayverify");
+            exit(1);
+        }
+    }
+    paths[path_num++] = strdup(path);
+}
+
+/** @brief List a file, or every file under a directory
+ *
+ *  @return void
+ */
+static void collect(const char *path){
+    struct dirent *de;
+    struct stat st;
+    char sub[4096];
+    DIR *dir;
+
+    if(stat(path, &st) != 0){
+        perror(path);
+        return;
+    }
+    if(!S_ISDIR(st.st_mode)){
+        add_path(path);
+        return;
+    }
+    if((dir = opendir(path)) == NULL){
+        perror(path);
+        return;
+    }
+    while((de = readdir(dir)) != NULL){
+        if(de->d_name[0] == '.')
+            continue;
+        snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name);
+        collect(sub);
+    }
+    closedir(dir);
+}
+
+int main(int argc, char **argv){
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t files = 0, bad = 0, bytes = 0, moves = 0;
+    struct timespec t0, t1;
+    worker_t *w;
+    double secs;
+    int opt, i;
+
+    while((opt = getopt(argc, argv, "t:ek:")) != -1){
+        switch(opt){
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'e':
+                use_engine = 1;
+                break;
+            case 'k':
+                seeks = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: replayverify [-t THREADS] [-e] "
+                    "[-k SEEKS] PATH...\n");
+                return 2;
+        }
+    }
+    if(seeks < 0 || seeks > SEEKS_MAX){
+        fprintf(stderr, "replayverify: -k takes 0 to %d\n", SEEKS_MAX);
+        return 2;
+    }
+    if(threads < 1)
+        threads = 1;
+    bb_init();
+    for(i = optind; i < argc; i++)
+        collect(argv[i]);
+
+    w = calloc((size_t)threads, sizeof(*w));
+    if(w == NULL){
+        perror("replayverify");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(i = 0; i < threads; i++)
+        pthread_create(&w[i].tid, NULL, worker, &w[i]);
+    for(i = 0; i < threads; i++){
+        pthread_join(w[i].tid, NULL);
+        files += w[i].files;
+        bad += w[i].bad;
+        bytes += w[i].bytes;
+        moves += w[i].moves;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if(secs <= 0)
+        secs = 1e-9;
+
+    printf("replays      %llu checked, %llu bad, %d threads\n",
+        (unsigned long long)files, (unsigned long long)bad, threads);
+    printf("throughput   %.0f replays/s, %.0f moves/s, %.1f MB/s\n",
+        files / secs, moves / secs, bytes / secs / 1e6);
+    printf("total        %llu moves, %llu bytes in %.3fs\n",
+        (unsigned long long)moves, (unsigned long long)bytes, secs);
+    for(i = 0; i < (int)path_num; i++)
+        free(paths[i]);
+    free(paths);
+    free(w);
+    return bad ? 1 : 0;
+}
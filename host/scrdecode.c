@@ -0,0 +1,396 @@
+/** @file scrdecode.c
+ *
+ *  @brief Decode a screen capture (capture.h) from a COM1 log into text,
+ *         colored text or a PNG.
+ *
+ *  Lines other than the capture's own are skipped, so the whole log can
+ *  be given; with several captures in it, -n picks one (0 is the first,
+ *  the last by default). Every capture is checked against its CRC. The
+ *  plain text is the characters only, one line per row without trailing
+ *  blanks, to be compared with a golden copy; -a adds ANSI colors. The
+ *  PNG uses the 16 VGA colors and a 5x7 font at twice its size, and is
+ *  written without compression, so no library is needed.
+ *
+ *  scrdecode [-n INDEX] [-a | -p PNG] [LOG]
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug Characters outside of printable ASCII are drawn as blanks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "replay.h"
+#include "capture.h"
+
+/* Pixels of a cell in the PNG, the glyph is drawn at SCALE */
+#define CELL_W 12
+#define CELL_H 18
+#define SCALE  2
+
+/* Largest stored deflate block */
+#define STORED_MAX 65535
+
+typedef struct
+{
+    int rows;
+    int cols;
+    uint32_t bytes;
+    uint32_t crc;
+    uint8_t *data;          /* encoded bytes */
+    uint32_t len;
+}capture_t;
+
+/* VGA text colors, RGB */
+static const uint8_t palette[16][3] = {
+    { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0xaa }, { 0x00, 0xaa, 0x00 },
+    { 0x00, 0xaa, 0xaa }, { 0xaa, 0x00, 0x00 }, { 0xaa, 0x00, 0xaa },
+    { 0xaa, 0x55, 0x00 }, { 0xaa, 0xaa, 0xaa }, { 0x55, 0x55, 0x55 },
+    { 0x55, 0x55, 0xff }, { 0x55, 0xff, 0x55 }, { 0x55, 0xff, 0xff },
+    { 0xff, 0x55, 0x55 }, { 0xff, 0x55, 0xff }, { 0xff, 0xff, 0x55 },
+    { 0xff, 0xff, 0xff },
+};
+
+/* VGA color to ANSI color */
+static const int ansi[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+/* 5x7 font from ' ' to '~', one byte per column, bit 0 at the top */
+static const uint8_t font[95][5] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5f,0x00,0x00},
+    {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7f,0x14,0x7f,0x14},
+    {0x24,0x2a,0x7f,0x2a,0x12}, {0x23,0x13,0x08,0x64,0x62},
+    {0x36,0x49,0x56,0x20,0x50}, {0x00,0x08,0x07,0x03,0x00},
+    {0x00,0x1c,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1c,0x00},
+    {0x2a,0x1c,0x7f,0x1c,0x2a}, {0x08,0x08,0x3e,0x08,0x08},
+    {0x00,0x80,0x70,0x30,0x00}, {0x08,0x08,0x08,0x08,0x08},
+    {0x00,0x00,0x60,0x60,0x00}, {0x20,0x10,0x08,0x04,0x02},
+    {0x3e,0x51,0x49,0x45,0x3e}, {0x00,0x42,0x7f,0x40,0x00},
+    {0x72,0x49,0x49,0x49,0x46}, {0x21,0x41,0x49,0x4d,0x33},
+    {0x18,0x14,0x12,0x7f,0x10}, {0x27,0x45,0x45,0x45,0x39},
+    {0x3c,0x4a,0x49,0x49,0x31}, {0x41,0x21,0x11,0x09,0x07},
+    {0x36,0x49,0x49,0x49,0x36}, {0x46,0x49,0x49,0x29,0x1e},
+    {0x00,0x00,0x14,0x00,0x00}, {0x00,0x40,0x34,0x00,0x00},
+    {0x00,0x08,0x14,0x22,0x41}, {0x14,0x14,0x14,0x14,0x14},
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x59,0x09,0x06},
+    {0x3e,0x41,0x5d,0x59,0x4e}, {0x7c,0x12,0x11,0x12,0x7c},
+    {0x7f,0x49,0x49,0x49,0x36}, {0x3e,0x41,0x41,0x41,0x22},
+    {0x7f,0x41,0x41,0x41,0x3e}, {0x7f,0x49,0x49,0x49,0x41},
+    {0x7f,0x09,0x09,0x09,0x01}, {0x3e,0x41,0x41,0x51,0x73},
+    {0x7f,0x08,0x08,0x08,0x7f}, {0x00,0x41,0x7f,0x41,0x00},
+    {0x20,0x40,0x41,0x3f,0x01}, {0x7f,0x08,0x14,0x22,0x41},
+    {0x7f,0x40,0x40,0x40,0x40}, {0x7f,0x02,0x1c,0x02,0x7f},
+    {0x7f,0x04,0x08,0x10,0x7f}, {0x3e,0x41,0x41,0x41,0x3e},
+    {0x7f,0x09,0x09,0x09,0x06}, {0x3e,0x41,0x51,0x21,0x5e},
+    {0x7f,0x09,0x19,0x29,0x46}, {0x26,0x49,0x49,0x49,0x32},
+    {0x03,0x01,0x7f,0x01,0x03}, {0x3f,0x40,0x40,0x40,0x3f},
+    {0x1f,0x20,0x40,0x20,0x1f}, {0x3f,0x40,0x38,0x40,0x3f},
+    {0x63,0x14,0x08,0x14,0x63}, {0x03,0x04,0x78,0x04,0x03},
+    {0x61,0x59,0x49,0x4d,0x43}, {0x00,0x7f,0x41,0x41,0x41},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x41,0x7f},
+    {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+    {0x00,0x03,0x07,0x08,0x00}, {0x20,0x54,0x54,0x78,0x40},
+    {0x7f,0x28,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x28},
+    {0x38,0x44,0x44,0x28,0x7f}, {0x38,0x54,0x54,0x54,0x18},
+    {0x00,0x08,0x7e,0x09,0x02}, {0x18,0xa4,0xa4,0x9c,0x78},
+    {0x7f,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7d,0x40,0x00},
+    {0x20,0x40,0x40,0x3d,0x00}, {0x7f,0x10,0x28,0x44,0x00},
+    {0x00,0x41,0x7f,0x40,0x00}, {0x7c,0x04,0x78,0x04,0x78},
+    {0x7c,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+    {0xfc,0x18,0x24,0x24,0x18}, {0x18,0x24,0x24,0x18,0xfc},
+    {0x7c,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x24},
+    {0x04,0x04,0x3f,0x44,0x24}, {0x3c,0x40,0x40,0x20,0x7c},
+    {0x1c,0x20,0x40,0x20,0x1c}, {0x3c,0x40,0x30,0x40,0x3c},
+    {0x44,0x28,0x10,0x28,0x44}, {0x4c,0x90,0x90,0x90,0x7c},
+    {0x44,0x64,0x54,0x4c,0x44}, {0x00,0x08,0x36,0x41,0x00},
+    {0x00,0x00,0x77,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00},
+    {0x02,0x01,0x02,0x04,0x02},
+};
+
+/** @brief Decode a capture into rows * cols cells, char and attribute
+ *
+ *  @return 0 on success, -1 if the bytes do not give exactly the cells
+ */
+static int decode(const capture_t *c, uint8_t *cells){
+    uint32_t total = (uint32_t)c->rows * c->cols * 2, n = 0, i = 0, k;
+    uint32_t count;
+    uint8_t op;
+
+    while(i < c->len){
+        op = c->data[i++];
+        if(op >= CAPTURE_RUN){
+            count = op - CAPTURE_RUN + CAPTURE_RUN_MIN;
+            if(i + 2 > c->len || n + count * 2 > total)
+                return -1;
+            for(k = 0; k < count; k++, n += 2)
+                memcpy(cells + n, c->data + i, 2);
+            i += 2;
+        }else{
+            count = (uint32_t)op + 1;
+            if(i + count * 2 > c->len || n + count * 2 > total)
+                return -1;
+            memcpy(cells + n, c->data + i, count * 2);
+            i += count * 2;
+            n += count * 2;
+        }
+    }
+    return n == total ? 0 : -1;
+}
+
+static void print_text(const capture_t *c, const uint8_t *cells, int color){
+    int row, col, end, ch, attr, last = -1;
+
+    for(row = 0; row < c->rows; row++){
+        const uint8_t *p = cells + (size_t)row * c->cols * 2;
+        /* Trailing blanks only go when there are no colors to keep */
+        for(end = c->cols; !color && end > 0 && (p[(end - 1) * 2] == ' ' ||
+            p[(end - 1) * 2] == 0); end--)
+            continue;
+        for(col = 0; col < end; col++){
+            ch = p[col * 2];
+            attr = p[col * 2 + 1];
+            if(color && attr != last){
+                printf("\033[0;%s%d;%d%dm", attr & 8 ? "1;" : "",
+                    30 + ansi[attr & 7], attr & 0x80 ? 10 : 4,
+                    ansi[(attr >> 4) & 7]);
+                last = attr;
+            }
+            putchar(ch >= 0x20 && ch < 0x7f ? ch : ' ');
+        }
+        if(color){
+            printf("\033[0m");
+            last = -1;
+        }
+        putchar('\n');
+    }
+}
+
+static void put32(uint8_t *p, uint32_t v){
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/** @brief Write one PNG chunk
+ *
+ *  @return void
+ */
+static void put_chunk(FILE *f, const char *type, const uint8_t *data,
+    uint32_t len){
+    uint8_t word[4];
+    uint32_t crc;
+
+    put32(word, len);
+    fwrite(word, 1, 4, f);
+    fwrite(type, 1, 4, f);
+    fwrite(data, 1, len, f);
+    crc = replay_crc32(0, type, 4);
+    crc = replay_crc32(crc, data, len);
+    put32(word, crc);
+    fwrite(word, 1, 4, f);
+}
+
+/** @brief Draw the cells and write them as a palette PNG
+ *
+ *  @return 0 on success, -1 on error
+ */
+static int write_png(const char *path, const capture_t *c,
+    const uint8_t *cells){
+    static const uint8_t magic[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+        '\n' };
+    uint32_t w = (uint32_t)c->cols * CELL_W, h = (uint32_t)c->rows * CELL_H;
+    uint32_t line = w + 1, raw_len = line * h, z_len, a = 1, b = 0, i, n;
+    uint8_t *raw, *z, *p, ihdr[13], plte[16 * 3];
+    int row, col, x, y, ch, attr, bits;
+    FILE *f;
+
+    raw = calloc(raw_len, 1);
+    z_len = 2 + raw_len + (raw_len / STORED_MAX + 1) * 5 + 4;
+    z = malloc(z_len);
+    if(raw == NULL || z == NULL){
+        perror("scrdecode");
+        return -1;
+    }
+    /* Every scanline starts with filter 0, none */
+    for(row = 0; row < c->rows; row++){
+        for(col = 0; col < c->cols; col++){
+            ch = cells[((size_t)row * c->cols + col) * 2];
+            attr = cells[((size_t)row * c->cols + col) * 2 + 1];
+            for(y = 0; y < CELL_H; y++){
+                p = raw + (row * CELL_H + y) * line + 1 + col * CELL_W;
+                for(x = 0; x < CELL_W; x++)
+                    p[x] = (uint8_t)((attr >> 4) & 0xf);
+                if(ch < 0x20 || ch >= 0x7f)
+                    continue;
+                /* Glyph rows 0 to 7, one pixel of margin */
+                if(y < 1 || (y - 1) / SCALE >= 8)
+                    continue;
+                for(x = 0; x < 5 * SCALE; x++){
+                    bits = font[ch - 0x20][x / SCALE];
+                    if(bits & (1 << ((y - 1) / SCALE)))
+                        p[1 + x] = (uint8_t)(attr & 0xf);
+                }
+            }
+        }
+    }
+
+    /* zlib stream of stored blocks */
+    p = z;
+    *p++ = 0x78;
+    *p++ = 0x01;
+    for(i = 0; i < raw_len; i += n){
+        n = raw_len - i < STORED_MAX ? raw_len - i : STORED_MAX;
+        *p++ = i + n == raw_len;
+        *p++ = (uint8_t)n;
+        *p++ = (uint8_t)(n >> 8);
+        *p++ = (uint8_t)~n;
+        *p++ = (uint8_t)(~n >> 8);
+        memcpy(p, raw + i, n);
+        p += n;
+    }
+    for(i = 0; i < raw_len; i++){
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(p, b << 16 | a);
+    p += 4;
+
+    put32(ihdr, w);
+    put32(ihdr + 4, h);
+    ihdr[8] = 8;            /* bits per index */
+    ihdr[9] = 3;            /* palette */
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    memcpy(plte, palette, sizeof(plte));
+
+    if((f = fopen(path, "wb")) == NULL){
+        perror(path);
+        free(raw);
+        free(z);
+        return -1;
+    }
+    fwrite(magic, 1, sizeof(magic), f);
+    put_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    put_chunk(f, "PLTE", plte, sizeof(plte));
+    put_chunk(f, "IDAT", z, (uint32_t)(p - z));
+    put_chunk(f, "IEND", NULL, 0);
+    free(raw);
+    free(z);
+    if(fclose(f) != 0){
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief Add the bytes of a "scr HEX" line to a capture
+ *
+ *  @return 0 on success, -1 on a bad line or too many bytes
+ */
+static int add_hex(capture_t *c, const char *hex){
+    unsigned int byte;
+
+    while(hex[0] && hex[0] != '\r' && hex[0] != '\n'){
+        if(sscanf(hex, "%2x", &byte) != 1 || c->len >= c->bytes)
+            return -1;
+        c->data[c->len++] = (uint8_t)byte;
+        hex += 2;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv){
+    const char *png = NULL;
+    char line[512];
+    capture_t cur, keep;
+    uint8_t *cells;
+    long index = -1, seen = 0;
+    int opt, color = 0, in = 0, bad = 0, ret = 0;
+    FILE *f = stdin;
+
+    memset(&keep, 0, sizeof(keep));
+    memset(&cur, 0, sizeof(cur));
+    while((opt = getopt(argc, argv, "n:ap:")) != -1){
+        switch(opt){
+            case 'n':
+                index = atol(optarg);
+                break;
+            case 'a':
+                color = 1;
+                break;
+            case 'p':
+                png = optarg;
+                break;
+            default:
+                goto usage;
+        }
+    }
+    if(optind + 1 < argc)
+        goto usage;
+    if(optind < argc && (f = fopen(argv[optind], "r")) == NULL){
+        perror(argv[optind]);
+        return 1;
+    }
+
+    while(fgets(line, sizeof(line), f) != NULL){
+        if(sscanf(line, "scr=begin rows=%d cols=%d bytes=%u crc=%x",
+            &cur.rows, &cur.cols, &cur.bytes, &cur.crc) == 4){
+            free(cur.data);
+            cur.len = 0;
+            bad = cur.rows <= 0 || cur.cols <= 0 ||
+                (cur.data = malloc(cur.bytes + 1)) == NULL;
+            in = 1;
+        }else if(in && strncmp(line, "scr ", 4) == 0){
+            bad |= add_hex(&cur, line + 4) != 0;
+        }else if(in && strncmp(line, "scr=end", 7) == 0){
+            in = 0;
+            if(bad || cur.len != cur.bytes){
+                fprintf(stderr, "scrdecode: capture %ld is cut short, "
+                    "skipped\n", seen);
+            }else if(index < 0 || seen == index){
+                free(keep.data);
+                keep = cur;
+                cur.data = NULL;
+            }
+            seen++;
+        }
+    }
+    if(f != stdin)
+        fclose(f);
+    free(cur.data);
+    if(keep.data == NULL){
+        fprintf(stderr, "scrdecode: no capture%s\n", index >= 0 ?
+            " with that index" : "");
+        return 1;
+    }
+
+    cells = malloc((size_t)keep.rows * keep.cols * 2);
+    if(cells == NULL){
+        perror("scrdecode");
+        return 1;
+    }
+    if(decode(&keep, cells) != 0){
+        fprintf(stderr, "scrdecode: the bytes do not make %dx%d cells\n",
+            keep.rows, keep.cols);
+        ret = 1;
+    }else if(replay_crc32(0, cells, (uint32_t)keep.rows * keep.cols * 2) !=
+        keep.crc){
+        fprintf(stderr, "scrdecode: CRC mismatch\n");
+        ret = 1;
+    }else if(png != NULL){
+        ret = write_png(png, &keep, cells) != 0;
+    }else{
+        print_text(&keep, cells, color);
+    }
+    free(cells);
+    free(keep.data);
+    return ret;
+
+usage:
+    fprintf(stderr, "usage: scrdecode [-n INDEX] [-a | -p PNG] [LOG]\n");
+    return 2;
+}
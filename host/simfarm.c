@@ -0,0 +1,490 @@
+/** @file simfarm.c
+ *
+ *  @brief Monte Carlo simulation farm: many games, one policy, all cores.
+ *
+ *  Every thread owns its games, its random stream and its statistics,
+ *  so nothing is locked while games run. The main thread peeks at the
+ *  per-thread histograms once per interval for a streaming report and
+ *  merges them when all threads are done.
+ *
+ *  Games run on the packed board (bitboard.c) with bb_add_random(), which
+ *  draws the same numbers as the engine, so the game with seed s here is
+ *  the game with seed s in the kernel. With -r every game is also written
+ *  to DIR as a replay (replay.h), with -o every move goes to training
+ *  shards in DIR (dataset.h).
+ *
+ *  simfarm [-n GAMES] [-t THREADS] [-p random|greedy|corner|expectimax]
+ *          [-d DEPTH] [-s SEED] [-i SECONDS] [-r DIR] [-o DIR]
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include "engine.h"
+#include "bitboard.h"
+#include "ai.h"
+#include "replay.h"
+#include "dataset.h"
+
+#define TT_BITS 18
+/* Target scores of the kernel's five modes */
+#define MODE_NUM 5
+static const int modes[MODE_NUM] = { 128, 256, 512, 1024, 2048 };
+
+/*******************************************************
+ * Log-linear histogram, mergeable, for streaming quantiles
+ *
+ * Values below 2^SUB_BITS have one bucket each, larger ones share
+ * 2^SUB_BITS buckets per power of two (under 1.6% error).
+ *******************************************************/
+#define SUB_BITS 6
+#define SUB_NUM (1 << SUB_BITS)
+#define HIST_NUM ((64 - SUB_BITS + 1) * SUB_NUM)
+
+typedef struct
+{
+    uint64_t count[HIST_NUM];
+    uint64_t total;
+    uint64_t max;
+}hist_t;
+
+static int hist_bucket(uint64_t v){
+    int e;
+    if(v < SUB_NUM)
+        return (int)v;
+    e = 63 - __builtin_clzll(v);
+    return (e - SUB_BITS + 1) * SUB_NUM + (int)((v >> (e - SUB_BITS)) & (SUB_NUM - 1));
+}
+
+/* Lowest value of a bucket */
+static uint64_t hist_value(int b){
+    int e;
+    if(b < SUB_NUM)
+        return (uint64_t)b;
+    e = b / SUB_NUM + SUB_BITS - 1;
+    return (1ULL << e) | ((uint64_t)(b % SUB_NUM) << (e - SUB_BITS));
+}
+
+/* Only the owning thread writes, readers may look at any time */
+static void hist_add(hist_t *h, uint64_t v){
+    int b = hist_bucket(v);
+    __atomic_store_n(&h->count[b], h->count[b] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->total, h->total + 1, __ATOMIC_RELAXED);
+    if(v > h->max)
+        __atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+}
+
+static void hist_merge(hist_t *dst, const hist_t *src){
+    int b;
+    for(b = 0; b < HIST_NUM; b++)
+        dst->count[b] += __atomic_load_n(&src->count[b], __ATOMIC_RELAXED);
+    dst->total += __atomic_load_n(&src->total, __ATOMIC_RELAXED);
+    if(src->max > dst->max)
+        dst->max = src->max;
+}
+
+static uint64_t hist_quantile(const hist_t *h, double q){
+    uint64_t rank = (uint64_t)(q * (h->total ? h->total - 1 : 0));
+    uint64_t seen = 0;
+    int b;
+    for(b = 0; b < HIST_NUM; b++){
+        seen += h->count[b];
+        if(seen > rank)
+            return hist_value(b);
+    }
+    return h->max;
+}
+
+/*******************************************************
+ * Per-thread state
+ *******************************************************/
+
+typedef struct
+{
+    hist_t score;
+    hist_t length;
+    uint64_t max_tile[16];
+    uint64_t wins[MODE_NUM];
+    uint64_t games;
+    uint64_t moves;
+    uint64_t score_sum;
+}stats_t;
+
+typedef struct
+{
+    pthread_t tid;
+    uint64_t rng;               /* splitmix64 stream of game seeds */
+    uint32_t policy_rng;        /* moves of the random policy */
+    int id;
+    uint64_t games;             /* games to play */
+    ai_ctx_t ai;
+    ai_tt_entry_t *tt;
+    dataset_rec_t *recs;        /* moves of the current game */
+    size_t rec_cap;
+    stats_t st;
+} __attribute__((aligned(64))) worker_t;
+
+static int policy = 0;
+static int depth = 2;
+static const char *replay_dir = NULL;
+static uint64_t farm_seed = 1;
+static dataset_t dataset;
+static int export = 0;
+
+#define POLICY_RANDOM     0
+#define POLICY_GREEDY     1
+#define POLICY_CORNER     2
+#define POLICY_EXPECTIMAX 3
+static const char *policy_names[] = { "random", "greedy", "corner",
+    "expectimax" };
+
+static uint64_t splitmix(uint64_t *s){
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/** @brief Pick a move with the selected policy
+ *
+ *  @return MOVE_*, -1 when no move is possible
+ */
+static int choose(worker_t *w, bboard_t b){
+    /* Corner: keep the big numbers in the up-left corner */
+    static const int corner_order[MOVE_NUM] = { MOVE_UP, MOVE_LEFT,
+        MOVE_RIGHT, MOVE_DOWN };
+    int legal[MOVE_NUM], n = 0;
+    int dir, best = -1;
+    int64_t best_v = -1;
+
+    if(policy == POLICY_EXPECTIMAX)
+        return ai_search(&w->ai, b, depth, 0);
+    for(dir = 0; dir < MOVE_NUM; dir++){
+        if(bb_move(b, dir, NULL) != b)
+            legal[n++] = dir;
+    }
+    if(n == 0)
+        return -1;
+    switch(policy){
+        case POLICY_RANDOM:
+            return legal[engine_rng_below(&w->policy_rng,
+                (uint32_t)n)];
+        case POLICY_GREEDY:
+            /* Most points now, then most empty blocks */
+            for(dir = 0; dir < n; dir++){
+                uint32_t s = 0;
+                bboard_t nb = bb_move(b, legal[dir], &s);
+                int64_t v = (int64_t)s * 32 + bb_count_empty(nb);
+                if(v > best_v){
+                    best_v = v;
+                    best = legal[dir];
+                }
+            }
+            return best;
+        default:
+            for(dir = 0; dir < MOVE_NUM; dir++){
+                if(bb_move(b, corner_order[dir], NULL) != b)
+                    return corner_order[dir];
+            }
+            return -1;
+    }
+}
+
+static int write_file(void *ctx, const void *buf, uint32_t len){
+    return fwrite(buf, 1, len, ctx) == len ? 0 : -1;
+}
+
+/** @brief Open the replay of a game in replay_dir and write its header
+ *
+ *  @return the file, NULL on error
+ */
+static FILE *replay_open(worker_t *w, uint64_t g, uint32_t seed,
+    replay_writer_t *rw){
+    /* Games go on past every tile, so the replay has no target */
+    replay_header_t h = { REPLAY_VERSION, REPLAY_RULES_CLASSIC,
+        ENGINE_NO_TARGET, seed };
+    char path[4096];
+    FILE *f;
+    snprintf(path, sizeof(path), "%s/s%llu-t%03d-%08llu.rpl", replay_dir,
+        (unsigned long long)farm_seed, w->id, (unsigned long long)g);
+    if((f = fopen(path, "wb")) == NULL){
+        perror(path);
+        return NULL;
+    }
+    replay_write_begin(rw, write_file, f, &h);
+    return f;
+}
+
+/** @brief Keep a move of the current game for the dataset
+ *
+ *  @return void
+ */
+static void record(worker_t *w, size_t n, bboard_t b, int dir,
+    uint32_t reward){
+    dataset_rec_t *r;
+    int d;
+    if(n == w->rec_cap){
+        w->rec_cap = w->rec_cap ? w->rec_cap * 2 : 4096;
+        w->recs = realloc(w->recs, w->rec_cap * sizeof(*w->recs));
+        if(w->recs == NULL){
+            perror("simfarm");
+            exit(1);
+        }
+    }
+    r = &w->recs[n];
+    r->board = b;
+    r->legal = 0;
+    for(d = 0; d < MOVE_NUM; d++){
+        if(bb_move(b, d, NULL) != b)
+            r->legal |= (uint8_t)(1 << d);
+    }
+    r->move = (uint8_t)dir;
+    r->reward = reward;
+}
+
+static void *worker(void *arg){
+    worker_t *w = arg;
+    replay_writer_t rw;
+    uint64_t g;
+
+    if(policy == POLICY_EXPECTIMAX)
+        ai_init(&w->ai, w->tt, TT_BITS);
+    for(g = 0; g < w->games; g++){
+        uint32_t rng = (uint32_t)splitmix(&w->rng) | 1;
+        FILE *f = replay_dir ? replay_open(w, g, rng, &rw) : NULL;
+        bboard_t b = bb_add_random(bb_add_random(0, &rng), &rng);
+        uint32_t score = 0, moves = 0;
+        int dir, top, m;
+
+        while((dir = choose(w, b)) >= 0){
+            bboard_t before = b;
+            uint32_t last = score;
+            if(f != NULL)
+                replay_write_packed(&rw, b, score, rng, dir);
+            b = bb_add_random(bb_move(b, dir, &score), &rng);
+            if(export)
+                record(w, moves, before, dir, score - last);
+            moves++;
+        }
+        if(export){
+            /* The final score is known now, the game goes out whole */
+            for(m = 0; m < (int)moves; m++)
+                w->recs[m].final_score = score;
+            if(dataset_append(&dataset, w->recs, moves) != 0){
+                perror("simfarm: dataset");
+                exit(1);
+            }
+        }
+        if(f != NULL){
+            replay_write_end_packed(&rw, b, score);
+            fclose(f);
+        }
+        top = bb_max_tile(b);
+        hist_add(&w->st.score, score);
+        hist_add(&w->st.length, moves);
+        __atomic_store_n(&w->st.max_tile[top], w->st.max_tile[top] + 1,
+            __ATOMIC_RELAXED);
+        for(m = 0; m < MODE_NUM; m++){
+            if((1 << top) >= modes[m])
+                __atomic_store_n(&w->st.wins[m], w->st.wins[m] + 1,
+                    __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&w->st.score_sum, w->st.score_sum + score,
+            __ATOMIC_RELAXED);
+        __atomic_store_n(&w->st.moves, w->st.moves + moves,
+            __ATOMIC_RELAXED);
+        __atomic_store_n(&w->st.games, w->st.games + 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/** @brief Merge the statistics of all threads
+ *
+ *  Safe while the threads run, the result is then a recent snapshot.
+ *
+ *  @return void
+ */
+static void merge(stats_t *all, worker_t *w, int threads){
+    int i, k;
+    memset(all, 0, sizeof(*all));
+    for(i = 0; i < threads; i++){
+        const stats_t *st = &w[i].st;
+        hist_merge(&all->score, &st->score);
+        hist_merge(&all->length, &st->length);
+        for(k = 0; k < 16; k++)
+            all->max_tile[k] += __atomic_load_n(&st->max_tile[k],
+                __ATOMIC_RELAXED);
+        for(k = 0; k < MODE_NUM; k++)
+            all->wins[k] += __atomic_load_n(&st->wins[k], __ATOMIC_RELAXED);
+        all->games += __atomic_load_n(&st->games, __ATOMIC_RELAXED);
+        all->moves += __atomic_load_n(&st->moves, __ATOMIC_RELAXED);
+        all->score_sum += __atomic_load_n(&st->score_sum, __ATOMIC_RELAXED);
+    }
+}
+
+static double seconds_since(const struct timespec *t0){
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void print_progress(const stats_t *s, double secs){
+    printf("[%7.1fs] games %llu (%.0f/s) moves/s %.0f score p50 %llu "
+        "p90 %llu p99 %llu\n", secs, (unsigned long long)s->games,
+        s->games / secs, s->moves / secs,
+        (unsigned long long)hist_quantile(&s->score, 0.5),
+        (unsigned long long)hist_quantile(&s->score, 0.9),
+        (unsigned long long)hist_quantile(&s->score, 0.99));
+    fflush(stdout);
+}
+
+static void print_final(const stats_t *s, double secs){
+    int k;
+    printf("policy       %s", policy_names[policy]);
+    if(policy == POLICY_EXPECTIMAX)
+        printf(" depth %d", depth);
+    printf("\ngames        %llu in %.2fs, %.0f games/s, %.0f moves/s\n",
+        (unsigned long long)s->games, secs, s->games / secs,
+        s->moves / secs);
+    if(s->games == 0)
+        return;
+    printf("score        mean %.0f p50 %llu p90 %llu p99 %llu max %llu\n",
+        (double)s->score_sum / s->games,
+        (unsigned long long)hist_quantile(&s->score, 0.5),
+        (unsigned long long)hist_quantile(&s->score, 0.9),
+        (unsigned long long)hist_quantile(&s->score, 0.99),
+        (unsigned long long)s->score.max);
+    printf("length       mean %.0f p50 %llu p99 %llu max %llu\n",
+        (double)s->moves / s->games,
+        (unsigned long long)hist_quantile(&s->length, 0.5),
+        (unsigned long long)hist_quantile(&s->length, 0.99),
+        (unsigned long long)s->length.max);
+    for(k = 0; k < MODE_NUM; k++)
+        printf("win %-4d     %.2f%%\n", modes[k],
+            100.0 * s->wins[k] / s->games);
+    for(k = 1; k < 16; k++){
+        if(s->max_tile[k])
+            printf("max tile %-5d %.2f%%\n", 1 << k,
+                100.0 * s->max_tile[k] / s->games);
+    }
+}
+
+int main(int argc, char **argv){
+    uint64_t games = 100000;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int interval = 1;
+    worker_t *w;
+    stats_t all;
+    struct timespec t0;
+    double next;
+    int opt, i, k, running;
+
+    while((opt = getopt(argc, argv, "n:t:p:d:s:i:r:o:")) != -1){
+        switch(opt){
+            case 'n':
+                games = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'p':
+                for(k = 0; k < 4; k++){
+                    if(strcmp(optarg, policy_names[k]) == 0)
+                        break;
+                }
+                if(k == 4){
+                    fprintf(stderr, "simfarm: unknown policy %s\n", optarg);
+                    return 2;
+                }
+                policy = k;
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 's':
+                farm_seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            case 'r':
+                replay_dir = optarg;
+                break;
+            case 'o':
+                if(dataset_open(&dataset, optarg, 0) != 0){
+                    perror(optarg);
+                    return 1;
+                }
+                export = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: simfarm [-n GAMES] [-t THREADS] "
+                    "[-p random|greedy|corner|expectimax] [-d DEPTH] "
+                    "[-s SEED] [-i SECONDS] [-r DIR] [-o DIR]\n");
+                return 2;
+        }
+    }
+    if(threads < 1)
+        threads = 1;
+    if(interval < 1)
+        interval = 1;
+    bb_init();
+
+    w = aligned_alloc(64, sizeof(*w) * (size_t)threads);
+    if(w == NULL){
+        perror("simfarm");
+        return 1;
+    }
+    memset(w, 0, sizeof(*w) * (size_t)threads);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(i = 0; i < threads; i++){
+        w[i].rng = farm_seed * 0x100000001B3ULL + (uint64_t)i;
+        w[i].policy_rng = (uint32_t)splitmix(&w[i].rng) | 1;
+        w[i].id = i;
+        w[i].games = games / threads + ((uint64_t)i < games % threads);
+        if(policy == POLICY_EXPECTIMAX){
+            w[i].tt = malloc(sizeof(ai_tt_entry_t) << TT_BITS);
+            if(w[i].tt == NULL){
+                perror("simfarm");
+                return 1;
+            }
+        }
+        pthread_create(&w[i].tid, NULL, worker, &w[i]);
+    }
+
+    /* Streaming report, reading the threads' statistics without locks */
+    next = interval;
+    do{
+        usleep(10000);
+        merge(&all, w, threads);
+        running = all.games < games;
+        if(running && seconds_since(&t0) >= next){
+            print_progress(&all, seconds_since(&t0));
+            next += interval;
+        }
+    }while(running);
+
+    for(i = 0; i < threads; i++){
+        pthread_join(w[i].tid, NULL);
+        free(w[i].tt);
+        free(w[i].recs);
+    }
+    if(export){
+        if(dataset_close(&dataset) != 0)
+            perror("simfarm: dataset");
+        printf("dataset      %llu records in %u shards\n",
+            (unsigned long long)dataset.records, dataset.shards);
+    }
+    merge(&all, w, threads);
+    print_final(&all, seconds_since(&t0));
+    free(w);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/** @file symbolize.c
+ *
+ *  @brief Turn a kernel profile dump (prof.h) into samples per function.
+ *
+ *  The symbols come from "nm -n" of the kernel ELF, run here, or from a
+ *  file of its output with -s. The dump is read from a file or stdin;
+ *  anything around the prof lines, such as the rest of the COM1 log, is
+ *  skipped. Functions are listed by samples, most first, then by
+ *  exclusive cycles if the log has counts of the instrumented kernel
+ *  (instrument.h).
+ *
+ *  symbolize [-s NMFILE | KERNEL] [DUMP]
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug A bucket is given whole to the function its first byte is in,
+ *       so samples at the very start of a function may belong to the end
+ *       of the one before it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+
+typedef struct
+{
+    uint32_t addr;
+    char *name;
+    uint64_t samples;
+    /* instrument.h counts */
+    uint64_t calls;
+    uint64_t incl;
+    uint64_t excl;
+}sym_t;
+
+static sym_t *syms = NULL;
+static size_t sym_num = 0, sym_cap = 0;
+
+static void add_sym(uint32_t addr, const char *name){
+    if(sym_num == sym_cap){
+        sym_cap = sym_cap ? sym_cap * 2 : 1024;
+        syms = realloc(syms, sym_cap * sizeof(*syms));
+        if(syms == NULL){
+            perror("symbolize");
+            exit(1);
+        }
+    }
+    syms[sym_num].addr = addr;
+    syms[sym_num].name = strdup(name);
+    syms[sym_num].samples = 0;
+    syms[sym_num].calls = 0;
+    syms[sym_num].incl = 0;
+    syms[sym_num].excl = 0;
+    sym_num++;
+}
+
+/** @brief Read the text symbols of "nm -n" output
+ *
+ *  @return void
+ */
+static void read_syms(FILE *f){
+    char line[1024], name[512], type;
+    unsigned long addr;
+
+    while(fgets(line, sizeof(line), f) != NULL){
+        if(sscanf(line, "%lx %c %511s", &addr, &type, name) != 3)
+            continue;
+        if(type == 't' || type == 'T')
+            add_sym((uint32_t)addr, name);
+    }
+}
+
+/** @brief Find the symbol an address is in
+ *
+ *  @return the symbol, NULL if the address is below all of them
+ */
+static sym_t *lookup(uint32_t addr){
+    size_t lo = 0, hi = sym_num, mid;
+    while(lo < hi){
+        mid = (lo + hi) / 2;
+        if(syms[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo ? &syms[lo - 1] : NULL;
+}
+
+static int by_samples(const void *a, const void *b){
+    const sym_t *x = a, *y = b;
+    if(x->samples != y->samples)
+        return x->samples < y->samples ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+static int by_excl(const void *a, const void *b){
+    const sym_t *x = a, *y = b;
+    if(x->excl != y->excl)
+        return x->excl < y->excl ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+/** @brief Print the instrument.h counts, by exclusive cycles
+ *
+ *  @return void
+ */
+static void print_instr(uint64_t excl_total){
+    size_t i;
+
+    qsort(syms, sym_num, sizeof(*syms), by_excl);
+    printf("\n%12s %16s %16s %7s %10s  %s\n", "calls", "inclusive",
+        "exclusive", "excl %", "excl/call", "function");
+    for(i = 0; i < sym_num && syms[i].calls > 0; i++)
+        printf("%12llu %16llu %16llu %6.2f%% %10llu  %s\n",
+            (unsigned long long)syms[i].calls,
+            (unsigned long long)syms[i].incl,
+            (unsigned long long)syms[i].excl,
+            excl_total ? 100.0 * syms[i].excl / excl_total : 0.0,
+            (unsigned long long)(syms[i].excl / syms[i].calls), syms[i].name);
+}
+
+int main(int argc, char **argv){
+    const char *nm_file = NULL;
+    char line[1024], cmd[4096];
+    uint64_t total = 0, unknown = 0, excl_total = 0;
+    unsigned long long incl, excl;
+    unsigned long addr, count, samples = 0, other = 0, hz = 0;
+    FILE *f, *dump = stdin;
+    sym_t *s;
+    size_t i;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:")) != -1){
+        switch(opt){
+            case 's':
+                nm_file = optarg;
+                break;
+            default:
+                goto usage;
+        }
+    }
+    if(nm_file != NULL){
+        if((f = fopen(nm_file, "r")) == NULL){
+            perror(nm_file);
+            return 1;
+        }
+        read_syms(f);
+        fclose(f);
+    }else{
+        if(optind >= argc)
+            goto usage;
+        snprintf(cmd, sizeof(cmd), "nm -n --defined-only '%s'", argv[optind]);
+        if((f = popen(cmd, "r")) == NULL){
+            perror("nm");
+            return 1;
+        }
+        read_syms(f);
+        if(pclose(f) != 0){
+            fprintf(stderr, "symbolize: nm failed on %s\n", argv[optind]);
+            return 1;
+        }
+        optind++;
+    }
+    if(optind < argc && (dump = fopen(argv[optind], "r")) == NULL){
+        perror(argv[optind]);
+        return 1;
+    }
+
+    while(fgets(line, sizeof(line), dump) != NULL){
+        if(sscanf(line, "prof 0x%lx %lu", &addr, &count) == 2){
+            total += count;
+            if((s = lookup((uint32_t)addr)) != NULL)
+                s->samples += count;
+            else
+                unknown += count;
+        }else if(sscanf(line, "instr 0x%lx %lx %llx %llx", &addr, &count,
+            &incl, &excl) == 4){
+            if((s = lookup((uint32_t)addr)) != NULL){
+                s->calls += count;
+                s->incl += incl;
+                s->excl += excl;
+                excl_total += excl;
+            }
+        }else if(strncmp(line, "instr=begin", 11) == 0){
+            for(i = 0; i < sym_num; i++)
+                syms[i].calls = syms[i].incl = syms[i].excl = 0;
+            excl_total = 0;
+        }else if(strncmp(line, "prof=begin", 10) == 0){
+            /* A later dump replaces an earlier one */
+            for(i = 0; i < sym_num; i++)
+                syms[i].samples = 0;
+            total = unknown = 0;
+            sscanf(line, "prof=begin base=%*s bucket=%*d hz=%lu samples=%lu "
+                "other=%lu", &hz, &samples, &other);
+        }
+    }
+    if(dump != stdin)
+        fclose(dump);
+
+    printf("%lu samples at %lu Hz, %lu outside the text\n", samples, hz,
+        other);
+    if(total > 0){
+        qsort(syms, sym_num, sizeof(*syms), by_samples);
+        printf("%10s %7s  %s\n", "samples", "%", "function");
+        for(i = 0; i < sym_num && syms[i].samples > 0; i++)
+            printf("%10llu %6.2f%%  %s\n", (unsigned long long)syms[i].samples,
+                100.0 * syms[i].samples / total, syms[i].name);
+        if(unknown > 0)
+            printf("%10llu %6.2f%%  (below every symbol)\n",
+                (unsigned long long)unknown, 100.0 * unknown / total);
+    }
+    if(excl_total > 0)
+        print_instr(excl_total);
+    for(i = 0; i < sym_num; i++)
+        free(syms[i].name);
+    free(syms);
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: symbolize [-s NMFILE | KERNEL] [DUMP]\n");
+    return 2;
+}
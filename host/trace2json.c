@@ -0,0 +1,147 @@
+/** @file trace2json.c
+ *
+ *  @brief Convert a kernel trace (trace.h) from a COM1 log to the Chrome
+ *         trace event format, for chrome://tracing or Perfetto.
+ *
+ *  Lines other than the trace's own are skipped, so the whole log can
+ *  be given. Interrupts are drawn on their own track, above the game
+ *  loop; times are microseconds from the first event.
+ *
+ *  trace2json [LOG] > trace.json
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+
+/* Tracks of the output */
+#define TID_KERNEL 1
+#define TID_IRQ    2
+
+static const char *dirs[4] = { "up", "down", "left", "right" };
+
+static int first = 1;
+
+static void begin_event(const char *name, const char *ph, double ts, int tid){
+    printf("%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,"
+        "\"tid\":%d", first ? "" : ",", name, ph, ts, tid);
+    first = 0;
+}
+
+/** @brief Print one event as a JSON object
+ *
+ *  @param ts: microseconds since the first event
+ *  @return 0 if the type is known, -1 if not
+ */
+static int print_event(double ts, unsigned int type, uint32_t arg){
+    char name[32];
+
+    switch(type){
+        case TRACE_IRQ_ENTER:
+        case TRACE_IRQ_EXIT:
+            snprintf(name, sizeof(name), "irq 0x%x", arg);
+            begin_event(name, type == TRACE_IRQ_ENTER ? "B" : "E", ts,
+                TID_IRQ);
+            break;
+        case TRACE_TIMER_ENTER:
+        case TRACE_TIMER_EXIT:
+            begin_event("timer", type == TRACE_TIMER_ENTER ? "B" : "E", ts,
+                TID_IRQ);
+            break;
+        case TRACE_KEY:
+            begin_event("key", "i", ts, TID_KERNEL);
+            if(arg >= 0x20 && arg < 0x7f && arg != '"' && arg != '\\')
+                printf(",\"s\":\"t\",\"args\":{\"char\":\"%c\"}", (int)arg);
+            else
+                printf(",\"s\":\"t\",\"args\":{\"code\":%u}", arg);
+            break;
+        case TRACE_MOVE:
+            begin_event("move", "i", ts, TID_KERNEL);
+            printf(",\"s\":\"t\",\"args\":{\"dir\":\"%s\",\"moved\":%u,"
+                "\"player\":%u}", dirs[arg & 3], (arg >> 8) & 1,
+                (arg >> 12) & 0xf);
+            break;
+        case TRACE_SPAWN:
+            begin_event("spawn", "i", ts, TID_KERNEL);
+            printf(",\"s\":\"t\",\"args\":{\"x\":%u,\"y\":%u,\"value\":%u}",
+                (arg & 0xff) / 4, (arg & 0xff) % 4, 1u << ((arg >> 8) & 0xf));
+            break;
+        case TRACE_RENDER_BEGIN:
+        case TRACE_RENDER_END:
+            begin_event("render", type == TRACE_RENDER_BEGIN ? "B" : "E", ts,
+                TID_KERNEL);
+            break;
+        case TRACE_SEARCH_BEGIN:
+            begin_event("search", "B", ts, TID_KERNEL);
+            printf(",\"args\":{\"depth\":%u}", arg);
+            break;
+        case TRACE_SEARCH_END:
+            begin_event("search", "E", ts, TID_KERNEL);
+            printf(",\"args\":{\"nodes\":%u}", arg);
+            break;
+        case TRACE_LOST:
+            begin_event("lost", "i", ts, TID_KERNEL);
+            printf(",\"s\":\"g\",\"args\":{\"events\":%u}", arg);
+            break;
+        default:
+            return -1;
+    }
+    printf("}");
+    return 0;
+}
+
+int main(int argc, char **argv){
+    char line[256];
+    unsigned long long tsc, tsc0 = 0;
+    unsigned int type, arg, khz = 0;
+    unsigned long events = 0, unknown = 0;
+    int have_tsc0 = 0;
+    FILE *f = stdin;
+
+    if(argc > 2){
+        fprintf(stderr, "usage: trace2json [LOG]\n");
+        return 2;
+    }
+    if(argc == 2 && (f = fopen(argv[1], "r")) == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    begin_event("thread_name", "M", 0, TID_KERNEL);
+    printf(",\"args\":{\"name\":\"kernel\"}}");
+    begin_event("thread_name", "M", 0, TID_IRQ);
+    printf(",\"args\":{\"name\":\"interrupts\"}}");
+    while(fgets(line, sizeof(line), f) != NULL){
+        if(sscanf(line, "trace=start tsc_khz=%u", &khz) == 1)
+            continue;
+        if(sscanf(line, "t %llx %x %x", &tsc, &type, &arg) != 3)
+            continue;
+        if(khz == 0){
+            fprintf(stderr, "trace2json: no trace=start line, "
+                "assuming a 1 GHz TSC\n");
+            khz = 1000000;
+        }
+        if(!have_tsc0){
+            tsc0 = tsc;
+            have_tsc0 = 1;
+        }
+        if(print_event((double)(tsc - tsc0) * 1000.0 / khz, type, arg) != 0)
+            unknown++;
+        else
+            events++;
+    }
+    printf("\n]}\n");
+    if(f != stdin)
+        fclose(f);
+    fprintf(stderr, "trace2json: %lu events", events);
+    if(unknown)
+        fprintf(stderr, ", %lu of unknown type skipped", unknown);
+    fprintf(stderr, "\n");
+    return 0;
+}
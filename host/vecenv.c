@@ -0,0 +1,414 @@
+/** @file vecenv.c
+ *
+ *  @brief Batched environment of vecenv.h, AVX2 and scalar backends.
+ *
+ *  Both backends work on the packed board with the same bit tricks, the
+ *  AVX2 one on 4 boards at a time:
+ *
+ *  - a move transposes the boards moving left or right, looks the four
+ *    rows up in one table of slid rows (gathers, the table half picked by
+ *    the direction) and transposes back;
+ *  - the empty blocks are the nibbles with no bit set; their count picks
+ *    the k-th empty block like engine_add_random(), found as the nibble
+ *    where a running count of the empty blocks reaches k + 1;
+ *  - a move is legal if some pair of neighbours in its direction is
+ *    (empty, block) or two equal blocks.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#include "vecenv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2 1
+#endif
+
+#define ROW_NUM 65536
+/* Bit 0 of every nibble */
+#define ONES   0x1111111111111111ULL
+/* Nibbles with a neighbour at y + 1, and at x + 1 */
+#define Y_PAIR 0x0111011101110111ULL
+#define X_PAIR 0x0000111111111111ULL
+
+/* Rows slid towards nibble 0 (first half) and nibble 3 (second half) */
+static uint32_t slide[2 * ROW_NUM];
+/* Score made by sliding a row */
+static uint32_t gain[ROW_NUM];
+static int ready = 0;
+
+static uint16_t reverse_row(uint16_t row){
+    return (uint16_t)((row >> 12) | ((row >> 4) & 0x00f0) |
+        ((row << 4) & 0x0f00) | (row << 12));
+}
+
+static void tables_init(void){
+    uint32_t row, s;
+    if(ready)
+        return;
+    bb_init();
+    for(row = 0; row < ROW_NUM; row++){
+        s = 0;
+        slide[row] = bb_row_slide((uint16_t)row, &s);
+        gain[row] = s;
+        slide[ROW_NUM + row] = reverse_row(
+            bb_row_slide(reverse_row((uint16_t)row), NULL));
+    }
+    ready = 1;
+}
+
+static uint32_t xs32(uint32_t x){
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/*******************************************************
+ * Scalar backend
+ *******************************************************/
+
+/* Bit 0 of a nibble set if the nibble is not 0 */
+static uint64_t nonzero(uint64_t b){
+    return (b | (b >> 1) | (b >> 2) | (b >> 3)) & ONES;
+}
+
+static uint32_t legal_mask(bboard_t b){
+    uint64_t nz = nonzero(b), z = nz ^ ONES;
+    uint64_t eqy = (nonzero(b ^ (b >> 4)) ^ ONES) & nz;
+    uint64_t eqx = (nonzero(b ^ (b >> 16)) ^ ONES) & nz;
+    uint32_t m = 0;
+    if(((z & (nz >> 4)) | eqy) & Y_PAIR)
+        m |= 1 << MOVE_UP;
+    if(((nz & (z >> 4)) | eqy) & Y_PAIR)
+        m |= 1 << MOVE_DOWN;
+    if(((z & (nz >> 16)) | eqx) & X_PAIR)
+        m |= 1 << MOVE_LEFT;
+    if(((nz & (z >> 16)) | eqx) & X_PAIR)
+        m |= 1 << MOVE_RIGHT;
+    return m;
+}
+
+/** @brief First board of a new game, the same as engine_play()'s
+ *
+ *  @return the board, *rng updated
+ */
+static bboard_t new_game(uint32_t *rng){
+    return bb_add_random(bb_add_random(0, rng), rng);
+}
+
+static void step_scalar(vecenv_t *e, const uint32_t *actions){
+    size_t i;
+    for(i = 0; i < e->n; i++){
+        bboard_t b = e->board[i], nb;
+        uint32_t rng = (uint32_t)e->rng[i], s = 0, seed;
+
+        nb = bb_move(b, (int)(actions[i] & 3), &s);
+        if(nb != b)
+            nb = bb_add_random(nb, &rng);
+        e->score[i] += s;
+        e->reward[i] = s;
+        e->legal[i] = legal_mask(nb);
+        e->done[i] = e->legal[i] == 0;
+        if(e->done[i]){
+            e->final[i] = (uint32_t)e->score[i];
+            e->seed[i] = seed = xs32((uint32_t)e->seed[i]);
+            rng = seed;
+            nb = new_game(&rng);
+            e->score[i] = 0;
+            e->legal[i] = legal_mask(nb);
+        }
+        e->board[i] = nb;
+        e->rng[i] = rng;
+    }
+}
+
+/*******************************************************
+ * AVX2 backend, 4 games per step
+ *******************************************************/
+#ifdef HAVE_AVX2
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 __m256i v_nonzero(__m256i b){
+    __m256i t = _mm256_or_si256(b, _mm256_srli_epi64(b, 1));
+    t = _mm256_or_si256(t, _mm256_srli_epi64(b, 2));
+    t = _mm256_or_si256(t, _mm256_srli_epi64(b, 3));
+    return _mm256_and_si256(t, _mm256_set1_epi64x((long long)ONES));
+}
+
+static AVX2 __m256i v_transpose(__m256i x){
+    __m256i t;
+    t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 12)),
+        _mm256_set1_epi64x(0x0000F0F00000F0F0LL));
+    x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 12)));
+    t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 24)),
+        _mm256_set1_epi64x(0x00000000FF00FF00LL));
+    return _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 24)));
+}
+
+/* Lane set to bit if v is not 0 */
+static AVX2 __m256i v_bit_if(__m256i v, long long bit){
+    __m256i zero = _mm256_cmpeq_epi64(v, _mm256_setzero_si256());
+    return _mm256_andnot_si256(zero, _mm256_set1_epi64x(bit));
+}
+
+static AVX2 __m256i v_legal(__m256i b){
+    __m256i ones = _mm256_set1_epi64x((long long)ONES);
+    __m256i ypair = _mm256_set1_epi64x((long long)Y_PAIR);
+    __m256i xpair = _mm256_set1_epi64x((long long)X_PAIR);
+    __m256i nz = v_nonzero(b), z = _mm256_xor_si256(nz, ones);
+    __m256i eqy = _mm256_and_si256(_mm256_xor_si256(v_nonzero(
+        _mm256_xor_si256(b, _mm256_srli_epi64(b, 4))), ones), nz);
+    __m256i eqx = _mm256_and_si256(_mm256_xor_si256(v_nonzero(
+        _mm256_xor_si256(b, _mm256_srli_epi64(b, 16))), ones), nz);
+    __m256i up = _mm256_and_si256(_mm256_or_si256(
+        _mm256_and_si256(z, _mm256_srli_epi64(nz, 4)), eqy), ypair);
+    __m256i down = _mm256_and_si256(_mm256_or_si256(
+        _mm256_and_si256(nz, _mm256_srli_epi64(z, 4)), eqy), ypair);
+    __m256i left = _mm256_and_si256(_mm256_or_si256(
+        _mm256_and_si256(z, _mm256_srli_epi64(nz, 16)), eqx), xpair);
+    __m256i right = _mm256_and_si256(_mm256_or_si256(
+        _mm256_and_si256(nz, _mm256_srli_epi64(z, 16)), eqx), xpair);
+    return _mm256_or_si256(
+        _mm256_or_si256(v_bit_if(up, 1 << MOVE_UP),
+            v_bit_if(down, 1 << MOVE_DOWN)),
+        _mm256_or_si256(v_bit_if(left, 1 << MOVE_LEFT),
+            v_bit_if(right, 1 << MOVE_RIGHT)));
+}
+
+static AVX2 __m256i v_xs32(__m256i x){
+    __m256i low = _mm256_set1_epi64x(0xffffffffLL);
+    x = _mm256_xor_si256(x, _mm256_and_si256(_mm256_slli_epi64(x, 13), low));
+    x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 17));
+    return _mm256_xor_si256(x, _mm256_and_si256(_mm256_slli_epi64(x, 5), low));
+}
+
+/* Every nibble set to the low nibble of v */
+static AVX2 __m256i v_spread(__m256i v){
+    v = _mm256_or_si256(v, _mm256_slli_epi64(v, 4));
+    v = _mm256_or_si256(v, _mm256_slli_epi64(v, 8));
+    v = _mm256_or_si256(v, _mm256_slli_epi64(v, 16));
+    return _mm256_or_si256(v, _mm256_slli_epi64(v, 32));
+}
+
+/** @brief bb_add_random() on the lanes of active
+ *
+ *  @return the boards, *rng updated in the active lanes
+ */
+static AVX2 __m256i v_spawn(__m256i b, __m256i *rng, __m256i active){
+    __m256i ones = _mm256_set1_epi64x((long long)ONES);
+    __m256i z = _mm256_xor_si256(v_nonzero(b), ones);
+    /* Empty blocks: nibble pairs summed into bytes, bytes into lanes */
+    __m256i cnt = _mm256_sad_epu8(_mm256_and_si256(
+        _mm256_add_epi64(z, _mm256_srli_epi64(z, 4)),
+        _mm256_set1_epi64x(0x0F0F0F0F0F0F0F0FLL)), _mm256_setzero_si256());
+    __m256i x1 = v_xs32(*rng), x2 = v_xs32(x1);
+    __m256i k = _mm256_srli_epi64(_mm256_mul_epu32(x1, cnt), 32);
+    __m256i p = z, hit, four, tile;
+
+    /* Running count of the empty blocks up to every nibble; only the
+     * last nibble of an empty board reaches 16 and wraps to 0 */
+    p = _mm256_add_epi64(p, _mm256_slli_epi64(p, 4));
+    p = _mm256_add_epi64(p, _mm256_slli_epi64(p, 8));
+    p = _mm256_add_epi64(p, _mm256_slli_epi64(p, 16));
+    p = _mm256_add_epi64(p, _mm256_slli_epi64(p, 32));
+    k = _mm256_and_si256(_mm256_add_epi64(k, _mm256_set1_epi64x(1)),
+        _mm256_set1_epi64x(0xf));
+    hit = _mm256_and_si256(_mm256_xor_si256(
+        v_nonzero(_mm256_xor_si256(p, v_spread(k))), ones), z);
+    four = _mm256_cmpeq_epi64(
+        _mm256_srli_epi64(_mm256_mul_epu32(x2, _mm256_set1_epi64x(3)), 32),
+        _mm256_set1_epi64x(2));
+    tile = _mm256_blendv_epi8(hit, _mm256_slli_epi64(hit, 1), four);
+    *rng = _mm256_blendv_epi8(*rng, x2, active);
+    return _mm256_blendv_epi8(b, _mm256_or_si256(b, tile), active);
+}
+
+/** @brief Move the boards, each in the direction of its lane
+ *
+ *  @return the moved boards, *score the score made
+ */
+static AVX2 __m256i v_move(__m256i b, __m256i dir, __m256i *score){
+    __m256i trans = _mm256_cmpeq_epi64(
+        _mm256_and_si256(dir, _mm256_set1_epi64x(2)), _mm256_set1_epi64x(2));
+    __m256i half = _mm256_slli_epi64(
+        _mm256_and_si256(dir, _mm256_set1_epi64x(1)), 16);
+    __m256i mask = _mm256_set1_epi64x(0xffff);
+    __m256i t = _mm256_blendv_epi8(b, v_transpose(b), trans);
+    __m256i out = _mm256_setzero_si256(), s = _mm256_setzero_si256();
+    __m256i row;
+    __m128i got;
+
+#define ROW(k) \
+    row = _mm256_and_si256(_mm256_srli_epi64(t, 16 * k), mask); \
+    got = _mm256_i64gather_epi32((const int *)slide, \
+        _mm256_add_epi64(row, half), 4); \
+    out = _mm256_or_si256(out, \
+        _mm256_slli_epi64(_mm256_cvtepu32_epi64(got), 16 * k)); \
+    got = _mm256_i64gather_epi32((const int *)gain, row, 4); \
+    s = _mm256_add_epi64(s, _mm256_cvtepu32_epi64(got));
+    ROW(0) ROW(1) ROW(2) ROW(3)
+#undef ROW
+
+    *score = s;
+    return _mm256_blendv_epi8(out, v_transpose(out), trans);
+}
+
+/* Low 32 bits of the 4 lanes */
+static AVX2 __m128i v_low32(__m256i v){
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(v,
+        _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+}
+
+static AVX2 void step_avx2(vecenv_t *e, const uint32_t *actions){
+    size_t i;
+    for(i = 0; i < e->n; i += VECENV_LANES){
+        __m256i b = _mm256_load_si256((const __m256i *)(e->board + i));
+        __m256i rng = _mm256_load_si256((const __m256i *)(e->rng + i));
+        __m256i seed = _mm256_load_si256((const __m256i *)(e->seed + i));
+        __m256i score = _mm256_load_si256((const __m256i *)(e->score + i));
+        __m256i final = _mm256_cvtepu32_epi64(
+            _mm_load_si128((const __m128i *)(e->final + i)));
+        __m256i dir = _mm256_cvtepu32_epi64(
+            _mm_loadu_si128((const __m128i *)(actions + i)));
+        __m256i all = _mm256_set1_epi64x(-1);
+        __m256i nb, s, changed, legal, done, nseed, nrng, rb;
+
+        nb = v_move(b, dir, &s);
+        changed = _mm256_xor_si256(_mm256_cmpeq_epi64(nb, b), all);
+        nb = v_spawn(nb, &rng, changed);
+        score = _mm256_add_epi64(score, s);
+        legal = v_legal(nb);
+        done = _mm256_cmpeq_epi64(legal, _mm256_setzero_si256());
+
+        /* A new game for every lane, kept where the game is over */
+        nseed = v_xs32(seed);
+        nrng = nseed;
+        rb = v_spawn(_mm256_setzero_si256(), &nrng, all);
+        rb = v_spawn(rb, &nrng, all);
+        final = _mm256_blendv_epi8(final, score, done);
+        nb = _mm256_blendv_epi8(nb, rb, done);
+        rng = _mm256_blendv_epi8(rng, nrng, done);
+        seed = _mm256_blendv_epi8(seed, nseed, done);
+        score = _mm256_andnot_si256(done, score);
+        legal = _mm256_blendv_epi8(legal, v_legal(rb), done);
+
+        _mm256_store_si256((__m256i *)(e->board + i), nb);
+        _mm256_store_si256((__m256i *)(e->rng + i), rng);
+        _mm256_store_si256((__m256i *)(e->seed + i), seed);
+        _mm256_store_si256((__m256i *)(e->score + i), score);
+        _mm_store_si128((__m128i *)(e->reward + i), v_low32(s));
+        _mm_store_si128((__m128i *)(e->legal + i), v_low32(legal));
+        _mm_store_si128((__m128i *)(e->final + i), v_low32(final));
+        _mm_store_si128((__m128i *)(e->done + i), v_low32(
+            _mm256_and_si256(done, _mm256_set1_epi64x(1))));
+    }
+}
+#endif
+
+/*******************************************************
+ * API
+ *******************************************************/
+
+static void *alloc_array(size_t n, size_t size){
+    size_t len = (n * size + 31) & ~(size_t)31;
+    void *p = aligned_alloc(32, len);
+    if(p != NULL)
+        memset(p, 0, len);
+    return p;
+}
+
+/** @brief Set up n games, all ended until vecenv_reset()
+ *
+ *  @param e: the environment
+ *         n: number of games, rounded up to VECENV_LANES
+ *         simd: VECENV_AUTO, VECENV_SCALAR or VECENV_AVX2
+ *  @return 0 on success, -1 if out of memory or AVX2 is not there
+ */
+int vecenv_init(vecenv_t *e, size_t n, int simd){
+    memset(e, 0, sizeof(*e));
+    e->n = (n + VECENV_LANES - 1) / VECENV_LANES * VECENV_LANES;
+#ifdef HAVE_AVX2
+    if(simd == VECENV_AUTO)
+        simd = __builtin_cpu_supports("avx2") ? VECENV_AVX2 : VECENV_SCALAR;
+    if(simd == VECENV_AVX2 && !__builtin_cpu_supports("avx2"))
+        return -1;
+#else
+    if(simd == VECENV_AVX2)
+        return -1;
+    simd = VECENV_SCALAR;
+#endif
+    e->simd = simd;
+    tables_init();
+    e->board = alloc_array(e->n, sizeof(*e->board));
+    e->rng = alloc_array(e->n, sizeof(*e->rng));
+    e->seed = alloc_array(e->n, sizeof(*e->seed));
+    e->score = alloc_array(e->n, sizeof(*e->score));
+    e->reward = alloc_array(e->n, sizeof(*e->reward));
+    e->done = alloc_array(e->n, sizeof(*e->done));
+    e->legal = alloc_array(e->n, sizeof(*e->legal));
+    e->final = alloc_array(e->n, sizeof(*e->final));
+    if(!e->board || !e->rng || !e->seed || !e->score || !e->reward ||
+        !e->done || !e->legal || !e->final){
+        vecenv_free(e);
+        return -1;
+    }
+    return 0;
+}
+
+void vecenv_free(vecenv_t *e){
+    free(e->board);
+    free(e->rng);
+    free(e->seed);
+    free(e->score);
+    free(e->reward);
+    free(e->done);
+    free(e->legal);
+    free(e->final);
+    memset(e, 0, sizeof(*e));
+}
+
+/** @brief Start a new game everywhere
+ *
+ *  @param e: the environment
+ *         seeds: n seeds, game i is the engine's game with seeds[i]
+ *  @return void
+ */
+void vecenv_reset(vecenv_t *e, const uint32_t *seeds){
+    size_t i;
+    for(i = 0; i < e->n; i++){
+        /* 0 is replaced the way engine_seed() does */
+        uint32_t rng = seeds[i] ? seeds[i] : 0x2048;
+        e->seed[i] = (rng * 0x9E3779B9U) | 1;
+        e->board[i] = new_game(&rng);
+        e->rng[i] = rng;
+        e->score[i] = 0;
+        e->reward[i] = 0;
+        e->done[i] = 0;
+        e->final[i] = 0;
+        e->legal[i] = legal_mask(e->board[i]);
+    }
+}
+
+/** @brief Play one move in every game
+ *
+ *  A move that does not change the board is played as a no-op with
+ *  reward 0, as engine_step() does.
+ *
+ *  @param e: the environment
+ *         actions: n moves, MOVE_*
+ *  @return void
+ */
+void vecenv_step(vecenv_t *e, const uint32_t *actions){
+#ifdef HAVE_AVX2
+    if(e->simd == VECENV_AVX2){
+        step_avx2(e, actions);
+        return;
+    }
+#endif
+    step_scalar(e, actions);
+}
@@ -0,0 +1,64 @@
+/** @file vecenv.h
+ *
+ *  @brief Batched environment: N games stepped together.
+ *
+ *  The games are kept structure-of-arrays, one array per field, and
+ *  stepped 4 at a time in the 64-bit lanes of an AVX2 register (or one
+ *  at a time on the packed board without AVX2). Moves, new blocks,
+ *  legal masks and game over are computed for all lanes with no branch
+ *  per game; a game that ends is replaced by a new one in the same step
+ *  by blending the lanes.
+ *
+ *  The rules are the engine's: vecenv_reset() with seed s starts the
+ *  game engine_init() starts with s, and every step draws the same
+ *  random numbers as engine_step(). New games of the auto-reset take
+ *  their seeds from a second generator per game.
+ *
+ *  After vecenv_reset() or vecenv_step(), the results are read straight
+ *  from the arrays:
+ *
+ *    board[i]   packed board (the next game's first board after a reset)
+ *    reward[i]  score made by the last action
+ *    done[i]    1 if the last action ended the game
+ *    legal[i]   legal moves on board[i], bit MOVE_*
+ *    score[i]   score of the running game
+ *    final[i]   score of the last game that ended
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _VECENV_H_
+#define _VECENV_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bitboard.h"
+
+/* Games per AVX2 step, n is rounded up to a multiple of it */
+#define VECENV_LANES 4
+
+/* Backends of vecenv_init() */
+#define VECENV_AUTO   -1
+#define VECENV_SCALAR 0
+#define VECENV_AVX2   1
+
+typedef struct
+{
+    size_t n;               /* games, a multiple of VECENV_LANES */
+    int simd;               /* VECENV_SCALAR or VECENV_AVX2 */
+    /* 32-byte aligned arrays of n entries */
+    bboard_t *board;
+    uint64_t *rng;          /* xorshift32 state of the game */
+    uint64_t *seed;         /* xorshift32 state giving the next game's seed */
+    uint64_t *score;
+    uint32_t *reward;
+    uint32_t *done;
+    uint32_t *legal;
+    uint32_t *final;
+}vecenv_t;
+
+int vecenv_init(vecenv_t *e, size_t n, int simd);
+void vecenv_free(vecenv_t *e);
+void vecenv_reset(vecenv_t *e, const uint32_t *seeds);
+void vecenv_step(vecenv_t *e, const uint32_t *actions);
+
+#endif
@@ -0,0 +1,180 @@
+/** @file instrument.c
+ *
+ *  @brief Hooks of -finstrument-functions and the table they fill.
+ *
+ *  The hooks run with interrupts off, as an interrupt handler is
+ *  instrumented too and pushes on the same shadow stack; its cycles
+ *  become those of a child of the function it interrupted. Without
+ *  INSTRUMENT only instr_reset() and instr_dump() are left.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug A recursive function counts the cycles of its inner calls in
+ *       its inclusive time once per level.
+ */
+#include <stdio.h>
+
+#include "serial.h"
+#include "instrument.h"
+
+#ifdef INSTRUMENT
+
+#define NO_INSTR __attribute__((no_instrument_function))
+
+typedef struct
+{
+    uint32_t fn;            /* address of the function, 0 if free */
+    uint32_t calls;
+    uint64_t incl;          /* cycles from entry to exit */
+    uint64_t excl;          /* the same without the calls it made */
+}instr_func_t;
+
+typedef struct
+{
+    uint32_t fn;
+    uint64_t start;
+    uint64_t child;         /* inclusive cycles of its calls */
+}instr_frame_t;
+
+static instr_func_t funcs[INSTR_FUNCS];
+static instr_frame_t stack[INSTR_DEPTH];
+static int depth = 0;
+static int recording = 1;
+static uint32_t dropped = 0;        /* exits of functions not in the table */
+
+void __cyg_profile_func_enter(void *fn, void *site) NO_INSTR;
+void __cyg_profile_func_exit(void *fn, void *site) NO_INSTR;
+
+static inline uint64_t NO_INSTR now(void){
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint32_t NO_INSTR irq_save(void){
+    uint32_t flags;
+    __asm__ __volatile__("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void NO_INSTR irq_restore(uint32_t flags){
+    __asm__ __volatile__("pushl %0; popfl" : : "r"(flags) : "memory", "cc");
+}
+
+/** @brief Find or add the entry of a function
+ *
+ *  @return the entry, NULL if the table is full
+ */
+static instr_func_t * NO_INSTR lookup(uint32_t fn){
+    uint32_t i = ((fn >> 2) * 2654435761u) & (INSTR_FUNCS - 1);
+    int probes;
+    for(probes = 0; probes < INSTR_FUNCS; probes++){
+        if(funcs[i].fn == fn)
+            return &funcs[i];
+        if(funcs[i].fn == 0){
+            funcs[i].fn = fn;
+            return &funcs[i];
+        }
+        i = (i + 1) & (INSTR_FUNCS - 1);
+    }
+    return NULL;
+}
+
+void __cyg_profile_func_enter(void *fn, void *site){
+    uint32_t flags = irq_save();
+    (void)site;
+    /* Past INSTR_DEPTH only the depth is counted */
+    if(depth < INSTR_DEPTH){
+        stack[depth].fn = (uint32_t)fn;
+        stack[depth].child = 0;
+        stack[depth].start = now();
+    }
+    depth++;
+    irq_restore(flags);
+}
+
+void __cyg_profile_func_exit(void *fn, void *site){
+    uint64_t end = now(), incl;
+    uint32_t flags = irq_save();
+    instr_func_t *f;
+    (void)fn;
+    (void)site;
+
+    if(depth == 0){
+        /* More exits than entries, nothing to pop */
+        irq_restore(flags);
+        return;
+    }
+    depth--;
+    if(depth < INSTR_DEPTH){
+        incl = end - stack[depth].start;
+        if(depth > 0)
+            stack[depth - 1].child += incl;
+        if(recording){
+            if((f = lookup(stack[depth].fn)) != NULL){
+                f->calls++;
+                f->incl += incl;
+                f->excl += incl - stack[depth].child;
+            }else{
+                dropped++;
+            }
+        }
+    }
+    irq_restore(flags);
+}
+
+/** @brief Forget all counts
+ *
+ *  The call chain in progress is kept, so the functions on it still
+ *  exit correctly.
+ *
+ *  @return void
+ */
+void NO_INSTR instr_reset(void){
+    uint32_t flags = irq_save();
+    int i;
+    for(i = 0; i < INSTR_FUNCS; i++){
+        funcs[i].fn = 0;
+        funcs[i].calls = 0;
+        funcs[i].incl = 0;
+        funcs[i].excl = 0;
+    }
+    dropped = 0;
+    irq_restore(flags);
+}
+
+/** @brief Send the table to COM1
+ *
+ *  Nothing is recorded while it is sent.
+ *
+ *  @return void
+ */
+void NO_INSTR instr_dump(void){
+    int i, n = 0;
+
+    recording = 0;
+    for(i = 0; i < INSTR_FUNCS; i++)
+        n += funcs[i].fn != 0;
+    serial_printf("instr=begin functions=%d dropped=%u\n", n,
+        (unsigned int)dropped);
+    for(i = 0; i < INSTR_FUNCS; i++){
+        if(funcs[i].fn == 0)
+            continue;
+        serial_printf("instr 0x%08x %x %08x%08x %08x%08x\n",
+            (unsigned int)funcs[i].fn, (unsigned int)funcs[i].calls,
+            (unsigned int)(funcs[i].incl >> 32), (unsigned int)funcs[i].incl,
+            (unsigned int)(funcs[i].excl >> 32), (unsigned int)funcs[i].excl);
+    }
+    serial_puts("instr=end\n");
+    recording = 1;
+}
+
+#else
+
+void instr_reset(void){
+}
+
+void instr_dump(void){
+    serial_puts("instr=off\n");
+}
+
+#endif
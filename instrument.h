@@ -0,0 +1,35 @@
+/** @file instrument.h
+ *
+ *  @brief Exact call counts and cycles per function, from the hooks of
+ *         -finstrument-functions.
+ *
+ *  Only the instrumented flavour of the kernel records anything: build
+ *  it with "-finstrument-functions -DINSTRUMENT" added to the kernel's
+ *  CFLAGS. Every function entry and exit then goes through the hooks in
+ *  instrument.c, which keep a shadow stack of TSC stamps and add calls,
+ *  inclusive and exclusive cycles into a fixed table of functions.
+ *
+ *  instr_dump() sends the table to COM1:
+ *
+ *    instr=begin functions=N dropped=N
+ *    instr ADDRESS CALLS INCLUSIVE EXCLUSIVE      (hex, cycles)
+ *    instr=end
+ *
+ *  and host/symbolize gives it names.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _INSTRUMENT_H_
+#define _INSTRUMENT_H_
+
+#include <stdint.h>
+
+/* Functions in the table, a power of 2 */
+#define INSTR_FUNCS 1024
+/* Deepest call chain followed */
+#define INSTR_DEPTH 64
+
+void instr_reset(void);
+void instr_dump(void);
+
+#endif
@@ -16,6 +16,9 @@
 #include <simics.h>
 #include <stdio.h>
 #include "int.h"
+#include "prof.h"
+#include "trace.h"
+#include "script.h"
 
 /**
  * Structure of registers pushed before calling handler
@@ -107,6 +110,9 @@ struct Gatedp idt[IDT_ENTS] = { {0} };
 
 /* Timer counter */
 static uint32_t timer_ticks = 0;
+/* Interrupts per tick, more than 1 only while profiling */
+static uint32_t timer_mult = 1;
+static uint32_t timer_sub = 0;
 
 /* Declared in the assembly file interrupt.S */
 extern void asm_timer_handler();
@@ -116,14 +122,19 @@ extern void asm_kbd_handler();
 static void (*timer_callback)(unsigned int);
 static void timer_handler(struct Regs* regs);
 static void timer_install(void(*tickback)(unsigned int));
+void timer_set_mult(unsigned int mult);
 
 /* Helper functions of keyboard handler */
 static void kbd_handler(struct Regs* regs);
 static void kbd_handler(struct Regs* regs);
 static void writebuf(char ch);
 static uint8_t readbuf();
+static void kbd_script(void);
 
 int readchar(void);
+int kbd_pending(void);
+void kbd_inject(uint8_t scancode);
+void kbd_stats(uint32_t *high, uint32_t *dropped, uint32_t *size);
 void int_handler(struct Regs *regs);
 
 /*******************************************************
@@ -186,13 +197,17 @@ int handler_install(void(*tickback)(unsigned int)){
 void int_handler(struct Regs *regs){
 	/* Dispatch timer handler */
 	if(regs->irq_no == IRQ_TIMER){
+		TRACE(TRACE_TIMER_ENTER, IRQ_TIMER);
 		timer_handler(regs);
 		outb(INT_CTL_PORT, INT_ACK_CURRENT);
+		TRACE(TRACE_TIMER_EXIT, IRQ_TIMER);
 		return;
 	}/* Dispatch keyboard handler */
 	else if(regs->irq_no == IRQ_KBD){
+		TRACE(TRACE_IRQ_ENTER, IRQ_KBD);
 		kbd_handler(regs);
 		outb(INT_CTL_PORT, INT_ACK_CURRENT);
+		TRACE(TRACE_IRQ_EXIT, IRQ_KBD);
 		return;
 	}/* Print out the info for setted INTs in 
 	  * the IDT without relevant handlers */
@@ -209,6 +224,7 @@ void int_handler(struct Regs *regs){
  * (1)timer_init()
  * (2)timer_handler()
  * (3)timer_install()
+ * (4)timer_set_mult()
  *******************************************************/
 
 /** @breif timer_init()
@@ -222,7 +238,7 @@ void int_handler(struct Regs *regs){
  *  @return void
  */
  static void timer_init(){
-	uint32_t period = TIMER_RATE / 100;
+	uint32_t period = TIMER_RATE / (TIMER_HZ * timer_mult);
 
 	outb(TIMER_MODE_IO_PORT, TIMER_SQUARE_WAVE);
 	outb(TIMER_PERIOD_IO_PORT, period & 0xff);
@@ -239,7 +255,14 @@ void int_handler(struct Regs *regs){
  *  @return void
  */
 static void timer_handler(struct Regs* regs){
+	if(prof_enabled)
+		prof_hit(regs->eip);
+	/* The game sees TIMER_HZ ticks a second whatever the timer runs at */
+	if(++timer_sub < timer_mult)
+		return;
+	timer_sub = 0;
 	timer_ticks++;
+	kbd_script();
 	if(timer_callback){
 		timer_callback(timer_ticks);
 	}
@@ -258,6 +281,23 @@ void timer_install(void(*tickback)(unsigned int)){
 	timer_callback = tickback;
 }
 
+/** @breif timer_set_mult()
+ * 
+ *  Run the timer mult times faster, for the profiler. The callback
+ *  is still called 100 times a second.
+ *
+ *  @param  mult: interrupts per tick, at least 1
+ *             
+ *  @return void
+ */
+void timer_set_mult(unsigned int mult){
+	disable_interrupts();
+	timer_mult = mult ? mult : 1;
+	timer_sub = 0;
+	timer_init();
+	enable_interrupts();
+}
+
 /*******************************************************
  * Helper functions used for initialize the kbd handler:
  *
@@ -265,10 +305,17 @@ void timer_install(void(*tickback)(unsigned int)){
  * (2)writebuf()
  * (3)readbuf()
  * (4)readchar()
+ * (5)kbd_pending()
+ * (6)kbd_inject()
+ * (7)kbd_stats()
+ * (8)kbd_script()
  *******************************************************/
 /* basic stucture for keyboard handler */
 static char buf[MAX_BUF_SZ];
 static int buf_sz = 0;
+/* Most scancodes ever waiting, and those lost to a full buffer */
+static uint32_t buf_high = 0;
+static uint32_t buf_dropped = 0;
 
 int head = 0;
 int tail = 0;
@@ -289,6 +336,7 @@ static void kbd_handler(struct Regs* regs){
  * 
  *  Write chars into keyboard buf which can be regared as 
  *  circular buf. So, we won't worry about buffer overflow.
+ *  A char arriving when the buf is full is dropped and counted.
  *
  *  @param  ch: the character need to write into the buf
  *             
@@ -300,6 +348,10 @@ static void writebuf(char ch){
 		if(head == MAX_BUF_SZ)
 			head = 0;
 		buf_sz++;
+		if((uint32_t)buf_sz > buf_high)
+			buf_high = buf_sz;
+	}else{
+		buf_dropped++;
 	}
 }
 
@@ -329,7 +381,8 @@ static uint8_t readbuf(){
  *
  *  @param  void
  *             
- *  @return voKH_GETCHAR(aug): next character in the kbd buffer;
+ *  @return voKH_GETCHAR(aug): next character in the kbd buffer,
+ *          0 to 255 so that extended keys (KHE_*) compare equal;
  *          -1 : if no such character.
  */
 int readchar(void){
@@ -337,8 +390,71 @@ int readchar(void){
 	int ch = (int)readbuf();
 	aug = process_scancode(ch);
 	if(KH_ISMAKE(aug) && KH_HASDATA(aug)){
-		return KH_GETCHAR(aug);
+		return (unsigned char)KH_GETCHAR(aug);
 	}
 	return -1;
 }
 
+/** @breif kbd_pending()
+ * 
+ *  Tell whether the keyboard buffer holds anything. Cheap enough
+ *  to be polled by the background search every few nodes.
+ *
+ *  @param  void
+ *             
+ *  @return 1: there are scancodes waiting;
+ *          0: the buffer is empty.
+ */
+int kbd_pending(void){
+	return buf_sz > 0;
+}
+
+/** @breif kbd_inject()
+ * 
+ *  Put a scancode into the keyboard buffer as if the keyboard
+ *  had sent it, for synthetic input.
+ *
+ *  @param  scancode: the scancode readchar() will see
+ *             
+ *  @return void
+ */
+void kbd_inject(uint8_t scancode){
+	disable_interrupts();
+	writebuf((char)scancode);
+	enable_interrupts();
+}
+
+/** @breif kbd_stats()
+ * 
+ *  Counters of the keyboard buffer, for the statistics panel.
+ *
+ *  @param  high: most scancodes that were ever waiting
+ *          dropped: scancodes lost because the buffer was full
+ *          size: size of the buffer
+ *             
+ *  @return void
+ */
+void kbd_stats(uint32_t *high, uint32_t *dropped, uint32_t *size){
+	*high = buf_high;
+	*dropped = buf_dropped;
+	*size = MAX_BUF_SZ;
+}
+
+/** @breif kbd_script()
+ * 
+ *  Called by the timer handler. Put the scripted scancodes that are
+ *  due into the keyboard buf, while it has room, the same way
+ *  kbd_handler() does with the keyboard's.
+ *
+ *  @param  void
+ *             
+ *  @return void
+ */
+static void kbd_script(void){
+	int sc;
+	while(buf_sz < MAX_BUF_SZ && (sc = script_next(timer_ticks)) >= 0){
+		TRACE(TRACE_IRQ_ENTER, IRQ_KBD);
+		writebuf((char)sc);
+		TRACE(TRACE_IRQ_EXIT, IRQ_KBD);
+	}
+}
@@ -18,6 +18,9 @@
 /* The same as KEY_IDT_ENTRY in 'x86/keyhelp.h' */
 #define IRQ_KBD    0x21
 
+/* Ticks a second given to the timer callback, whatever the timer runs at */
+#define TIMER_HZ   100
+
 /*******************************************************
  * Segment type used for defining a gate descriptor
  *
@@ -0,0 +1,240 @@
+/** @file kbench.c
+ *
+ *  @brief Self-benchmark of the kernel: moves, rendering, console,
+ *         keyboard path and search, timed with the TSC.
+ *
+ *  The TSC rate is measured against the timer first. Counts are kept
+ *  in 32 bits where they are divided, the kernel has no 64-bit
+ *  division.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <p1kern.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86/asm.h>
+
+#include "engine.h"
+#include "bitboard.h"
+#include "ai.h"
+#include "serial.h"
+#include "tsc.h"
+#include "kbench.h"
+
+/* Boards the move tests go through */
+#define BOARDS 64
+#define BOARD_MASK (BOARDS - 1)
+
+#define MOVE_OPS    (1 << 16)
+#define RENDER_OPS  256
+#define CLEAR_OPS   64
+#define SCROLL_OPS  256
+#define KEY_OPS     1024
+#define SEARCH_BOARDS 4
+#define SEARCH_DEPTH  6
+#define SEARCH_MS     2000
+
+/* Set 1 scancodes of w, s, a, d (MOVE_* order), released with | 0x80 */
+static const uint8_t move_scancodes[MOVE_NUM] = { 0x11, 0x1f, 0x1e, 0x20 };
+#define SCANCODE_BREAK 0x80
+
+static game_t boards[BOARDS];
+static bboard_t packed[BOARDS];
+static uint32_t tsc_khz;
+static volatile uint32_t sink;
+
+/* Declared in game.c */
+void draw_num(uint16_t board[SIZE][SIZE]);
+/* Declared in console.c */
+void console_scroll();
+/* Declared in int.c */
+void kbd_inject(uint8_t scancode);
+
+/** @brief Send the line of one test, without its end of line
+ *
+ *  @return cycles per op
+ */
+static uint32_t report(const char *name, uint32_t ops, uint64_t cycles){
+    uint32_t cpo = tsc_div(cycles, ops);
+    uint32_t mhz = tsc_khz / 1000 ? tsc_khz / 1000 : 1;
+
+    serial_printf("bench=%s ops=%u cycles=%u cycles_per_op=%u ns_per_op=%u",
+        name, (unsigned int)ops, (unsigned int)(cycles >> 32 ? 0xffffffff :
+        cycles), (unsigned int)cpo, (unsigned int)(cpo < 4000000 ?
+        cpo * 1000 / mhz : cpo / mhz * 1000));
+    return cpo;
+}
+
+/** @brief Fill the boards with positions of seeded random games
+ *
+ *  @return void
+ */
+static void make_boards(void){
+    game_t g;
+    int i = 0;
+    while(i < BOARDS){
+        engine_init(&g, (uint32_t)i + 1, 2048);
+        engine_add_random(&g);
+        engine_add_random(&g);
+        while(i < BOARDS && !engine_is_over(g.board)){
+            engine_step(&g, (int)engine_rand_below(&g, MOVE_NUM));
+            /* Take every 8th board, deeper into the game */
+            if((engine_rand_below(&g, 8)) == 0){
+                boards[i] = g;
+                packed[i] = bb_pack(g.board);
+                i++;
+            }
+        }
+    }
+}
+
+static void bench_moves(void){
+    game_t g;
+    uint32_t i, score = 0;
+    uint64_t t0, t1;
+
+    engine_init(&g, 1, 2048);
+    t0 = read_tsc();
+    for(i = 0; i < MOVE_OPS; i++){
+        memcpy(g.board, boards[i & BOARD_MASK].board, sizeof(g.board));
+        sink += engine_move(&g, (int)(i & 3));
+    }
+    t1 = read_tsc();
+    report("move", MOVE_OPS, t1 - t0);
+    serial_puts("\n");
+
+    t0 = read_tsc();
+    for(i = 0; i < MOVE_OPS; i++)
+        sink += (uint32_t)bb_move(packed[i & BOARD_MASK], (int)(i & 3), &score);
+    t1 = read_tsc();
+    report("bb_move", MOVE_OPS, t1 - t0);
+    serial_puts("\n");
+}
+
+/* The console tests draw on the screen, it is cleared afterwards */
+static void bench_console(void){
+    uint16_t full[SIZE][SIZE];
+    uint64_t t0, t1;
+    int i, x, y;
+
+    /* Every block holds a number, so every block is drawn in color */
+    for(x = 0; x < SIZE; x++){
+        for(y = 0; y < SIZE; y++)
+            full[x][y] = (uint16_t)(2 << ((x * SIZE + y) % 11));
+    }
+    t0 = read_tsc();
+    for(i = 0; i < RENDER_OPS; i++)
+        draw_num(full);
+    t1 = read_tsc();
+    report("render", RENDER_OPS, t1 - t0);
+    serial_puts("\n");
+
+    t0 = read_tsc();
+    for(i = 0; i < CLEAR_OPS; i++)
+        clear_console();
+    t1 = read_tsc();
+    report("clear", CLEAR_OPS, t1 - t0);
+    serial_puts("\n");
+
+    t0 = read_tsc();
+    for(i = 0; i < SCROLL_OPS; i++)
+        console_scroll();
+    t1 = read_tsc();
+    report("scroll", SCROLL_OPS, t1 - t0);
+    serial_puts("\n");
+    clear_console();
+}
+
+/** @brief From a scancode in the keyboard buffer to the board moved
+ *
+ *  A press is injected, read back through readchar() and the keymap,
+ *  and played with engine_step(); the release is injected and read
+ *  outside of the timing.
+ *
+ *  @return void
+ */
+static void bench_keys(void){
+    static const char keys[MOVE_NUM] = { 'w', 's', 'a', 'd' };
+    uint32_t i, d, lost = 0, min = 0xffffffff, max = 0, lat;
+    uint64_t t0, total = 0;
+    game_t g;
+    int ch;
+
+    engine_init(&g, 1, 2048);
+    engine_add_random(&g);
+    engine_add_random(&g);
+    for(i = 0; i < KEY_OPS; i++){
+        d = i & 3;
+        t0 = read_tsc();
+        kbd_inject(move_scancodes[d]);
+        ch = readchar();
+        if(ch == keys[d])
+            engine_step(&g, (int)d);
+        else
+            lost++;
+        lat = (uint32_t)(read_tsc() - t0);
+        kbd_inject(move_scancodes[d] | SCANCODE_BREAK);
+        readchar();
+
+        total += lat;
+        if(lat < min)
+            min = lat;
+        if(lat > max)
+            max = lat;
+        if(engine_is_over(g.board)){
+            engine_init(&g, i, 2048);
+            engine_add_random(&g);
+            engine_add_random(&g);
+        }
+    }
+    report("key_latency", KEY_OPS, total);
+    serial_printf(" min_cycles=%u max_cycles=%u lost=%u\n", (unsigned int)min,
+        (unsigned int)max, (unsigned int)lost);
+}
+
+static void bench_search(ai_ctx_t *ai){
+    const ai_stats_t *st;
+    uint32_t nodes = 0, ms = 0;
+    uint64_t t0, t1;
+    int i;
+
+    t0 = read_tsc();
+    for(i = 0; i < SEARCH_BOARDS; i++){
+        ai_search(ai, packed[i * BOARDS / SEARCH_BOARDS], SEARCH_DEPTH,
+            SEARCH_MS);
+        st = ai_get_stats(ai);
+        nodes += st->nodes;
+        ms += st->ms;
+    }
+    t1 = read_tsc();
+    report("search", nodes, t1 - t0);
+    serial_printf(" depth=%d ms=%u nps=%u\n", SEARCH_DEPTH, (unsigned int)ms,
+        (unsigned int)(ms ? nodes / ms * 1000 : 0));
+}
+
+/** @brief Run every test and report on COM1
+ *
+ *  Needs the timer running, for calibration and the search clock.
+ *
+ *  @param ai: search context, set up with its clock
+ *  @return void
+ */
+void kbench_run(ai_ctx_t *ai){
+    clear_console();
+    set_term_color(FGND_BCYAN);
+    printf("Self-benchmark running, results on COM1...");
+
+    tsc_khz = tsc_calibrate();
+    serial_printf("bench=start tsc_khz=%u\n", (unsigned int)tsc_khz);
+    make_boards();
+    bench_moves();
+    bench_console();
+    bench_keys();
+    bench_search(ai);
+    serial_puts("bench=done\n");
+
+    set_cursor(0, 0);
+    set_term_color(FGND_BCYAN);
+    printf("Self-benchmark done, results on COM1.");
+}
@@ -0,0 +1,23 @@
+/** @file kbench.h
+ *
+ *  @brief Self-benchmark run instead of the game with the "bench" boot
+ *         option.
+ *
+ *  Every test is timed with the TSC in the running kernel, so VGA
+ *  writes, port I/O and interrupts cost what they cost under the
+ *  emulator or on the machine. Results go to COM1, one line per test:
+ *
+ *    bench=NAME ops=N cycles=C cycles_per_op=X ns_per_op=Y [more=...]
+ *
+ *  with a first line giving tsc_khz and a last line "bench=done".
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _KBENCH_H_
+#define _KBENCH_H_
+
+#include "ai.h"
+
+void kbench_run(ai_ctx_t *ai);
+
+#endif
@@ -0,0 +1,113 @@
+/** @file prof.c
+ *
+ *  @brief Sampling profiler: eip histogram filled by the timer.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug Samples taken while interrupts are disabled land on the
+ *       instruction that enables them again.
+ */
+#include <stdio.h>
+#include <x86/asm.h>
+
+#include "serial.h"
+#include "prof.h"
+#include "instrument.h"
+
+volatile int prof_enabled = 0;
+
+static uint32_t hist[PROF_BUCKETS];
+static uint32_t samples = 0;
+static uint32_t other = 0;          /* eip outside of the histogram */
+static unsigned int prof_hz = PROF_MIN_HZ;
+
+/* Declared in int.c */
+void timer_set_mult(unsigned int mult);
+
+/** @brief Start sampling
+ *
+ *  The timer interrupts hz times a second from now on; the game still
+ *  gets its 100 ticks a second. Call it after handler_install().
+ *
+ *  @param hz: samples per second, rounded down to a multiple of 100
+ *  @return void
+ */
+void prof_start(unsigned int hz){
+    if(hz < PROF_MIN_HZ)
+        hz = PROF_MIN_HZ;
+    if(hz > PROF_MAX_HZ)
+        hz = PROF_MAX_HZ;
+    prof_hz = hz / 100 * 100;
+    timer_set_mult(hz / 100);
+    prof_enabled = 1;
+}
+
+/** @brief Count one sample, called by the timer interrupt
+ *
+ *  @param eip: where the kernel was interrupted
+ *  @return void
+ */
+void prof_hit(uint32_t eip){
+    uint32_t off = eip - PROF_BASE;
+    samples++;
+    if(off < PROF_SIZE)
+        hist[off >> PROF_SHIFT]++;
+    else
+        other++;
+}
+
+/** @brief Forget the samples so far, and the counts of instrument.h
+ *
+ *  @return void
+ */
+void prof_reset(void){
+    int i;
+    disable_interrupts();
+    for(i = 0; i < PROF_BUCKETS; i++)
+        hist[i] = 0;
+    samples = 0;
+    other = 0;
+    enable_interrupts();
+    instr_reset();
+}
+
+/** @brief Send the histogram to COM1
+ *
+ *  Sampling stops while it is sent, so the dump does not profile
+ *  itself. The counts of instrument.h follow.
+ *
+ *  @return void
+ */
+void prof_dump(void){
+    int was = prof_enabled;
+    int i;
+
+    prof_enabled = 0;
+    serial_printf("prof=begin base=0x%08x bucket=%d hz=%u samples=%u "
+        "other=%u\n", PROF_BASE, PROF_BUCKET, prof_hz,
+        (unsigned int)samples, (unsigned int)other);
+    for(i = 0; i < PROF_BUCKETS; i++){
+        if(hist[i] != 0)
+            serial_printf("prof 0x%08x %u\n", PROF_BASE + (i << PROF_SHIFT),
+                (unsigned int)hist[i]);
+    }
+    serial_puts("prof=end\n");
+    prof_enabled = was;
+    instr_dump();
+}
+
+/** @brief Run a profiler command received on COM1
+ *
+ *  PROF_CMD_DUMP dumps the histogram, PROF_CMD_RESET clears it.
+ *
+ *  @param c: the byte received
+ *  @return 1 if it was a profiler command, 0 if not
+ */
+int prof_command(int c){
+    if(c == PROF_CMD_DUMP)
+        prof_dump();
+    else if(c == PROF_CMD_RESET)
+        prof_reset();
+    else
+        return 0;
+    return 1;
+}
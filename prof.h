@@ -0,0 +1,47 @@
+/** @file prof.h
+ *
+ *  @brief Sampling profiler fed by the timer interrupt.
+ *
+ *  When enabled, every timer interrupt adds the interrupted eip to a
+ *  histogram of PROF_BUCKET-byte buckets over the kernel text. The
+ *  timer can be sped up for profiling without changing the 100 Hz the
+ *  game sees. The histogram is dumped to COM1 as text:
+ *
+ *    prof=begin base=0x... bucket=N hz=N samples=N other=N
+ *    prof ADDRESS COUNT          (one line per non-empty bucket)
+ *    prof=end
+ *
+ *  and host/symbolize turns it into samples per function of the kernel
+ *  ELF.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <stdint.h>
+
+/* Kernel text covered by the histogram, the kernel is linked at 1MB */
+#define PROF_BASE   0x00100000
+#define PROF_SIZE   0x00100000
+#define PROF_SHIFT  4
+#define PROF_BUCKET (1 << PROF_SHIFT)
+#define PROF_BUCKETS (PROF_SIZE >> PROF_SHIFT)
+
+/* Sampling rate limits, in samples per second */
+#define PROF_MIN_HZ 100
+#define PROF_MAX_HZ 10000
+
+/* Serial commands, first byte of a line read by script_poll() */
+#define PROF_CMD_DUMP  'P'
+#define PROF_CMD_RESET 'R'
+
+extern volatile int prof_enabled;
+
+void prof_start(unsigned int hz);
+void prof_reset(void);
+void prof_dump(void);
+int prof_command(int c);
+void prof_hit(uint32_t eip);
+
+#endif
@@ -0,0 +1,264 @@
+/** @file render.c
+ *
+ *  @brief Region-clipped drawing into a shadow screen, see render.h.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <p1kern.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "render.h"
+
+/* A cell as the VGA memory holds it: character, then color */
+#define CELL(ch, color) ((uint16_t)(((color) & 0xff) << 8 | ((ch) & 0xff)))
+/* Never drawn, so that a reset shows every cell again */
+#define CELL_UNKNOWN 0xffff
+
+#define GRID_COLOR FGND_BCYAN
+
+/* What is drawn and what is on the screen */
+static uint16_t back[RENDER_ROWS][RENDER_COLS];
+static uint16_t front[RENDER_ROWS][RENDER_COLS];
+/* Rows drawn since the last flush, one bit each */
+static uint32_t dirty_rows;
+
+/* Declared in game.c */
+int set_color(int num);
+
+/** @brief Blank the screen and forget what is on it
+ *
+ *  @return void
+ */
+void render_reset(void){
+    int row, col;
+
+    for(row = 0; row < RENDER_ROWS; row++){
+        for(col = 0; col < RENDER_COLS; col++){
+            back[row][col] = CELL(' ', FGND_LGRAY);
+            front[row][col] = CELL_UNKNOWN;
+        }
+    }
+    dirty_rows = (1u << RENDER_ROWS) - 1;
+}
+
+/** @brief Forget what is on the screen in a region
+ *
+ *  For regions written to by something else than render_flush(): the
+ *  next flush draws every cell of the region again.
+ *
+ *  @return void
+ */
+void render_invalidate(const render_region_t *r){
+    int row, col;
+
+    for(row = 0; row < r->rows; row++){
+        for(col = 0; col < r->cols; col++)
+            front[r->row + row][r->col + col] = CELL_UNKNOWN;
+        dirty_rows |= 1u << (r->row + row);
+    }
+}
+
+/** @brief Set up a region, cut to the screen
+ *
+ *  @param r: the region
+ *         row, col: its top left corner on the screen
+ *         rows, cols: its size
+ *  @return void
+ */
+void render_region(render_region_t *r, int row, int col, int rows,
+    int cols){
+    if(row < 0){
+        rows += row;
+        row = 0;
+    }
+    if(col < 0){
+        cols += col;
+        col = 0;
+    }
+    if(row + rows > RENDER_ROWS)
+        rows = RENDER_ROWS - row;
+    if(col + cols > RENDER_COLS)
+        cols = RENDER_COLS - col;
+    r->row = row;
+    r->col = col;
+    r->rows = rows > 0 ? rows : 0;
+    r->cols = cols > 0 ? cols : 0;
+}
+
+/** @brief Draw one character, if it is in the region
+ *
+ *  @param row, col: relative to the region
+ *  @return void
+ */
+void render_put(const render_region_t *r, int row, int col, int ch,
+    int color){
+    if(row < 0 || row >= r->rows || col < 0 || col >= r->cols)
+        return;
+    back[r->row + row][r->col + col] = CELL(ch, color);
+    dirty_rows |= 1u << (r->row + row);
+}
+
+/** @brief Draw a string on one row, clipped to the region
+ *
+ *  @return void
+ */
+void render_text(const render_region_t *r, int row, int col, int color,
+    const char *s){
+    uint16_t *p;
+
+    if(row < 0 || row >= r->rows)
+        return;
+    for(; *s && col < 0; s++)
+        col++;
+    p = &back[r->row + row][r->col + col];
+    for(; *s && col < r->cols; s++, col++)
+        *p++ = CELL(*s, color);
+    dirty_rows |= 1u << (r->row + row);
+}
+
+/** @brief printf() into a region, one row of up to 80 characters
+ *
+ *  @return void
+ */
+void render_printf(const render_region_t *r, int row, int col, int color,
+    const char *fmt, ...){
+    char line[RENDER_COLS + 1];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    render_text(r, row, col, color, line);
+}
+
+/** @brief Fill the whole region with one character
+ *
+ *  @return void
+ */
+void render_fill(const render_region_t *r, int ch, int color){
+    int row, col;
+
+    for(row = 0; row < r->rows; row++){
+        for(col = 0; col < r->cols; col++)
+            back[r->row + row][r->col + col] = CELL(ch, color);
+        dirty_rows |= 1u << (r->row + row);
+    }
+}
+
+/** @brief Draw a board with its grid
+ *
+ *  Every block is cell_w by cell_h inside the grid, the number on its
+ *  middle row; the whole board takes SIZE * (cell_w + 1) + 1 columns and
+ *  SIZE * (cell_h + 1) + 1 rows. Empty blocks are drawn blank, so the
+ *  board can be drawn again over itself.
+ *
+ *  @param r: the region
+ *         row, col: top left corner of the grid, relative to the region
+ *         board: the board, board[x][y] with x the column
+ *         cell_w, cell_h: size of a block inside the grid
+ *  @return void
+ */
+void render_board(const render_region_t *r, int row, int col,
+    uint16_t board[SIZE][SIZE], int cell_w, int cell_h){
+    char num[8];
+    int x, y, i, j, len, val, top, left, color;
+
+    for(y = 0; y <= SIZE; y++){
+        top = row + y * (cell_h + 1);
+        for(x = 0; x <= SIZE; x++){
+            left = col + x * (cell_w + 1);
+            render_put(r, top, left, '+', GRID_COLOR);
+            for(j = 1; x < SIZE && j <= cell_w; j++)
+                render_put(r, top, left + j, '-', GRID_COLOR);
+            for(i = 1; y < SIZE && i <= cell_h; i++)
+                render_put(r, top + i, left, '|', GRID_COLOR);
+        }
+    }
+    for(x = 0; x < SIZE; x++){
+        for(y = 0; y < SIZE; y++){
+            top = row + y * (cell_h + 1) + 1;
+            left = col + x * (cell_w + 1) + 1;
+            val = board[x][y];
+            for(i = 0; i < cell_h; i++){
+                for(j = 0; j < cell_w; j++)
+                    render_put(r, top + i, left + j, ' ', FGND_LGRAY);
+            }
+            if(val == 0)
+                continue;
+            /* set_color() stops at 2048 */
+            if((color = set_color(val)) == 0)
+                color = FGND_WHITE;
+            len = snprintf(num, sizeof(num), "%d", val);
+            render_text(r, top + (cell_h - 1) / 2,
+                left + (len < cell_w ? (cell_w - len) / 2 : 0), color, num);
+        }
+    }
+}
+
+/** @brief Draw a board without a grid, one row per row of blocks
+ *
+ *  Every block takes cell_w columns. A number that leaves no column free
+ *  in its block is drawn as its power of 2 instead, one base-36 digit
+ *  (b for 2048), so a board of 1-column blocks still fits in 4 by 4.
+ *
+ *  @param r: the region
+ *         row, col: top left corner, relative to the region
+ *         board: the board, board[x][y] with x the column
+ *         cell_w: columns of a block
+ *  @return void
+ */
+void render_mini_board(const render_region_t *r, int row, int col,
+    uint16_t board[SIZE][SIZE], int cell_w){
+    char num[8];
+    int x, y, j, len, val, color, log2v;
+
+    for(x = 0; x < SIZE; x++){
+        for(y = 0; y < SIZE; y++){
+            for(j = 0; j < cell_w; j++)
+                render_put(r, row + y, col + x * cell_w + j, ' ', FGND_LGRAY);
+            val = board[x][y];
+            if(val == 0){
+                render_put(r, row + y, col + (x + 1) * cell_w - 1, '.',
+                    FGND_DGRAY);
+                continue;
+            }
+            if((color = set_color(val)) == 0)
+                color = FGND_WHITE;
+            len = snprintf(num, sizeof(num), "%d", val);
+            if(len < cell_w){
+                render_text(r, row + y, col + (x + 1) * cell_w - len, color,
+                    num);
+                continue;
+            }
+            for(log2v = 0; (1 << log2v) < val; log2v++)
+                continue;
+            render_put(r, row + y, col + (x + 1) * cell_w - 1,
+                log2v < 10 ? '0' + log2v : 'a' + log2v - 10, color);
+        }
+    }
+}
+
+/** @brief Write the changed cells of the dirty rows to the screen
+ *
+ *  @return number of cells written
+ */
+int render_flush(void){
+    int row, col, cells = 0;
+    uint32_t rows = dirty_rows;
+
+    dirty_rows = 0;
+    for(row = 0; rows; row++, rows >>= 1){
+        if(!(rows & 1))
+            continue;
+        for(col = 0; col < RENDER_COLS; col++){
+            if(back[row][col] == front[row][col])
+                continue;
+            front[row][col] = back[row][col];
+            draw_char(row, col, back[row][col] & 0xff, back[row][col] >> 8);
+            cells++;
+        }
+    }
+    return cells;
+}
@@ -0,0 +1,49 @@
+/** @file render.h
+ *
+ *  @brief Drawing into regions of a shadow screen, flushed cell by cell.
+ *
+ *  Everything is drawn into a back buffer of the 80x25 text screen;
+ *  render_flush() then writes to the VGA memory only the cells that
+ *  differ from what is shown, and only in the rows drawn since the last
+ *  flush. Drawing goes through a region, a rectangle of the screen with
+ *  its own origin: coordinates are relative to it and anything outside
+ *  of it is clipped, so several boards can be drawn with the same code
+ *  at different places and never run into each other.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _RENDER_H_
+#define _RENDER_H_
+
+#include <stdint.h>
+#include "engine.h"
+
+#define RENDER_ROWS 25
+#define RENDER_COLS 80
+
+typedef struct
+{
+    int row;                /* top left corner on the screen */
+    int col;
+    int rows;
+    int cols;
+}render_region_t;
+
+void render_reset(void);
+void render_invalidate(const render_region_t *r);
+void render_region(render_region_t *r, int row, int col, int rows,
+    int cols);
+void render_put(const render_region_t *r, int row, int col, int ch,
+    int color);
+void render_text(const render_region_t *r, int row, int col, int color,
+    const char *s);
+void render_printf(const render_region_t *r, int row, int col, int color,
+    const char *fmt, ...);
+void render_fill(const render_region_t *r, int ch, int color);
+void render_board(const render_region_t *r, int row, int col,
+    uint16_t board[SIZE][SIZE], int cell_w, int cell_h);
+void render_mini_board(const render_region_t *r, int row, int col,
+    uint16_t board[SIZE][SIZE], int cell_w);
+int render_flush(void);
+
+#endif
@@ -0,0 +1,555 @@
+/** @file replay.c
+ *
+ *  @brief Streaming reader and writer of the replay format in replay.h.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+
+#include "replay.h"
+
+/* CRC32 (the zlib one), a nibble at a time from a 16-entry table */
+static const uint32_t crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+/** @brief Add bytes to a CRC32
+ *
+ *  @param crc: CRC of the bytes before, 0 to start
+ *         buf: the bytes
+ *         len: number of bytes
+ *  @return the new CRC
+ */
+uint32_t replay_crc32(uint32_t crc, const void *buf, uint32_t len){
+    const uint8_t *p = buf;
+    crc = ~crc;
+    while(len--){
+        crc ^= *p++;
+        crc = (crc >> 4) ^ crc_table[crc & 0xf];
+        crc = (crc >> 4) ^ crc_table[crc & 0xf];
+    }
+    return ~crc;
+}
+
+static void put16(uint8_t *p, uint32_t v){
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v){
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static uint32_t get16(const uint8_t *p){
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p){
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+static int log2_of(uint32_t v){
+    int n = 0;
+    while(v > 1){
+        v >>= 1;
+        n++;
+    }
+    return n;
+}
+
+/*******************************************************
+ * Writer
+ *******************************************************/
+
+/** @brief Write bytes and count them
+ *
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+static int emit(replay_writer_t *w, const void *buf, uint32_t len){
+    if(w->write(w->ctx, buf, len) != 0)
+        return REPLAY_ERR_IO;
+    w->offset += len;
+    return 0;
+}
+
+/** @brief Close buf as a record of len bytes with its CRC and write it
+ *
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+static int write_record(replay_writer_t *w, uint32_t len){
+    put32(w->buf + len, replay_crc32(0, w->buf, len));
+    return emit(w, w->buf, len + 4);
+}
+
+/** @brief Write the moves waiting in the buffer as an 'M' record
+ *
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+static int flush_moves(replay_writer_t *w){
+    uint32_t n = w->n;
+    if(n == 0)
+        return 0;
+    w->n = 0;
+    w->buf[0] = REPLAY_REC_MOVES;
+    put16(w->buf + 1, n);
+    return write_record(w, 3 + (n + 3) / 4);
+}
+
+/** @brief Write a keyframe of the game and add it to the index
+ *
+ *  With the index full, the keyframes off the doubled interval are
+ *  dropped from it first, and this one too if it is off.
+ *
+ *  @param w: the writer
+ *         b: the packed board
+ *         score: score of the game
+ *         rng: state of the game's generator
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+static int write_key(replay_writer_t *w, bboard_t b, uint32_t score,
+    uint32_t rng){
+    int i, n = 0;
+    if(flush_moves(w) != 0)
+        return REPLAY_ERR_IO;
+    if(w->keys == REPLAY_INDEX_MAX){
+        w->interval <<= 1;
+        for(i = 0; i < w->keys; i++){
+            if((w->index[i].move & (w->interval - 1)) == 0)
+                w->index[n++] = w->index[i];
+        }
+        w->keys = (uint16_t)n;
+        if(w->moves & (w->interval - 1))
+            return 0;
+    }
+    w->index[w->keys].move = w->moves;
+    w->index[w->keys].offset = w->offset;
+    w->keys++;
+
+    w->buf[0] = REPLAY_REC_KEY;
+    put32(w->buf + 1, w->moves);
+    put32(w->buf + 5, (uint32_t)b);
+    put32(w->buf + 9, (uint32_t)(b >> 32));
+    put32(w->buf + 13, score);
+    put32(w->buf + 17, rng);
+    return write_record(w, 21);
+}
+
+/** @brief Write the index of the keyframes and the trailer pointing at it
+ *
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+static int write_index(replay_writer_t *w){
+    uint32_t start = w->offset, crc;
+    int i;
+    w->buf[0] = REPLAY_REC_INDEX;
+    put16(w->buf + 1, w->keys);
+    put32(w->buf + 3, w->interval);
+    crc = replay_crc32(0, w->buf, 7);
+    if(emit(w, w->buf, 7) != 0)
+        return REPLAY_ERR_IO;
+    for(i = 0; i < w->keys; i++){
+        put32(w->buf, w->index[i].move);
+        put32(w->buf + 4, w->index[i].offset);
+        crc = replay_crc32(crc, w->buf, 8);
+        if(emit(w, w->buf, 8) != 0)
+            return REPLAY_ERR_IO;
+    }
+    put32(w->buf, crc);
+    put32(w->buf + 4, start);
+    put32(w->buf + 8, REPLAY_INDEX_MAGIC);
+    return emit(w, w->buf, 4 + REPLAY_TRAILER_BYTES);
+}
+
+/** @brief Start a replay and write its header
+ *
+ *  @param w: the writer
+ *         write: where the bytes go
+ *         ctx: passed to write
+ *         h: seed, target and rules of the game
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+int replay_write_begin(replay_writer_t *w, replay_write_fn write, void *ctx,
+    const replay_header_t *h){
+    w->write = write;
+    w->ctx = ctx;
+    w->moves = 0;
+    w->offset = 0;
+    w->interval = REPLAY_KEY_INTERVAL;
+    w->n = 0;
+    w->keys = 0;
+    put32(w->buf, REPLAY_MAGIC);
+    w->buf[4] = REPLAY_VERSION;
+    w->buf[5] = h->rules;
+    w->buf[6] = h->target_score == ENGINE_NO_TARGET ? 0 :
+        (uint8_t)log2_of((uint32_t)h->target_score);
+    w->buf[7] = 0;
+    put32(w->buf + 8, h->seed);
+    return write_record(w, REPLAY_HEADER_BYTES - 4);
+}
+
+/** @brief Is a keyframe due before the next move?
+ *
+ *  @return 1 if it is, 0 if not
+ */
+static int key_due(const replay_writer_t *w){
+    return w->moves != 0 && (w->moves & (w->interval - 1)) == 0;
+}
+
+/** @brief Add a move to the buffer, writing it out when full
+ *
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+static int push_move(replay_writer_t *w, int dir){
+    uint8_t *p = w->buf + 3 + w->n / 4;
+    int shift = (w->n % 4) * 2;
+    if(shift == 0)
+        *p = 0;
+    *p |= (uint8_t)((dir & 3) << shift);
+    w->moves++;
+    if(++w->n == REPLAY_BLOCK_MOVES)
+        return flush_moves(w);
+    return 0;
+}
+
+/** @brief Add a move, given to engine_step() whether it moved or not
+ *
+ *  Every interval moves, a keyframe of the game goes first.
+ *
+ *  @param w: the writer
+ *         g: the game before the move
+ *         dir: MOVE_*
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+int replay_write_move(replay_writer_t *w, game_t *g, int dir){
+    if(key_due(w) &&
+        write_key(w, bb_pack(g->board), (uint32_t)g->score, g->rng) != 0)
+        return REPLAY_ERR_IO;
+    return push_move(w, dir);
+}
+
+/** @brief replay_write_move() for a game played on the packed board
+ *
+ *  @param w: the writer
+ *         b: the board before the move
+ *         score: score before the move
+ *         rng: generator state before the move
+ *         dir: MOVE_*
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+int replay_write_packed(replay_writer_t *w, bboard_t b, uint32_t score,
+    uint32_t rng, int dir){
+    if(key_due(w) && write_key(w, b, score, rng) != 0)
+        return REPLAY_ERR_IO;
+    return push_move(w, dir);
+}
+
+/** @brief Write the last moves, the end record and the index
+ *
+ *  @param w: the writer
+ *         g: the game as it ended
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+int replay_write_end(replay_writer_t *w, game_t *g){
+    return replay_write_end_packed(w, bb_pack(g->board),
+        (uint32_t)g->score);
+}
+
+/** @brief replay_write_end() for a game played on the packed board
+ *
+ *  @param w: the writer
+ *         b: the board as the game ended
+ *         score: the final score
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+int replay_write_end_packed(replay_writer_t *w, bboard_t b, uint32_t score){
+    if(flush_moves(w) != 0)
+        return REPLAY_ERR_IO;
+    w->buf[0] = REPLAY_REC_END;
+    put32(w->buf + 1, w->moves);
+    put32(w->buf + 5, score);
+    w->buf[9] = (uint8_t)bb_max_tile(b);
+    put32(w->buf + 10, (uint32_t)b);
+    put32(w->buf + 14, (uint32_t)(b >> 32));
+    if(write_record(w, 18) != 0)
+        return REPLAY_ERR_IO;
+    return write_index(w);
+}
+
+/*******************************************************
+ * Reader
+ *******************************************************/
+
+/** @brief Read exactly len bytes into buf at off
+ *
+ *  @return 0 on success, REPLAY_ERR_IO
+ */
+static int read_full(replay_reader_t *r, uint32_t off, uint32_t len){
+    while(len > 0){
+        int got = r->read(r->ctx, r->buf + off, len);
+        if(got <= 0)
+            return REPLAY_ERR_IO;
+        off += (uint32_t)got;
+        len -= (uint32_t)got;
+    }
+    return 0;
+}
+
+/** @brief Read the CRC after len bytes of buf and check it
+ *
+ *  @return 0 on success, REPLAY_ERR_IO, REPLAY_ERR_CRC
+ */
+static int check_record(replay_reader_t *r, uint32_t len){
+    if(read_full(r, len, 4) != 0)
+        return REPLAY_ERR_IO;
+    if(get32(r->buf + len) != replay_crc32(0, r->buf, len))
+        return REPLAY_ERR_CRC;
+    return 0;
+}
+
+/** @brief Start reading a replay, the header ends up in r->header
+ *
+ *  @param r: the reader
+ *         read: where the bytes come from
+ *         ctx: passed to read
+ *  @return 0 on success, REPLAY_ERR_*
+ */
+int replay_read_begin(replay_reader_t *r, replay_read_fn read, void *ctx){
+    int ret;
+    r->read = read;
+    r->ctx = ctx;
+    r->moves = 0;
+    r->n = 0;
+    r->pos = 0;
+    r->done = 0;
+    if(read_full(r, 0, REPLAY_HEADER_BYTES - 4) != 0)
+        return REPLAY_ERR_IO;
+    if((ret = check_record(r, REPLAY_HEADER_BYTES - 4)) != 0)
+        return ret;
+    if(get32(r->buf) != REPLAY_MAGIC || r->buf[4] == 0 ||
+        r->buf[4] > REPLAY_VERSION ||
+        r->buf[5] != REPLAY_RULES_CLASSIC || r->buf[6] > 15)
+        return REPLAY_ERR_FORMAT;
+    r->header.version = r->buf[4];
+    r->header.rules = r->buf[5];
+    r->header.target_score = r->buf[6] ? 1 << r->buf[6] : ENGINE_NO_TARGET;
+    r->header.seed = get32(r->buf + 8);
+    return 0;
+}
+
+/** @brief Read the next moves or end record into the buffer
+ *
+ *  Keyframes on the way are checked and skipped.
+ *
+ *  @return 0 for moves, REPLAY_END, REPLAY_ERR_*
+ */
+static int next_record(replay_reader_t *r){
+    uint32_t n;
+    int ret;
+    if(read_full(r, 0, 1) != 0)
+        return REPLAY_ERR_IO;
+    while(r->buf[0] == REPLAY_REC_KEY){
+        if(read_full(r, 1, 20) != 0)
+            return REPLAY_ERR_IO;
+        if((ret = check_record(r, 21)) != 0)
+            return ret;
+        if(read_full(r, 0, 1) != 0)
+            return REPLAY_ERR_IO;
+    }
+    switch(r->buf[0]){
+        case REPLAY_REC_MOVES:
+            if(read_full(r, 1, 2) != 0)
+                return REPLAY_ERR_IO;
+            n = get16(r->buf + 1);
+            if(n == 0 || n > REPLAY_BLOCK_MOVES)
+                return REPLAY_ERR_FORMAT;
+            if(read_full(r, 3, (n + 3) / 4) != 0)
+                return REPLAY_ERR_IO;
+            if((ret = check_record(r, 3 + (n + 3) / 4)) != 0)
+                return ret;
+            r->n = (uint16_t)n;
+            r->pos = 0;
+            return 0;
+        case REPLAY_REC_END:
+            n = r->header.version < 3 ? 10 : 18;
+            if(read_full(r, 1, n - 1) != 0)
+                return REPLAY_ERR_IO;
+            if((ret = check_record(r, n)) != 0)
+                return ret;
+            r->end.moves = get32(r->buf + 1);
+            r->end.score = get32(r->buf + 5);
+            r->end.max_tile = r->buf[9] ? 1 << r->buf[9] : 0;
+            r->end.board = 0;
+            if(n == 18)
+                r->end.board = get32(r->buf + 10) |
+                    ((bboard_t)get32(r->buf + 14) << 32);
+            if(r->end.moves != r->moves)
+                return REPLAY_ERR_FORMAT;
+            r->done = 1;
+            return REPLAY_END;
+        default:
+            return REPLAY_ERR_FORMAT;
+    }
+}
+
+/** @brief Next move of the replay
+ *
+ *  @param r: the reader
+ *  @return MOVE_*, REPLAY_END after the last one (r->end is then
+ *          valid), REPLAY_ERR_* on a broken replay
+ */
+int replay_read_move(replay_reader_t *r){
+    int ret;
+    if(r->done)
+        return REPLAY_END;
+    if(r->pos == r->n){
+        if((ret = next_record(r)) != 0)
+            return ret;
+    }
+    ret = (r->buf[3 + r->pos / 4] >> ((r->pos % 4) * 2)) & 3;
+    r->pos++;
+    r->moves++;
+    return ret;
+}
+
+/** @brief Find the last keyframe at or before a move in the index
+ *
+ *  @param r: the reader
+ *         seek: how to move in the replay
+ *         move: the move looked for
+ *         key: the keyframe found, move 0 if there is none
+ *  @return 0 on success, REPLAY_ERR_*
+ */
+static int find_key(replay_reader_t *r, replay_seek_fn seek, uint32_t move,
+    replay_index_t *key){
+    uint32_t count, crc, m;
+    uint32_t i;
+    key->move = 0;
+    key->offset = 0;
+    if(r->header.version < 2)
+        return 0;
+    if(seek(r->ctx, -REPLAY_TRAILER_BYTES, 1) != 0 ||
+        read_full(r, 0, REPLAY_TRAILER_BYTES) != 0)
+        return REPLAY_ERR_IO;
+    if(get32(r->buf + 4) != REPLAY_INDEX_MAGIC)
+        return REPLAY_ERR_FORMAT;
+    if(seek(r->ctx, (int32_t)get32(r->buf), 0) != 0 ||
+        read_full(r, 0, 7) != 0)
+        return REPLAY_ERR_IO;
+    count = get16(r->buf + 1);
+    if(r->buf[0] != REPLAY_REC_INDEX || count > REPLAY_INDEX_MAX)
+        return REPLAY_ERR_FORMAT;
+    crc = replay_crc32(0, r->buf, 7);
+    for(i = 0; i < count; i++){
+        if(read_full(r, 0, 8) != 0)
+            return REPLAY_ERR_IO;
+        crc = replay_crc32(crc, r->buf, 8);
+        m = get32(r->buf);
+        if(m <= move && m > key->move){
+            key->move = m;
+            key->offset = get32(r->buf + 4);
+        }
+    }
+    if(read_full(r, 0, 4) != 0)
+        return REPLAY_ERR_IO;
+    if(get32(r->buf) != crc)
+        return REPLAY_ERR_CRC;
+    return 0;
+}
+
+/** @brief Jump to the game after a number of moves
+ *
+ *  Starts from the nearest keyframe of the index (or from the start of
+ *  a replay without one) and plays the moves after it. Reading goes on
+ *  from there with replay_read_move().
+ *
+ *  @param r: the reader, after replay_read_begin()
+ *         seek: how to move in the replay
+ *         g: where the game is set up
+ *         move: number of moves to be played
+ *  @return 0 on success, REPLAY_END if the replay is shorter (g is then
+ *          the end of it), REPLAY_ERR_*
+ */
+int replay_seek(replay_reader_t *r, replay_seek_fn seek, game_t *g,
+    uint32_t move){
+    replay_index_t key;
+    bboard_t b;
+    int ret;
+
+    if((ret = find_key(r, seek, move, &key)) != 0)
+        return ret;
+    if(key.move == 0){
+        if(seek(r->ctx, REPLAY_HEADER_BYTES, 0) != 0)
+            return REPLAY_ERR_IO;
+        replay_start(g, &r->header);
+    }else{
+        if(seek(r->ctx, (int32_t)key.offset, 0) != 0 ||
+            read_full(r, 0, 21) != 0)
+            return REPLAY_ERR_IO;
+        if((ret = check_record(r, 21)) != 0)
+            return ret;
+        if(r->buf[0] != REPLAY_REC_KEY || get32(r->buf + 1) != key.move)
+            return REPLAY_ERR_FORMAT;
+        b = get32(r->buf + 5) | ((bboard_t)get32(r->buf + 9) << 32);
+        engine_init(g, get32(r->buf + 17), r->header.target_score);
+        bb_unpack(b, g->board);
+        g->score = (int)get32(r->buf + 13);
+    }
+    r->moves = key.move;
+    r->n = 0;
+    r->pos = 0;
+    r->done = 0;
+    while(r->moves < move){
+        if((ret = replay_read_move(r)) < 0)
+            return ret;
+        engine_step(g, ret);
+    }
+    return 0;
+}
+
+/*******************************************************
+ * Playing back
+ *******************************************************/
+
+/** @brief Set up the game a replay starts from
+ *
+ *  The same as the start of engine_play(): a fresh game with the seed
+ *  and the two first numbers. Every move of the replay then goes
+ *  through engine_step().
+ *
+ *  @param g: the game
+ *         h: header of the replay
+ *  @return void
+ */
+void replay_start(game_t *g, const replay_header_t *h){
+    engine_init(g, h->seed, h->target_score);
+    engine_add_random(g);
+    engine_add_random(g);
+}
+
+/** @brief Check a played back game against the end record
+ *
+ *  @param g: the game after the last move
+ *         end: the end record
+ *         moves: moves played
+ *  @return 0 if everything matches, -1 if not
+ */
+int replay_check(game_t *g, const replay_end_t *end,
+    uint32_t moves){
+    int x, y, max = 0;
+    for(x = 0; x < SIZE; x++){
+        for(y = 0; y < SIZE; y++){
+            if(g->board[x][y] > max)
+                max = g->board[x][y];
+        }
+    }
+    if(moves != end->moves || (uint32_t)g->score != end->score ||
+        max != end->max_tile)
+        return -1;
+    if(end->board != 0 && bb_pack(g->board) != end->board)
+        return -1;
+    return 0;
+}
@@ -0,0 +1,144 @@
+/** @file replay.h
+ *
+ *  @brief Compact replays: the seed of a game and its moves, 2 bits each.
+ *
+ *  The new blocks are not stored, they come back from the seed through
+ *  the engine's own generator. A replay is a 16-byte header followed by
+ *  records, each closed by a CRC32:
+ *
+ *    header  "2RPL", version, rules, log2(target) or 0 for none, 0, seed,
+ *            crc
+ *    'M'     count (u16), count moves packed 4 per byte, crc
+ *    'K'     move (u32), packed board (u64), score (u32), rng (u32), crc
+ *    'E'     moves (u32), score (u32), log2(max tile), packed board (u64),
+ *            crc
+ *    'I'     count (u16), interval (u32), count x (move, offset), crc
+ *    trailer offset of 'I' (u32), "2RPI"
+ *
+ *  A keyframe 'K' holds the game after its number of moves and starts a
+ *  new 'M' record, so a reader can jump to it and play on from there.
+ *  The index after the end lists the keyframes; when it is full, every
+ *  other entry is dropped and the interval doubles, so seeking costs at
+ *  most one interval of moves however long the game is.
+ *
+ *  All numbers are little endian. Reader and writer stream through
+ *  callbacks and a fixed buffer of one record, nothing is allocated, so
+ *  the same code runs in the kernel and in the host tools.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <stdint.h>
+#include "engine.h"
+#include "bitboard.h"
+
+#define REPLAY_MAGIC    0x4c505232  /* "2RPL" */
+#define REPLAY_INDEX_MAGIC 0x49505232  /* "2RPI" */
+/* Version 1 has no keyframes and no index, version 2 no board in 'E' */
+#define REPLAY_VERSION  3
+/* The only rules so far: 4x4, a 4 with p = 1/3, new block after a move
+ * that changed the board */
+#define REPLAY_RULES_CLASSIC 0
+
+#define REPLAY_HEADER_BYTES 16
+/* Moves in a full 'M' record */
+#define REPLAY_BLOCK_MOVES  256
+#define REPLAY_BLOCK_BYTES  (3 + REPLAY_BLOCK_MOVES / 4 + 4)
+/* Moves between keyframes at the start, a power of 2 */
+#define REPLAY_KEY_INTERVAL 512
+/* Entries of the index */
+#define REPLAY_INDEX_MAX    64
+#define REPLAY_TRAILER_BYTES 8
+
+#define REPLAY_REC_MOVES    'M'
+#define REPLAY_REC_KEY      'K'
+#define REPLAY_REC_END      'E'
+#define REPLAY_REC_INDEX    'I'
+
+/* Results of the reader and writer, moves are >= 0 */
+#define REPLAY_END          -1
+#define REPLAY_ERR_IO       -2
+#define REPLAY_ERR_CRC      -3
+#define REPLAY_ERR_FORMAT   -4
+
+/* Write len bytes, 0 on success */
+typedef int (*replay_write_fn)(void *ctx, const void *buf, uint32_t len);
+/* Read up to len bytes, returns the bytes read */
+typedef int (*replay_read_fn)(void *ctx, void *buf, uint32_t len);
+/* Go to off bytes from the start, or from the end with from_end, 0 on
+ * success */
+typedef int (*replay_seek_fn)(void *ctx, int32_t off, int from_end);
+
+typedef struct
+{
+    uint8_t version;
+    uint8_t rules;
+    int target_score;
+    uint32_t seed;
+}replay_header_t;
+
+/* What the game ended with, checked when the replay is played back */
+typedef struct
+{
+    uint32_t moves;
+    uint32_t score;
+    int max_tile;
+    bboard_t board;         /* 0 before version 3 */
+}replay_end_t;
+
+typedef struct
+{
+    uint32_t move;
+    uint32_t offset;        /* of the 'K' record */
+}replay_index_t;
+
+typedef struct
+{
+    replay_write_fn write;
+    void *ctx;
+    uint32_t moves;         /* moves written */
+    uint32_t offset;        /* bytes written */
+    uint32_t interval;      /* moves between keyframes */
+    uint16_t n;             /* moves waiting in buf */
+    uint16_t keys;          /* entries in index */
+    replay_index_t index[REPLAY_INDEX_MAX];
+    uint8_t buf[REPLAY_BLOCK_BYTES];
+}replay_writer_t;
+
+typedef struct
+{
+    replay_read_fn read;
+    void *ctx;
+    replay_header_t header;
+    replay_end_t end;       /* valid once REPLAY_END is returned */
+    uint32_t moves;         /* moves returned */
+    uint16_t n;             /* moves in buf */
+    uint16_t pos;           /* next move in buf */
+    int done;
+    uint8_t buf[REPLAY_BLOCK_BYTES];
+}replay_reader_t;
+
+/* Writing */
+int replay_write_begin(replay_writer_t *w, replay_write_fn write, void *ctx,
+    const replay_header_t *h);
+int replay_write_move(replay_writer_t *w, game_t *g, int dir);
+int replay_write_end(replay_writer_t *w, game_t *g);
+int replay_write_packed(replay_writer_t *w, bboard_t b, uint32_t score,
+    uint32_t rng, int dir);
+int replay_write_end_packed(replay_writer_t *w, bboard_t b, uint32_t score);
+
+/* Reading */
+int replay_read_begin(replay_reader_t *r, replay_read_fn read, void *ctx);
+int replay_read_move(replay_reader_t *r);
+int replay_seek(replay_reader_t *r, replay_seek_fn seek, game_t *g,
+    uint32_t move);
+
+/* Playing back */
+void replay_start(game_t *g, const replay_header_t *h);
+int replay_check(game_t *g, const replay_end_t *end,
+    uint32_t moves);
+uint32_t replay_crc32(uint32_t crc, const void *buf, uint32_t len);
+
+#endif
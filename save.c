@@ -0,0 +1,341 @@
+/** @file save.c
+ *
+ *  @brief Saved game on a disk sector, see save.h.
+ *
+ *  A write first reads the sector, a few words at a time, and checks
+ *  that it may be written over; then it sends WRITE SECTORS, the data a
+ *  few words at a time and a cache flush. Between them the drive is
+ *  busy and save_poll() returns at once. A save asked for while one is
+ *  being written is kept and written after it, only the latest one.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug Only the primary master is looked at.
+ */
+#include <x86/asm.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "replay.h"
+#include "serial.h"
+#include "save.h"
+
+#define SECTOR_WORDS (SAVE_SECTOR_SIZE / 2)
+
+/* States of a write */
+#define ST_IDLE    0
+#define ST_READY   1    /* drive busy from before */
+#define ST_PEEK    2    /* READ SECTORS sent, the sector as it is */
+#define ST_CHECKED 3    /* the sector may be written over */
+#define ST_DATA    4    /* WRITE SECTORS sent */
+#define ST_WRITE   5    /* data sent, being written */
+#define ST_FLUSH   6    /* cache flush sent */
+
+static uint32_t save_lba = SAVE_LBA_NONE;
+
+static int state = ST_IDLE;
+static uint16_t sector[SECTOR_WORDS];
+static uint16_t old[SECTOR_WORDS];  /* the sector read from the disk */
+static int words;                   /* words of sector[] or old[] moved */
+static save_record_t next;          /* asked for while writing */
+static int next_waiting = 0;
+static int32_t writing_score;
+static unsigned long started;       /* ticks at save_start() */
+static unsigned long waited;        /* ticks when the drive last moved on */
+
+/** @brief Sector of the saved game, saving is off until it is given
+ *
+ *  @param lba: sector number, 28 bits, not 0
+ *  @return 0 on success, -1 for a sector that cannot be used
+ */
+int save_set_lba(uint32_t lba){
+    if(lba == SAVE_LBA_NONE || lba > 0x0fffffff)
+        return -1;
+    save_lba = lba;
+    return 0;
+}
+
+/** @brief Text of an error, as sent to COM1
+ *
+ *  @return the reason
+ */
+const char *save_reason(int err){
+    switch(err){
+        case SAVE_ERR_NO_DISK:
+            return "no-disk";
+        case SAVE_ERR_DEVICE:
+            return "device";
+        case SAVE_ERR_TIMEOUT:
+            return "timeout";
+        case SAVE_ERR_OFF:
+            return "off";
+        case SAVE_ERR_IN_USE:
+            return "in-use";
+        default:
+            return "empty";
+    }
+}
+
+/** @brief The 400ns the drive needs after being selected
+ *
+ *  @return void
+ */
+static void ata_delay(void){
+    int i;
+
+    for(i = 0; i < 4; i++)
+        (void)inb(ATA_CTRL);
+}
+
+/** @brief Select the sector and send a command
+ *
+ *  @return void
+ */
+static void ata_command(uint8_t cmd){
+    outb(ATA_CTRL, ATA_CTRL_NIEN);
+    outb(ATA_IO + ATA_DRIVE, ATA_DRIVE_LBA | ((save_lba >> 24) & 0x0f));
+    ata_delay();
+    outb(ATA_IO + ATA_COUNT, 1);
+    outb(ATA_IO + ATA_LBA0, save_lba & 0xff);
+    outb(ATA_IO + ATA_LBA1, (save_lba >> 8) & 0xff);
+    outb(ATA_IO + ATA_LBA2, (save_lba >> 16) & 0xff);
+    outb(ATA_IO + ATA_STATUS, cmd);
+    ata_delay();
+}
+
+/** @brief Reset the drive after an error, it may be stuck in a command
+ *
+ *  @return void
+ */
+static void ata_reset(void){
+    outb(ATA_CTRL, ATA_CTRL_SRST | ATA_CTRL_NIEN);
+    ata_delay();
+    outb(ATA_CTRL, ATA_CTRL_NIEN);
+}
+
+/** @brief Error shown by a status, if any
+ *
+ *  @return SAVE_ERR_*, or 0 if there is none
+ */
+static int ata_error(uint8_t status){
+    if(status == ATA_ST_NONE)
+        return SAVE_ERR_NO_DISK;
+    if(!(status & ATA_ST_BSY) && (status & (ATA_ST_ERR | ATA_ST_DF)))
+        return SAVE_ERR_DEVICE;
+    return 0;
+}
+
+/** @brief CRC of a record, over the fields before the CRC
+ *
+ *  @return the CRC
+ */
+static uint32_t record_crc(const save_record_t *rec){
+    return replay_crc32(0, rec, (uint32_t)offsetof(save_record_t, crc));
+}
+
+/** @brief May the sector read into old[] be written over?
+ *
+ *  @return 1 if it is all zeros or a saved game, 0 if not
+ */
+static int sector_ours(void){
+    const save_record_t *rec = (const save_record_t *)old;
+    int i;
+
+    if(rec->magic == SAVE_MAGIC && rec->version == SAVE_VERSION)
+        return 1;
+    for(i = 0; i < SECTOR_WORDS; i++){
+        if(old[i] != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/** @brief Put a record into the sector and start writing it
+ *
+ *  @return void
+ */
+static void begin(const save_record_t *rec, unsigned long ticks){
+    memset(sector, 0, sizeof(sector));
+    memcpy(sector, rec, sizeof(*rec));
+    writing_score = rec->score;
+    words = 0;
+    started = ticks;
+    waited = ticks;
+    state = ST_READY;
+}
+
+/** @brief Save a game, written by the following save_poll()s
+ *
+ *  @param rec: the game, magic, version and CRC are filled in here
+ *         ticks: the timer's tick count
+ *  @return SAVE_OK, SAVE_ERR_OFF (reported to COM1) without a sector
+ */
+int save_start(save_record_t *rec, unsigned long ticks){
+    if(save_lba == SAVE_LBA_NONE){
+        serial_printf("save=error reason=%s lba=0\n",
+            save_reason(SAVE_ERR_OFF));
+        return SAVE_ERR_OFF;
+    }
+    rec->magic = SAVE_MAGIC;
+    rec->version = SAVE_VERSION;
+    rec->crc = record_crc(rec);
+    if(state != ST_IDLE){
+        next = *rec;
+        next_waiting = 1;
+        return SAVE_OK;
+    }
+    begin(rec, ticks);
+    return SAVE_OK;
+}
+
+/** @brief Move the write on as far as the drive allows, never waiting
+ *
+ *  Called from the idle loop.
+ *
+ *  @param ticks: the timer's tick count
+ *  @return 1 when a write just finished, SAVE_ERR_* when it just failed,
+ *          0 otherwise
+ */
+int save_poll(unsigned long ticks){
+    uint8_t status;
+    int err, n;
+
+    if(state == ST_IDLE)
+        return 0;
+    status = inb(ATA_IO + ATA_STATUS);
+    if((err = ata_error(status)) != 0)
+        goto fail;
+    /* Still busy, or not yet ready to move the data */
+    if((status & ATA_ST_BSY) || ((state == ST_PEEK || state == ST_DATA) &&
+        !(status & ATA_ST_DRQ))){
+        if(ticks - waited > SAVE_TIMEOUT_TICKS){
+            err = SAVE_ERR_TIMEOUT;
+            goto fail;
+        }
+        return 0;
+    }
+    waited = ticks;
+    switch(state){
+        case ST_READY:
+            ata_command(ATA_CMD_READ);
+            state = ST_PEEK;
+            return 0;
+        case ST_PEEK:
+            for(n = 0; n < SAVE_WORDS_PER_POLL && words < SECTOR_WORDS; n++)
+                old[words++] = inw(ATA_IO + ATA_DATA);
+            if(words < SECTOR_WORDS)
+                return 0;
+            if(!sector_ours()){
+                err = SAVE_ERR_IN_USE;
+                goto fail;
+            }
+            words = 0;
+            state = ST_CHECKED;
+            return 0;
+        case ST_CHECKED:
+            ata_command(ATA_CMD_WRITE);
+            state = ST_DATA;
+            return 0;
+        case ST_DATA:
+            for(n = 0; n < SAVE_WORDS_PER_POLL && words < SECTOR_WORDS; n++)
+                outw(ATA_IO + ATA_DATA, sector[words++]);
+            if(words == SECTOR_WORDS)
+                state = ST_WRITE;
+            return 0;
+        case ST_WRITE:
+            outb(ATA_IO + ATA_STATUS, ATA_CMD_FLUSH);
+            ata_delay();
+            state = ST_FLUSH;
+            return 0;
+    }
+    /* Flushed */
+    serial_printf("save=ok lba=%u score=%d ms=%lu\n", (unsigned int)save_lba,
+        (int)writing_score, (ticks - started) * 1000 / TIMER_HZ);
+    state = ST_IDLE;
+    if(next_waiting){
+        next_waiting = 0;
+        begin(&next, ticks);
+    }
+    return 1;
+
+fail:
+    serial_printf("save=error reason=%s lba=%u\n", save_reason(err),
+        (unsigned int)save_lba);
+    if(err == SAVE_ERR_DEVICE || err == SAVE_ERR_TIMEOUT)
+        ata_reset();
+    state = ST_IDLE;
+    next_waiting = 0;
+    return err;
+}
+
+/** @brief Finish the writes asked for, waiting for the drive
+ *
+ *  For when the idle loop stops calling save_poll().
+ *
+ *  @param ticks: clock, TIMER_HZ ticks a second
+ *  @return void
+ */
+void save_flush(unsigned long (*ticks)(void)){
+    while(state != ST_IDLE)
+        save_poll(ticks());
+}
+
+/** @brief Wait for the drive, up to SAVE_TIMEOUT_TICKS
+ *
+ *  @param mask: status bits that must be set once it is not busy
+ *  @return 0 on success, SAVE_ERR_* on failure
+ */
+static int ata_wait(uint8_t mask, unsigned long (*ticks)(void)){
+    unsigned long start = ticks();
+    uint8_t status;
+    int err;
+
+    while(1){
+        status = inb(ATA_IO + ATA_STATUS);
+        if((err = ata_error(status)) != 0)
+            return err;
+        if(!(status & ATA_ST_BSY) && (status & mask) == mask)
+            return 0;
+        if(ticks() - start > SAVE_TIMEOUT_TICKS)
+            return SAVE_ERR_TIMEOUT;
+    }
+}
+
+/** @brief Read the saved game, waiting for the drive
+ *
+ *  A save still being written is finished first.
+ *
+ *  @param rec: where the game goes
+ *         ticks: clock, TIMER_HZ ticks a second
+ *  @return SAVE_OK, or SAVE_ERR_* (reported to COM1)
+ */
+int save_load(save_record_t *rec, unsigned long (*ticks)(void)){
+    int err, i;
+
+    save_flush(ticks);
+    if(save_lba == SAVE_LBA_NONE){
+        serial_printf("resume=error reason=%s\n", save_reason(SAVE_ERR_OFF));
+        return SAVE_ERR_OFF;
+    }
+    if((err = ata_wait(0, ticks)) == 0){
+        ata_command(ATA_CMD_READ);
+        if((err = ata_wait(ATA_ST_DRQ, ticks)) == 0){
+            for(i = 0; i < SECTOR_WORDS; i++)
+                old[i] = inw(ATA_IO + ATA_DATA);
+        }
+    }
+    if(err == 0){
+        memcpy(rec, old, sizeof(*rec));
+        if(rec->magic != SAVE_MAGIC || rec->version != SAVE_VERSION ||
+            rec->crc != record_crc(rec))
+            err = SAVE_ERR_EMPTY;
+    }
+    if(err != 0){
+        if(err == SAVE_ERR_DEVICE || err == SAVE_ERR_TIMEOUT)
+            ata_reset();
+        serial_printf("resume=error reason=%s\n", save_reason(err));
+        return err;
+    }
+    serial_printf("resume=ok score=%d target=%d seconds=%d\n",
+        (int)rec->score, (int)rec->target_score, (int)rec->seconds);
+    return SAVE_OK;
+}
@@ -0,0 +1,98 @@
+/** @file save.h
+ *
+ *  @brief Saved game on a disk sector: one game in progress, written in
+ *         the background and read back from the welcome page.
+ *
+ *  The sector is on the primary ATA master and has to be reserved with
+ *  the "save=LBA" boot option; without it nothing is read or written.
+ *  LBA 0, the boot sector, is refused. Before each write the sector is
+ *  read back, and it is only written over if it is all zeros or already
+ *  holds a saved game, so a wrong LBA cannot wipe someone's data.
+ *
+ *  The drive is driven by PIO with its interrupt off. A write goes
+ *  through a few states, and each save_poll() from the idle loop moves
+ *  it on as far as the drive allows without waiting, so the game never
+ *  stops for the disk. Reading is done at once, before the game starts.
+ *
+ *  The record is checked with a CRC when it is read. Results go to COM1:
+ *
+ *    save=ok lba=N score=N ms=N
+ *    save=error reason=off|no-disk|device|timeout|in-use lba=N
+ *    resume=ok score=N target=N seconds=N
+ *    resume=error reason=off|no-disk|device|timeout|empty
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _SAVE_H_
+#define _SAVE_H_
+
+#include <stdint.h>
+#include "int.h"
+
+/* Primary ATA channel and its registers */
+#define ATA_IO          0x1f0
+#define ATA_CTRL        0x3f6       /* device control, alternate status */
+#define ATA_DATA        0
+#define ATA_COUNT       2
+#define ATA_LBA0        3
+#define ATA_LBA1        4
+#define ATA_LBA2        5
+#define ATA_DRIVE       6
+#define ATA_STATUS      7           /* command when written */
+
+#define ATA_ST_ERR      0x01
+#define ATA_ST_DRQ      0x08
+#define ATA_ST_DF       0x20
+#define ATA_ST_BSY      0x80
+#define ATA_ST_NONE     0xff        /* nothing on the bus */
+
+#define ATA_CTRL_NIEN   0x02        /* no interrupt */
+#define ATA_CTRL_SRST   0x04        /* software reset */
+#define ATA_DRIVE_LBA   0xe0        /* master, LBA addressing */
+
+#define ATA_CMD_READ    0x20
+#define ATA_CMD_WRITE   0x30
+#define ATA_CMD_FLUSH   0xe7
+
+#define SAVE_SECTOR_SIZE 512
+/* No sector given, saving is off */
+#define SAVE_LBA_NONE    0
+/* Words written to the drive per save_poll() */
+#define SAVE_WORDS_PER_POLL 64
+/* The drive may stay busy this long, 5 seconds in timer ticks */
+#define SAVE_TIMEOUT_TICKS (5 * TIMER_HZ)
+
+#define SAVE_MAGIC      0x45564153  /* "SAVE" */
+#define SAVE_VERSION    1
+
+/* Results */
+#define SAVE_OK          0
+#define SAVE_ERR_NO_DISK -1
+#define SAVE_ERR_DEVICE  -2
+#define SAVE_ERR_TIMEOUT -3
+#define SAVE_ERR_EMPTY   -4         /* no record, or a bad one */
+#define SAVE_ERR_OFF     -5         /* no sector given */
+#define SAVE_ERR_IN_USE  -6         /* the sector holds something else */
+
+/* Start of the sector, the rest is zero */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t board;         /* bb_pack() of the board */
+    int32_t score;
+    int32_t best_score;
+    int32_t target_score;
+    int32_t seconds;        /* TIME on the UI */
+    uint32_t rng;
+    uint32_t crc;           /* replay_crc32() of the fields above */
+}save_record_t;
+
+int save_set_lba(uint32_t lba);
+int save_start(save_record_t *rec, unsigned long ticks);
+int save_poll(unsigned long ticks);
+void save_flush(unsigned long (*ticks)(void));
+int save_load(save_record_t *rec, unsigned long (*ticks)(void));
+const char *save_reason(int err);
+
+#endif
@@ -0,0 +1,255 @@
+/** @file script.c
+ *
+ *  @brief Scripted input from COM1, see script.h.
+ *
+ *  The queue has one writer, script_poll() in the game loop, and one
+ *  reader, script_next() in the timer interrupt, so neither needs a
+ *  lock: each only moves its own end of the queue.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <stdlib.h>
+#include <x86/asm.h>
+
+#include "serial.h"
+#include "prof.h"
+#include "capture.h"
+#include "script.h"
+
+#define QUEUE_MASK (SCRIPT_QUEUE - 1)
+
+/* Set 1 scancodes */
+#define SC_LSHIFT 0x2a
+#define SC_BREAK  0x80
+
+/* Keeps the stores to the queue before the store of its head */
+#define barrier() __asm__ __volatile__("" ::: "memory")
+
+typedef struct
+{
+    uint16_t delay;         /* ticks to wait before it, first scancode */
+    uint8_t scancode;
+    uint8_t first;          /* first scancode of a key */
+}script_code_t;
+
+/* Rows of the keyboard, scancode of the first key of each */
+static const struct
+{
+    uint8_t scancode;
+    const char *keys;
+}rows[] = {
+    { 0x02, "1234567890-=" },
+    { 0x10, "qwertyuiop" },
+    { 0x1e, "asdfghjkl" },
+    { 0x2c, "zxcvbnm" },
+    { 0x39, " " },
+};
+#define ROWS ((int)(sizeof(rows) / sizeof(rows[0])))
+
+static script_code_t queue[SCRIPT_QUEUE];
+static volatile uint32_t q_head = 0;    /* written by script_poll() */
+static volatile uint32_t q_tail = 0;    /* written by script_next() */
+
+/* Reader side, in the timer interrupt */
+static unsigned long next_at;
+static int waiting = 0;
+static volatile uint32_t sent = 0;
+
+/* Writer side */
+static char line[SCRIPT_LINE];
+static int line_len = 0;
+static int line_long = 0;
+static uint16_t delay_ticks = 0;
+static int busy = 0;
+
+/** @brief Scancode of a character, and whether it needs shift
+ *
+ *  @return the scancode, -1 for a character without a key
+ */
+static int scancode_of(int c, int *shift){
+    const char *k;
+    int i;
+
+    *shift = 0;
+    if(c >= 'A' && c <= 'Z'){
+        *shift = 1;
+        c += 'a' - 'A';
+    }else if(c == '+'){
+        *shift = 1;
+        c = '=';
+    }
+    for(i = 0; i < ROWS; i++){
+        for(k = rows[i].keys; *k; k++){
+            if(*k == c)
+                return rows[i].scancode + (int)(k - rows[i].keys);
+        }
+    }
+    return -1;
+}
+
+/** @brief Queue a key: make and break, with shift around them if needed
+ *
+ *  @return 0 on success, -1 if there is no such key, -2 if the queue is
+ *          full
+ */
+static int queue_key(int c){
+    uint32_t head = q_head;
+    int sc, shift, n, i;
+    uint8_t codes[4];
+
+    if((sc = scancode_of(c, &shift)) < 0)
+        return -1;
+    n = 0;
+    if(shift)
+        codes[n++] = SC_LSHIFT;
+    codes[n++] = (uint8_t)sc;
+    codes[n++] = (uint8_t)sc | SC_BREAK;
+    if(shift)
+        codes[n++] = SC_LSHIFT | SC_BREAK;
+    if(SCRIPT_QUEUE - (head - q_tail) < (uint32_t)n)
+        return -2;
+    for(i = 0; i < n; i++){
+        queue[(head + i) & QUEUE_MASK].scancode = codes[i];
+        queue[(head + i) & QUEUE_MASK].delay = i == 0 ? delay_ticks : 0;
+        queue[(head + i) & QUEUE_MASK].first = i == 0;
+    }
+    barrier();
+    q_head = head + n;
+    busy = 1;
+    return 0;
+}
+
+/** @brief Drop the keys not sent yet
+ *
+ *  A key partly sent is finished, so no key is left held down.
+ *
+ *  @return void
+ */
+static void cancel(void){
+    uint32_t i;
+
+    disable_interrupts();
+    for(i = q_tail; i != q_head; i++){
+        if(queue[i & QUEUE_MASK].first)
+            break;
+    }
+    q_head = i;
+    waiting = 0;
+    enable_interrupts();
+}
+
+/** @brief Run one command line
+ *
+ *  @return void
+ */
+static void run_line(void){
+    static const char move_keys[] = "udlr";
+    static const char keys[] = "wsad";     /* MOVE_* order */
+    const char *arg = line + 1, *m;
+    int n = 0, ret = 0;
+
+    if(*arg == ' ')
+        arg++;
+    switch(line[0]){
+        case SCRIPT_KEYS:
+            for(; *arg && ret == 0; arg++)
+                n += (ret = queue_key(*arg)) == 0;
+            break;
+        case SCRIPT_MOVES:
+            for(; *arg && ret == 0; arg++){
+                if(*arg == ' ')
+                    continue;
+                for(m = move_keys; *m && *m != *arg; m++)
+                    continue;
+                if(*m == '\0')
+                    ret = -1;
+                else
+                    n += (ret = queue_key(keys[m - move_keys])) == 0;
+            }
+            break;
+        case SCRIPT_DELAY:
+            /* Milliseconds to 10ms ticks, rounded up */
+            n = atoi(arg);
+            delay_ticks = (uint16_t)(n > 0 ? (n + 9) / 10 : 0);
+            serial_printf("script=delay ticks=%u\n",
+                (unsigned int)delay_ticks);
+            return;
+        case SCRIPT_CANCEL:
+            cancel();
+            serial_printf("script=cancelled pending=%u\n",
+                (unsigned int)(q_head - q_tail));
+            return;
+        case SCRIPT_CAPTURE:
+            capture_dump();
+            return;
+        default:
+            serial_printf("script=error reason=command\n");
+            return;
+    }
+    if(ret == -1)
+        serial_printf("script=error reason=key keys=%d\n", n);
+    else if(ret == -2)
+        serial_printf("script=error reason=full keys=%d\n", n);
+    else
+        serial_printf("script=queued keys=%d pending=%u\n", n,
+            (unsigned int)(q_head - q_tail));
+}
+
+/** @brief Read the commands waiting on COM1
+ *
+ *  Called from the idle loops; also reports when the queue ran empty.
+ *
+ *  @return void
+ */
+void script_poll(void){
+    int c;
+
+    while((c = serial_poll()) >= 0){
+        if(line_len == 0 && !line_long && prof_command(c))
+            continue;
+        if(c == '\r' || c == '\n'){
+            line[line_len] = '\0';
+            if(line_long)
+                serial_printf("script=error reason=long\n");
+            else if(line_len > 0)
+                run_line();
+            line_len = 0;
+            line_long = 0;
+        }else if(line_len < SCRIPT_LINE - 1){
+            line[line_len++] = (char)c;
+        }else{
+            line_long = 1;
+        }
+    }
+    if(busy && q_tail == q_head){
+        busy = 0;
+        serial_printf("script=done scancodes=%u\n", (unsigned int)sent);
+    }
+}
+
+/** @brief Next scancode due, called by the timer interrupt
+ *
+ *  @param ticks: the timer's tick count
+ *  @return the scancode, -1 if none is due
+ */
+int script_next(unsigned long ticks){
+    uint32_t tail = q_tail;
+    script_code_t *e;
+
+    if(tail == q_head)
+        return -1;
+    e = &queue[tail & QUEUE_MASK];
+    if(e->delay){
+        if(!waiting){
+            next_at = ticks + e->delay;
+            waiting = 1;
+        }
+        if(ticks < next_at)
+            return -1;
+        waiting = 0;
+    }
+    q_tail = tail + 1;
+    sent++;
+    return e->scancode;
+}
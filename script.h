@@ -0,0 +1,51 @@
+/** @file script.h
+ *
+ *  @brief Scripted input from COM1, fed to the keyboard buffer.
+ *
+ *  Commands are text lines sent to COM1, answered with one line each:
+ *
+ *    k TEXT      type TEXT: letters, digits, space, - = + (shift added
+ *                for capitals and +)
+ *    m MOVES     moves, u d l r, typed as w s a d
+ *    t MS        wait MS milliseconds before each key queued after it,
+ *                0 (the default) sends keys as fast as the buffer takes
+ *    c           drop the keys not sent yet
+ *    g           capture the screen (capture.h), answered by the capture
+ *
+ *    script=queued keys=N pending=N      (k, m)
+ *    script=delay ticks=N                (t)
+ *    script=cancelled pending=N          (c)
+ *    script=error reason=... [keys=N]
+ *    script=done scancodes=N             (once the queue is empty again)
+ *
+ *  A line starting with a profiler command (prof.h) is that command.
+ *
+ *  The keys wait in a queue of scancodes, make and break, and are put
+ *  into the keyboard buffer by the timer interrupt through the same
+ *  writebuf() the keyboard interrupt uses, traced the same way. Nothing
+ *  after the buffer can tell them from typed keys, so latencies measured
+ *  from readchar() on compare with those of a real keyboard.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+
+#include <stdint.h>
+
+/* Scancodes waiting, a power of 2 */
+#define SCRIPT_QUEUE 4096
+/* Longest command line */
+#define SCRIPT_LINE  256
+
+/* Commands */
+#define SCRIPT_KEYS   'k'
+#define SCRIPT_MOVES  'm'
+#define SCRIPT_DELAY  't'
+#define SCRIPT_CANCEL 'c'
+#define SCRIPT_CAPTURE 'g'
+
+void script_poll(void);
+int script_next(unsigned long ticks);
+
+#endif
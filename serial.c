@@ -0,0 +1,95 @@
+/** @file serial.c
+ *
+ *  @brief Polled COM1 driver.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <x86/asm.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "serial.h"
+
+/** @brief Set COM1 to 8N1 at 115200 / SERIAL_DIVISOR, no interrupts
+ *
+ *  @return void
+ */
+void serial_init(void){
+    outb(COM1 + UART_IER, 0);
+    outb(COM1 + UART_LCR, LCR_DLAB);
+    outb(COM1 + UART_DATA, SERIAL_DIVISOR & 0xff);
+    outb(COM1 + UART_IER, (SERIAL_DIVISOR >> 8) & 0xff);
+    outb(COM1 + UART_LCR, LCR_8N1);
+    /* Enable and clear the FIFOs, 14-byte threshold */
+    outb(COM1 + UART_FCR, 0xc7);
+    /* DTR, RTS */
+    outb(COM1 + UART_MCR, 0x03);
+}
+
+/** @brief Send a byte, waiting for room in the UART
+ *
+ *  @return void
+ */
+void serial_putc(char c){
+    while((inb(COM1 + UART_LSR) & LSR_EMPTY) == 0)
+        continue;
+    outb(COM1 + UART_DATA, (uint8_t)c);
+}
+
+/** @brief Can a byte be sent without waiting
+ *
+ *  With the FIFO on, the whole transmit FIFO is free when it says so.
+ *
+ *  @return 1 if the transmitter is empty, 0 if it is busy
+ */
+int serial_tx_ready(void){
+    return (inb(COM1 + UART_LSR) & LSR_EMPTY) != 0;
+}
+
+/** @brief Send a string, '\n' goes out as "\r\n"
+ *
+ *  @return void
+ */
+void serial_puts(const char *s){
+    while(*s){
+        if(*s == '\n')
+            serial_putc('\r');
+        serial_putc(*s++);
+    }
+}
+
+/** @brief printf() to COM1, lines of up to 127 characters
+ *
+ *  @return number of characters formatted
+ */
+int serial_printf(const char *fmt, ...){
+    char line[128];
+    va_list ap;
+    int len;
+    va_start(ap, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    serial_puts(line);
+    return len;
+}
+
+/** @brief Next received byte, or -1 if there is none
+ *
+ *  @return the byte, -1
+ */
+int serial_poll(void){
+    if((inb(COM1 + UART_LSR) & LSR_READY) == 0)
+        return -1;
+    return inb(COM1 + UART_DATA);
+}
+
+/** @brief Wait for the next received byte
+ *
+ *  @return the byte
+ */
+int serial_getc(void){
+    int c;
+    while((c = serial_poll()) < 0)
+        continue;
+    return c;
+}
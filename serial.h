@@ -0,0 +1,38 @@
+/** @file serial.h
+ *
+ *  @brief Polled COM1 driver: replays in, reports out.
+ *
+ *  No interrupt is used, the port is read only when the kernel asks for
+ *  a byte, so nothing else in the kernel changes when it is unused.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _SERIAL_H_
+#define _SERIAL_H_
+
+/* COM1 and its registers */
+#define COM1        0x3f8
+#define UART_DATA   0           /* receive/transmit, divisor LSB with DLAB */
+#define UART_IER    1           /* interrupt enable, divisor MSB with DLAB */
+#define UART_FCR    2           /* FIFO control */
+#define UART_LCR    3           /* line control */
+#define UART_MCR    4           /* modem control */
+#define UART_LSR    5           /* line status */
+
+#define LCR_8N1     0x03
+#define LCR_DLAB    0x80
+#define LSR_READY   0x01        /* a byte was received */
+#define LSR_EMPTY   0x20        /* transmit holding register empty */
+
+/* 115200 / SERIAL_DIVISOR baud */
+#define SERIAL_DIVISOR 1
+
+void serial_init(void);
+void serial_putc(char c);
+int serial_tx_ready(void);
+void serial_puts(const char *s);
+int serial_printf(const char *fmt, ...);
+int serial_getc(void);
+int serial_poll(void);
+
+#endif
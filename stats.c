@@ -0,0 +1,213 @@
+/** @file stats.c
+ *
+ *  @brief Session statistics panel, see stats.h.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <p1kern.h>
+
+#include "render.h"
+#include "tsc.h"
+#include "stats.h"
+
+/* Over the instructions of the game UI, right of the board */
+#define PANEL_ROW  7
+#define PANEL_COL  48
+#define PANEL_ROWS 7
+#define PANEL_COLS 32
+
+static stats_hist_t move_hist;
+static stats_hist_t frame_hist;
+static uint32_t last_frame;
+
+static render_region_t panel;
+static int shown = 0;
+static uint32_t tsc_mhz = 0;
+/* Moves and ticks at the last redraw, for moves/s */
+static uint32_t rate_moves = 0;
+static unsigned long rate_ticks = 0;
+static uint32_t rate = 0;
+
+/* Declared in int.c */
+void kbd_stats(uint32_t *high, uint32_t *dropped, uint32_t *size);
+
+/** @brief Bucket of a number of cycles
+ *
+ *  @return the bucket
+ */
+static int bucket(uint32_t v){
+    int e = 31;
+
+    if(v < (1u << STATS_SUB_BITS))
+        return (int)v;
+    while(!(v >> e))
+        e--;
+    return (e - STATS_SUB_BITS + 1) << STATS_SUB_BITS |
+        ((v >> (e - STATS_SUB_BITS)) & ((1u << STATS_SUB_BITS) - 1));
+}
+
+/** @brief Largest number of cycles of a bucket
+ *
+ *  @return the cycles
+ */
+static uint32_t bucket_top(int i){
+    int e = (i >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+    uint64_t low;
+
+    if(i < (1 << STATS_SUB_BITS))
+        return (uint32_t)i;
+    low = (uint64_t)((1 << STATS_SUB_BITS) | (i & ((1 << STATS_SUB_BITS) -
+        1))) << (e - STATS_SUB_BITS);
+    low += (1ULL << (e - STATS_SUB_BITS)) - 1;
+    return low >> 32 ? 0xffffffff : (uint32_t)low;
+}
+
+/** @brief Add a time to a histogram
+ *
+ *  @return void
+ */
+void stats_hist_add(stats_hist_t *h, uint32_t cycles){
+    h->count++;
+    h->total += cycles;
+    h->buckets[bucket(cycles)]++;
+}
+
+/** @brief Mean of a histogram, without 64-bit division
+ *
+ *  @return mean cycles, 0 if empty
+ */
+uint32_t stats_hist_mean(const stats_hist_t *h){
+    return tsc_div(h->total, h->count);
+}
+
+/** @brief Percentile of a histogram
+ *
+ *  @param pct: the percentile, 1 to 100
+ *  @return top of the bucket it falls in, 0 if empty
+ */
+uint32_t stats_hist_percentile(const stats_hist_t *h, uint32_t pct){
+    uint32_t rank, seen = 0;
+    int i;
+
+    if(h->count == 0)
+        return 0;
+    /* Rank of the sample, counted from 1, rounded up, in 32 bits */
+    rank = h->count / 100 * pct + (h->count % 100 * pct + 99) / 100;
+    for(i = 0; i < STATS_BUCKETS; i++){
+        seen += h->buckets[i];
+        if(seen >= rank)
+            return bucket_top(i);
+    }
+    return bucket_top(STATS_BUCKETS - 1);
+}
+
+/** @brief Count a move, from its key to its new block
+ *
+ *  @return void
+ */
+void stats_move(uint64_t cycles){
+    stats_hist_add(&move_hist, cycles >> 32 ? 0xffffffff : (uint32_t)cycles);
+}
+
+/** @brief Count a frame drawn after a move
+ *
+ *  @return void
+ */
+void stats_frame(uint64_t cycles){
+    last_frame = cycles >> 32 ? 0xffffffff : (uint32_t)cycles;
+    stats_hist_add(&frame_hist, last_frame);
+}
+
+/** @brief Cycles as microseconds and hundredths, for "%u.%02u"
+ *
+ *  @return hundredths of a microsecond
+ */
+static uint32_t centi_us(uint32_t cycles){
+    if(cycles < 0xffffffff / 100)
+        return cycles * 100 / tsc_mhz;
+    return cycles / tsc_mhz * 100;
+}
+
+/** @brief Draw the panel and flush it
+ *
+ *  @return void
+ */
+static void redraw(void){
+    uint32_t avg = centi_us(stats_hist_mean(&move_hist));
+    uint32_t p99 = centi_us(stats_hist_percentile(&move_hist, 99));
+    uint32_t frame = centi_us(stats_hist_mean(&frame_hist));
+    uint32_t last = centi_us(last_frame);
+    uint32_t high, dropped, size;
+
+    kbd_stats(&high, &dropped, &size);
+    render_fill(&panel, ' ', FGND_LGRAY);
+    render_text(&panel, 0, 1, FGND_BCYAN, "STATS          'i' to hide");
+    render_printf(&panel, 1, 1, FGND_LGRAY, "MOVES %-9u %u/s",
+        (unsigned int)move_hist.count, (unsigned int)rate);
+    render_printf(&panel, 2, 1, FGND_LGRAY, "MOVE AVG %u.%02uus",
+        (unsigned int)(avg / 100), (unsigned int)(avg % 100));
+    render_printf(&panel, 3, 1, FGND_LGRAY, "MOVE P99 %u.%02uus",
+        (unsigned int)(p99 / 100), (unsigned int)(p99 % 100));
+    render_printf(&panel, 4, 1, FGND_LGRAY, "FRAME %u.%02uus LAST %u.%02uus",
+        (unsigned int)(frame / 100), (unsigned int)(frame % 100),
+        (unsigned int)(last / 100), (unsigned int)(last % 100));
+    render_printf(&panel, 5, 1, FGND_LGRAY, "KBD HIGH WATER %u/%u",
+        (unsigned int)high, (unsigned int)size);
+    render_printf(&panel, 6, 1, dropped ? FGND_RED : FGND_LGRAY,
+        "KBD DROPPED %u", (unsigned int)dropped);
+    render_flush();
+}
+
+/** @brief Show or hide the panel
+ *
+ *  The TSC is measured the first time, which takes TSC_CALIBRATE_TICKS.
+ *  Hiding leaves the panel's cells to the caller, who draws what was
+ *  under it again.
+ *
+ *  @param ticks: the clock, 100 ticks a second
+ *  @return 1 if the panel is shown now, 0 if hidden
+ */
+int stats_toggle(unsigned long ticks){
+    shown = !shown;
+    if(!shown)
+        return 0;
+    rate = 0;
+    rate_moves = move_hist.count;
+    rate_ticks = ticks;
+    if(tsc_mhz == 0){
+        tsc_mhz = tsc_calibrate() / 1000;
+        if(tsc_mhz == 0)
+            tsc_mhz = 1;
+    }
+    render_region(&panel, PANEL_ROW, PANEL_COL, PANEL_ROWS, PANEL_COLS);
+    render_invalidate(&panel);
+    redraw();
+    return 1;
+}
+
+/** @brief Draw the panel again after something else drew over it
+ *
+ *  @return void
+ */
+void stats_expose(void){
+    if(!shown)
+        return;
+    render_invalidate(&panel);
+    redraw();
+}
+
+/** @brief Redraw the panel if it is shown and its period is over
+ *
+ *  @param ticks: the clock, 100 ticks a second
+ *  @return void
+ */
+void stats_poll(unsigned long ticks){
+    if(!shown || ticks - rate_ticks < STATS_PERIOD_TICKS)
+        return;
+    rate = (move_hist.count - rate_moves) * 100 / (uint32_t)(ticks -
+        rate_ticks);
+    rate_moves = move_hist.count;
+    rate_ticks = ticks;
+    redraw();
+}
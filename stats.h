@@ -0,0 +1,44 @@
+/** @file stats.h
+ *
+ *  @brief Session statistics and the panel that shows them.
+ *
+ *  The game hands over the TSC cycles of every move (the move and its
+ *  new block) and of every frame drawn after it. Move times go into a
+ *  histogram of log2 buckets, 4 to a power of 2, so the 99th percentile
+ *  is known to within a quarter of its value without keeping the times.
+ *  With the keyboard buffer's counters from int.c they are shown in a
+ *  panel over the instructions, toggled with 'i' and drawn a few times
+ *  a second through render.h.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+/* 4 buckets per power of 2, up to 2^32 cycles */
+#define STATS_SUB_BITS 2
+#define STATS_BUCKETS  (32 << STATS_SUB_BITS)
+
+/* Panel redraws, in 10ms ticks */
+#define STATS_PERIOD_TICKS 50
+
+typedef struct
+{
+    uint32_t count;
+    uint64_t total;
+    uint32_t buckets[STATS_BUCKETS];
+}stats_hist_t;
+
+void stats_hist_add(stats_hist_t *h, uint32_t cycles);
+uint32_t stats_hist_mean(const stats_hist_t *h);
+uint32_t stats_hist_percentile(const stats_hist_t *h, uint32_t pct);
+
+void stats_move(uint64_t cycles);
+void stats_frame(uint64_t cycles);
+int stats_toggle(unsigned long ticks);
+void stats_expose(void);
+void stats_poll(unsigned long ticks);
+
+#endif
@@ -0,0 +1,93 @@
+/** @file trace.c
+ *
+ *  @brief Event ring of trace.h and its drain to COM1.
+ *
+ *  Slots are taken with an atomic add on the head, so an interrupt
+ *  handler can write while the game loop is in the middle of an event.
+ *  The sequence number, stored last, tells the drain the event is
+ *  complete; an event overwritten while it was copied counts as lost.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <stdio.h>
+
+#include "serial.h"
+#include "tsc.h"
+#include "trace.h"
+
+volatile uint32_t trace_mask = 0;
+
+static trace_event_t ring[TRACE_RING];
+static volatile uint32_t head = 0;      /* next slot to take */
+static uint32_t tail = 0;               /* next slot to drain */
+static uint32_t lost = 0;               /* not reported yet */
+
+/** @brief Start tracing the events of a mask
+ *
+ *  Needs the timer running, to measure the TSC.
+ *
+ *  @param mask: TRACE_BIT() of the types to record
+ *  @return void
+ */
+void trace_start(uint32_t mask){
+    serial_printf("trace=start tsc_khz=%u\n", (unsigned int)tsc_calibrate());
+    trace_mask = mask;
+}
+
+/** @brief Record one event, from any context
+ *
+ *  @param type: TRACE_*
+ *         arg: what the type says
+ *  @return void
+ */
+void trace_event(uint32_t type, uint32_t arg){
+    uint32_t seq = __sync_fetch_and_add(&head, 1);
+    trace_event_t *ev = &ring[seq & (TRACE_RING - 1)];
+
+    ev->tsc = read_tsc();
+    ev->arg = arg;
+    ev->type = (uint16_t)type;
+    __sync_synchronize();
+    ev->seq = seq;
+}
+
+static void send(uint64_t tsc, uint32_t type, uint32_t arg){
+    serial_printf("t %08x%08x %02x %08x\n", (unsigned int)(tsc >> 32),
+        (unsigned int)tsc, (unsigned int)type, (unsigned int)arg);
+}
+
+/** @brief Send some of the recorded events to COM1
+ *
+ *  Called from the idle loop. A line is started only while the UART
+ *  is empty, and at most TRACE_DRAIN_LINES of them, so the game is
+ *  never held up for long.
+ *
+ *  @return void
+ */
+void trace_drain(void){
+    trace_event_t ev;
+    int lines = 0;
+
+    while(tail != head && lines < TRACE_DRAIN_LINES && serial_tx_ready()){
+        if(head - tail > TRACE_RING){
+            lost += head - tail - TRACE_RING;
+            tail = head - TRACE_RING;
+        }
+        ev = ring[tail & (TRACE_RING - 1)];
+        /* Taken but not written yet */
+        if(ev.seq != tail)
+            break;
+        /* Written over while it was copied */
+        if(head - tail > TRACE_RING)
+            continue;
+        tail++;
+        if(lost != 0){
+            send(ev.tsc, TRACE_LOST, lost);
+            lost = 0;
+            lines++;
+        }
+        send(ev.tsc, ev.type, ev.arg);
+        lines++;
+    }
+}
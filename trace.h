@@ -0,0 +1,71 @@
+/** @file trace.h
+ *
+ *  @brief Binary event trace: a ring of TSC-stamped events written from
+ *         interrupt handlers and the game loop, drained to COM1 when
+ *         the game is idle.
+ *
+ *  Writers take a slot with one atomic add and never wait; if the ring
+ *  is full, the oldest events are lost and the drain reports how many.
+ *  Every event goes out on COM1 as one line
+ *
+ *    t TSC TYPE ARG              (hex: 16, 2 and 8 digits)
+ *
+ *  after "trace=start tsc_khz=N". host/trace2json turns the lines into
+ *  Chrome trace JSON.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+/* Event types and their argument */
+#define TRACE_IRQ_ENTER    0x01     /* irq number */
+#define TRACE_IRQ_EXIT     0x02     /* irq number */
+#define TRACE_KEY          0x03     /* character */
+/* MOVE_* in bits 0-1, 1 if the board moved in bit 8, the player in
+ * bits 12-15 (0, or 0 and 1 in versus mode) */
+#define TRACE_MOVE         0x04
+#define TRACE_SPAWN        0x05     /* square x * 4 + y | log2 value << 8 */
+#define TRACE_RENDER_BEGIN 0x06
+#define TRACE_RENDER_END   0x07
+#define TRACE_SEARCH_BEGIN 0x08     /* max depth */
+#define TRACE_SEARCH_END   0x09     /* nodes */
+#define TRACE_LOST         0x0a     /* events lost to a full ring */
+#define TRACE_TIMER_ENTER  0x0b     /* timer irq, only with "trace=all" */
+#define TRACE_TIMER_EXIT   0x0c
+#define TRACE_TYPES        0x0d
+
+#define TRACE_BIT(type) (1u << (type))
+/* Everything but the timer, 200 events a second on its own */
+#define TRACE_DEFAULT (((1u << TRACE_TYPES) - 1) & \
+    ~(TRACE_BIT(TRACE_TIMER_ENTER) | TRACE_BIT(TRACE_TIMER_EXIT)))
+#define TRACE_ALL ((1u << TRACE_TYPES) - 1)
+
+/* Events in the ring, a power of 2 */
+#define TRACE_RING 1024
+/* Lines sent by one trace_drain() at most */
+#define TRACE_DRAIN_LINES 8
+
+typedef struct
+{
+    uint64_t tsc;
+    uint32_t arg;
+    uint32_t seq;           /* slot number, written last */
+    uint16_t type;
+}trace_event_t;
+
+extern volatile uint32_t trace_mask;
+
+void trace_start(uint32_t mask);
+void trace_event(uint32_t type, uint32_t arg);
+void trace_drain(void);
+
+/* Cheap enough to leave in hot paths when tracing is off */
+#define TRACE(type, arg) do{ \
+    if(trace_mask & TRACE_BIT(type)) \
+        trace_event((type), (arg)); \
+}while(0)
+
+#endif
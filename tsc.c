@@ -0,0 +1,31 @@
+/** @file tsc.c
+ *
+ *  @brief Rate of the time stamp counter, measured against the timer.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include "tsc.h"
+
+/* Declared in game.c */
+unsigned long get_ticks(void);
+
+/** @brief Measure the TSC against the timer, which must be running
+ *
+ *  Takes TSC_CALIBRATE_TICKS ticks.
+ *
+ *  @return TSC cycles per millisecond
+ */
+uint32_t tsc_calibrate(void){
+    unsigned long t = get_ticks();
+    uint64_t t0;
+
+    /* Start on a tick edge */
+    while(get_ticks() == t)
+        continue;
+    t = get_ticks();
+    t0 = read_tsc();
+    while(get_ticks() - t < TSC_CALIBRATE_TICKS)
+        continue;
+    return (uint32_t)(read_tsc() - t0) / (TSC_CALIBRATE_TICKS * 10);
+}
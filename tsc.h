@@ -0,0 +1,44 @@
+/** @file tsc.h
+ *
+ *  @brief Time stamp counter, for measuring short stretches of code.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _TSC_H_
+#define _TSC_H_
+
+#include <stdint.h>
+
+/* Timer ticks (10ms each) tsc_calibrate() measures over */
+#define TSC_CALIBRATE_TICKS 10
+
+uint32_t tsc_calibrate(void);
+
+/** @brief Read the time stamp counter
+ *
+ *  @return cycles since reset, at the TSC's rate
+ */
+static inline uint64_t read_tsc(void){
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/** @brief Cycles divided by a count, without 64-bit division
+ *
+ *  The kernel has no 64-bit divide, so both are halved until the
+ *  cycles fit in 32 bits; that costs at most a bit of precision.
+ *
+ *  @param cycles: the total
+ *         n: what it is divided by
+ *  @return cycles per count, 0 if n is 0
+ */
+static inline uint32_t tsc_div(uint64_t cycles, uint32_t n){
+    while(cycles >> 32){
+        cycles >>= 1;
+        n >>= 1;
+    }
+    return n ? (uint32_t)cycles / n : 0;
+}
+
+#endif
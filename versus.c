@@ -0,0 +1,280 @@
+/** @file versus.c
+ *
+ *  @brief Versus mode, see versus.h.
+ *
+ *  Two players can press keys twice as fast as one, and every key comes
+ *  as a make and a break scancode. So the loop first empties the whole
+ *  keyboard buffer, playing every move it finds, and only then draws,
+ *  once: the drawing goes into the shadow screen and only the cells that
+ *  changed reach the VGA memory, which keeps a frame short next to the
+ *  time the keys need to fill the buffer.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <p1kern.h>
+#include <x86/keyhelp.h>
+
+#include "engine.h"
+#include "render.h"
+#include "prof.h"
+#include "trace.h"
+#include "script.h"
+#include "capture.h"
+#include "int.h"
+#include "versus.h"
+
+/* Keys of both players */
+#define VS_PAUSE   'p'
+#define VS_QUIT    'q'
+#define VS_RESTART 'r'
+#define VS_CAPTURE 'g'
+
+/* Halves of the screen and what goes where in them */
+#define VS_HALF_COLS  (RENDER_COLS / VERSUS_PLAYERS)
+#define VS_HALF_ROWS  20
+#define VS_NAME_ROW   0
+#define VS_SCORE_ROW  1
+#define VS_BOARD_ROW  2
+#define VS_BOARD_COL  1
+#define VS_STATUS_ROW 19
+/* A block is 8 by 3 inside the grid, the board 37 by 17 */
+#define VS_CELL_W     8
+#define VS_CELL_H     3
+
+/* Shared lines below the boards */
+#define VS_INFO_ROW   21
+#define VS_INFO_ROWS  4
+
+typedef struct
+{
+    int key;
+    int player;
+    int dir;                /* MOVE_* */
+}vs_key_t;
+
+/* w a s d for the left player, i j k l or the arrows for the right */
+static const vs_key_t keymap[] = {
+    { 'w', 0, MOVE_UP },    { 's', 0, MOVE_DOWN },
+    { 'a', 0, MOVE_LEFT },  { 'd', 0, MOVE_RIGHT },
+    { 'i', 1, MOVE_UP },    { 'k', 1, MOVE_DOWN },
+    { 'j', 1, MOVE_LEFT },  { 'l', 1, MOVE_RIGHT },
+    /* readchar() gives these unsigned, as keyhelp.h defines them */
+    { KHE_ARROW_UP, 1, MOVE_UP },     { KHE_ARROW_DOWN, 1, MOVE_DOWN },
+    { KHE_ARROW_LEFT, 1, MOVE_LEFT }, { KHE_ARROW_RIGHT, 1, MOVE_RIGHT },
+};
+#define KEYMAP_LEN ((int)(sizeof(keymap) / sizeof(keymap[0])))
+
+typedef struct
+{
+    game_t g;
+    render_region_t r;
+    const char *name;
+    const char *keys;       /* shown next to the name */
+    uint32_t moves;
+    int over;
+    int dirty;              /* to be drawn again */
+}player_t;
+
+static player_t players[VERSUS_PLAYERS] = {
+    { .name = "PLAYER 1", .keys = "w a s d" },
+    { .name = "PLAYER 2", .keys = "i j k l / arrows" },
+};
+static render_region_t info;
+
+/* Declared in int.c */
+int kbd_pending(void);
+
+/** @brief Which player a key moves, and where
+ *
+ *  @param ch: the character from readchar()
+ *         player: where the player goes
+ *  @return MOVE_*, -1 if the key is not a move
+ */
+int versus_decode(int ch, int *player){
+    int i;
+
+    for(i = 0; i < KEYMAP_LEN; i++){
+        if(keymap[i].key == ch){
+            *player = keymap[i].player;
+            return keymap[i].dir;
+        }
+    }
+    return -1;
+}
+
+/** @brief Start both games again, keeping the best scores
+ *
+ *  @return void
+ */
+static void new_round(int target_score, uint32_t seed){
+    player_t *p;
+    int best, i;
+
+    render_reset();
+    render_region(&info, VS_INFO_ROW, 0, VS_INFO_ROWS, RENDER_COLS);
+    for(i = 0; i < VERSUS_PLAYERS; i++){
+        p = &players[i];
+        best = p->g.best_score;
+        engine_init(&p->g, seed, target_score);
+        p->g.best_score = best;
+        engine_add_random(&p->g);
+        engine_add_random(&p->g);
+        render_region(&p->r, 0, i * VS_HALF_COLS, VS_HALF_ROWS,
+            VS_HALF_COLS);
+        p->moves = 0;
+        p->over = 0;
+        p->dirty = 1;
+    }
+}
+
+/** @brief Draw one player's half of the screen
+ *
+ *  @return void
+ */
+static void draw_player(player_t *p){
+    const render_region_t *r = &p->r;
+
+    render_printf(r, VS_NAME_ROW, VS_BOARD_COL, FGND_BCYAN, "%s", p->name);
+    render_printf(r, VS_NAME_ROW, VS_BOARD_COL + 12, FGND_LGRAY, "%s",
+        p->keys);
+    render_printf(r, VS_SCORE_ROW, VS_BOARD_COL, FGND_BMAG, "SCORE %-8d",
+        p->g.score);
+    render_printf(r, VS_SCORE_ROW, VS_BOARD_COL + 18, FGND_BCYAN,
+        "BEST %-8d", p->g.best_score);
+    render_board(r, VS_BOARD_ROW, VS_BOARD_COL, p->g.board, VS_CELL_W,
+        VS_CELL_H);
+    render_printf(r, VS_STATUS_ROW, VS_BOARD_COL, FGND_LGRAY,
+        "MOVES %-8u", (unsigned int)p->moves);
+    render_text(r, VS_STATUS_ROW, VS_BOARD_COL + 18, FGND_RED,
+        p->over ? "GAME OVER" : "         ");
+    p->dirty = 0;
+}
+
+/** @brief Draw the shared lines below the boards
+ *
+ *  @param winner: the player who won, -1 while playing, VERSUS_PLAYERS
+ *                 for a draw
+ *  @return void
+ */
+static void draw_info(int target_score, int seconds, int pause, int winner){
+    render_fill(&info, ' ', FGND_LGRAY);
+    render_printf(&info, 0, 1, FGND_BCYAN, "In '%d' Mode   TIME: %d",
+        target_score, seconds);
+    if(winner == VERSUS_PLAYERS)
+        render_text(&info, 1, 1, FGND_BCYAN, "DRAW!");
+    else if(winner >= 0)
+        render_printf(&info, 1, 1, FGND_BCYAN, "%s WINS!",
+            players[winner].name);
+    else if(pause)
+        render_text(&info, 1, 1, FGND_BCYAN,
+            "PAUSE! Press 'p' again to resume the game!");
+    render_text(&info, 2, 1, FGND_LGRAY, winner >= 0 ?
+        "'r' to play again   'q' to quit" :
+        "'p' to pause   'r' to restart   'q' to quit");
+}
+
+/** @brief Who won, if the round is over
+ *
+ *  The first to reach the target wins. Once both boards are stuck, the
+ *  higher score does.
+ *
+ *  @return the player, VERSUS_PLAYERS for a draw, -1 if still playing
+ */
+static int find_winner(void){
+    int i;
+
+    for(i = 0; i < VERSUS_PLAYERS; i++){
+        if(is_win(&players[i].g))
+            return i;
+    }
+    for(i = 0; i < VERSUS_PLAYERS; i++){
+        if(!players[i].over)
+            return -1;
+    }
+    if(players[0].g.score == players[1].g.score)
+        return VERSUS_PLAYERS;
+    return players[0].g.score > players[1].g.score ? 0 : 1;
+}
+
+/** @brief Play versus rounds until 'q'
+ *
+ *  @param target_score: target of both games
+ *         seed: seed of the first round, the next ones take the clock
+ *         ticks: clock, TIMER_HZ ticks a second
+ *  @return void
+ */
+void versus_run(int target_score, uint32_t seed,
+    unsigned long (*ticks)(void)){
+    unsigned long now, last, played;
+    int ch, dir, i, pause, winner, info_dirty, seconds, result;
+    player_t *p;
+
+    hide_cursor();
+restart:
+    new_round(target_score, seed);
+    pause = 0;
+    winner = -1;
+    info_dirty = 1;
+    seconds = 0;
+    played = 0;
+    last = ticks();
+    while(1){
+        /* Every key waiting, before anything is drawn */
+        while(kbd_pending()){
+            if((ch = readchar()) == -1)
+                continue;
+            TRACE(TRACE_KEY, (uint8_t)ch);
+            if(ch == VS_QUIT){
+                return;
+            }else if(ch == VS_RESTART){
+                seed = (uint32_t)ticks();
+                goto restart;
+            }else if(ch == VS_PAUSE && winner < 0){
+                pause = !pause;
+                info_dirty = 1;
+                continue;
+            }else if(ch == VS_CAPTURE){
+                capture_dump();
+                continue;
+            }
+            if(pause || winner >= 0 || (dir = versus_decode(ch, &i)) < 0)
+                continue;
+            p = &players[i];
+            if(p->over)
+                continue;
+            result = engine_step(&p->g, dir);
+            TRACE(TRACE_MOVE, dir | result << 8 | i << 12);
+            p->moves += result;
+            p->over = engine_is_over(p->g.board);
+            p->dirty |= result | p->over;
+            if((winner = find_winner()) >= 0)
+                info_dirty = 1;
+        }
+        /* Time of the round, stopped while paused or over */
+        now = ticks();
+        if(!pause && winner < 0)
+            played += now - last;
+        last = now;
+        if((int)(played / TIMER_HZ) != seconds){
+            seconds = (int)(played / TIMER_HZ);
+            info_dirty = 1;
+        }
+
+        if(!info_dirty && !players[0].dirty && !players[1].dirty){
+            script_poll();
+            trace_drain();
+            continue;
+        }
+        TRACE(TRACE_RENDER_BEGIN, 0);
+        for(i = 0; i < VERSUS_PLAYERS; i++){
+            if(players[i].dirty)
+                draw_player(&players[i]);
+        }
+        if(info_dirty)
+            draw_info(target_score, seconds, pause, winner);
+        info_dirty = 0;
+        render_flush();
+        TRACE(TRACE_RENDER_END, 0);
+    }
+}
@@ -0,0 +1,23 @@
+/** @file versus.h
+ *
+ *  @brief Versus mode: two games side by side on one keyboard.
+ *
+ *  Each player has a game_t of their own and half of the screen, drawn
+ *  through a region of render.h. Both games start from the same seed,
+ *  so the new blocks only differ where the moves do. Keys are decoded
+ *  for both players in one place, versus_decode().
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _VERSUS_H_
+#define _VERSUS_H_
+
+#include <stdint.h>
+
+#define VERSUS_PLAYERS 2
+
+int versus_decode(int ch, int *player);
+void versus_run(int target_score, uint32_t seed,
+    unsigned long (*ticks)(void));
+
+#endif
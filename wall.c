@@ -0,0 +1,219 @@
+/** @file wall.c
+ *
+ *  @brief Wall of boards, see wall.h.
+ *
+ *  The kernel has one processor, so the games share it in frames: the
+ *  search plays one move of every game in turn, round robin, until the
+ *  frame's time is up, and the frame ends with one flush of the shadow
+ *  screen. Only the boards that moved are drawn again, and of them only
+ *  the cells that changed are written.
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ *  @bug No known bugs.
+ */
+#include <p1kern.h>
+
+#include "engine.h"
+#include "bitboard.h"
+#include "ai.h"
+#include "render.h"
+#include "serial.h"
+#include "prof.h"
+#include "trace.h"
+#include "script.h"
+#include "capture.h"
+#include "int.h"
+#include "wall.h"
+
+/* Keys */
+#define WALL_QUIT   'q'
+#define WALL_PAUSE  'p'
+#define WALL_DEEPER '+'
+#define WALL_LESS   '-'
+#define WALL_CAPTURE 'g'
+
+/* Regions: 4 rows down, a header row over the board and a gap below */
+#define WALL_DOWN        4
+#define WALL_REGION_ROWS 6
+#define WALL_STATUS_ROW  24
+/* Narrower regions show the score only, the narrowest nothing */
+#define WALL_ID_COLS     16
+#define WALL_SCORE_COLS  8
+
+/* 20 frames a second */
+#define WALL_FRAME_TICKS (TIMER_HZ / 20)
+/* Seconds between two lines on COM1 */
+#define WALL_REPORT_SECS 5
+
+/* Search of every move, deepened with '+' */
+#define WALL_DEPTH     2
+#define WALL_MAX_DEPTH 6
+#define WALL_SEARCH_MS 10
+
+typedef struct
+{
+    game_t g;
+    render_region_t r;
+    int dirty;              /* moved since the last frame */
+}wall_game_t;
+
+static wall_game_t wall[WALL_MAX];
+static render_region_t status;
+static uint32_t next_seed = 1;
+static uint32_t games_done = 0;
+
+/* Declared in int.c */
+int kbd_pending(void);
+
+/** @brief Start a new game in a slot, with the next seed
+ *
+ *  @return void
+ */
+static void new_game(wall_game_t *w){
+    engine_init(&w->g, next_seed++, 2048);
+    engine_add_random(&w->g);
+    engine_add_random(&w->g);
+    w->dirty = 1;
+}
+
+/** @brief Search and play one move of a game, a new game once it is over
+ *
+ *  @return 1 if a move was played, 0 if the game was over
+ */
+static int step(ai_ctx_t *ai, wall_game_t *w, int depth){
+    int move;
+
+    TRACE(TRACE_SEARCH_BEGIN, depth);
+    move = ai_search(ai, bb_pack(w->g.board), depth, WALL_SEARCH_MS);
+    TRACE(TRACE_SEARCH_END, ai_get_stats(ai)->nodes);
+    if(move < 0 || !engine_step(&w->g, move)){
+        games_done++;
+        new_game(w);
+        return 0;
+    }
+    w->dirty = 1;
+    return 1;
+}
+
+/** @brief Draw a game into its region
+ *
+ *  @param id: number of the game, shown on wide regions
+ *         cell_w: columns of a block
+ *  @return void
+ */
+static void draw_game(wall_game_t *w, int id, int cell_w){
+    const render_region_t *r = &w->r;
+
+    if(r->cols >= WALL_ID_COLS)
+        render_printf(r, 0, 0, FGND_BCYAN, "#%-2d %-10d", id, w->g.score);
+    else if(r->cols >= WALL_SCORE_COLS)
+        render_printf(r, 0, 0, FGND_BCYAN, "%-7d", w->g.score);
+    render_mini_board(r, 1, 0, w->g.board, cell_w);
+    w->dirty = 0;
+}
+
+/** @brief Play and show the wall until 'q'
+ *
+ *  @param ai: search context, set up with its clock
+ *         boards: number of games, WALL_MIN to WALL_MAX
+ *         ticks: clock, TIMER_HZ ticks a second
+ *  @return void
+ */
+void wall_run(ai_ctx_t *ai, int boards, unsigned long (*ticks)(void)){
+    unsigned long now, frame_end, sec_start, report_at;
+    uint32_t moves = 0, sec_moves = 0, sec_frames = 0, sec_cells = 0;
+    uint32_t mps = 0, fps = 0, cpf = 0;
+    int across, cols, cell_w, depth = WALL_DEPTH, pause = 0;
+    int i, ch, played, next = 0;
+
+    /* 4, 8 or 16 boards across the screen */
+    if(boards <= WALL_MIN)
+        across = WALL_MIN / WALL_DOWN;
+    else if(boards <= WALL_MAX / 2)
+        across = WALL_MAX / 2 / WALL_DOWN;
+    else
+        across = WALL_MAX / WALL_DOWN;
+    boards = across * WALL_DOWN;
+    cols = RENDER_COLS / across;
+    cell_w = (cols - 1) / SIZE;
+
+    render_reset();
+    hide_cursor();
+    for(i = 0; i < boards; i++){
+        render_region(&wall[i].r, i / across * WALL_REGION_ROWS,
+            i % across * cols, WALL_REGION_ROWS, cols);
+        new_game(&wall[i]);
+    }
+    render_region(&status, WALL_STATUS_ROW, 0, 1, RENDER_COLS);
+
+    now = ticks();
+    frame_end = now + WALL_FRAME_TICKS;
+    sec_start = now;
+    report_at = now + WALL_REPORT_SECS * TIMER_HZ;
+    while(1){
+        while(kbd_pending()){
+            switch(ch = readchar()){
+                case WALL_QUIT:
+                    return;
+                case WALL_PAUSE:
+                    pause = !pause;
+                    break;
+                case WALL_DEEPER:
+                    if(depth < WALL_MAX_DEPTH)
+                        depth++;
+                    break;
+                case WALL_LESS:
+                    if(depth > 1)
+                        depth--;
+                    break;
+                case WALL_CAPTURE:
+                    capture_dump();
+                    break;
+            }
+        }
+        /* The games take turns until the frame is up */
+        do{
+            if(!pause){
+                played = step(ai, &wall[next], depth);
+                moves += played;
+                sec_moves += played;
+                next = next + 1 < boards ? next + 1 : 0;
+            }
+        }while(ticks() < frame_end && !kbd_pending());
+
+        /* One flush for all the boards that moved */
+        TRACE(TRACE_RENDER_BEGIN, 0);
+        for(i = 0; i < boards; i++){
+            if(wall[i].dirty)
+                draw_game(&wall[i], i, cell_w);
+        }
+        render_fill(&status, ' ', FGND_LGRAY);
+        render_printf(&status, 0, 0, FGND_LGRAY, "%d boards  depth %d  "
+            "%u moves/s  %u games  %u fps  %u cells/frame", boards, depth,
+            (unsigned int)mps, (unsigned int)games_done, (unsigned int)fps,
+            (unsigned int)cpf);
+        sec_cells += render_flush();
+        sec_frames++;
+        TRACE(TRACE_RENDER_END, 0);
+
+        now = ticks();
+        frame_end = now + WALL_FRAME_TICKS;
+        if(now - sec_start >= TIMER_HZ){
+            mps = sec_moves * TIMER_HZ / (now - sec_start);
+            fps = sec_frames * TIMER_HZ / (now - sec_start);
+            cpf = sec_cells / sec_frames;
+            sec_moves = sec_frames = sec_cells = 0;
+            sec_start = now;
+        }
+        if(now >= report_at){
+            serial_printf("wall boards=%d depth=%d moves=%u mps=%u games=%u"
+                " fps=%u cells_per_frame=%u\n", boards, depth,
+                (unsigned int)moves, (unsigned int)mps,
+                (unsigned int)games_done, (unsigned int)fps,
+                (unsigned int)cpf);
+            report_at = now + WALL_REPORT_SECS * TIMER_HZ;
+        }
+        script_poll();
+        trace_drain();
+    }
+}
@@ -0,0 +1,25 @@
+/** @file wall.h
+ *
+ *  @brief Wall of boards: many games played by the search at once, each
+ *         drawn small in its own region of the screen.
+ *
+ *  A stress test and a visual check of the engine, the search and the
+ *  renderer together, run instead of the game with the "wall" or
+ *  "wall=N" boot option. Every few seconds a line goes to COM1:
+ *
+ *    wall boards=N depth=D moves=M mps=X games=G fps=F cells_per_frame=C
+ *
+ *  @author Yuhang Jiang(yuhangj)
+ */
+#ifndef _WALL_H_
+#define _WALL_H_
+
+#include "ai.h"
+
+/* Boards on the wall: 4, 8 or 16 across, 4 down */
+#define WALL_MIN 16
+#define WALL_MAX 64
+
+void wall_run(ai_ctx_t *ai, int boards, unsigned long (*ticks)(void));
+
+#endif